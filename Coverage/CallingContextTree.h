@@ -0,0 +1,242 @@
+#pragma once
+
+#include "ProfileNode.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// Profile store: the sampled call stacks as a calling-context tree.
+/// A frame is an interned (function, file, line) triple; a node is a frame under a given call path. Nodes live in one
+/// arena and are found from (parent, frame) in an open-addressing table, so recording a sample is a walk of integer
+/// lookups, without string hashing or allocation once the paths were seen.
+/// The per-line Deep/Shallow figures of the reports are derived from the node counts at report time (lines()).
+class CallingContextTree
+{
+public:
+  using FrameId = uint32_t;
+  using NodeId = uint32_t;
+
+  static constexpr NodeId Root = 0;
+
+  struct Frame
+  {
+    uint32_t function;
+    uint32_t file;
+    uint32_t line;
+
+    bool operator==(const Frame&) const = default;
+  };
+
+  struct FrameHash
+  {
+    size_t operator()(const Frame& frame) const
+    {
+      return std::hash<uint64_t>()((uint64_t(frame.function) << 32) ^ (uint64_t(frame.file) << 20) ^ frame.line);
+    }
+  };
+
+  struct Node
+  {
+    FrameId frame;
+    NodeId parent;
+    uint64_t inclusive = 0;   ///< Samples with this node on the stack (the root counts all samples)
+    uint64_t exclusive = 0;   ///< Samples with this node on top of the stack
+  };
+
+  CallingContextTree() :
+    _slots(16, Root)
+  {
+    _nodes.push_back(Node{ 0, Root });
+  }
+
+  // Avoid copy constructor
+  CallingContextTree(const CallingContextTree&) = delete;
+  CallingContextTree(CallingContextTree&&) = default;
+
+  FrameId intern(std::string_view function, std::string_view filename, uint32_t line)
+  {
+    const Frame frame = { internString(_functions, _functionIds, function), internString(_files, _fileIds, filename), line };
+    const auto it = _frameIds.emplace(frame, FrameId(_frames.size())).first;
+    if (it->second == _frames.size())
+    {
+      _frames.push_back(frame);
+    }
+    return it->second;
+  }
+
+  /// Record one sample of the call stack \p frames, outermost caller first.
+  void record(const FrameId* frames, size_t count)
+  {
+    if (count == 0)
+    {
+      return;
+    }
+
+    NodeId node = Root;
+    ++_nodes[Root].inclusive;
+    for (size_t i = 0; i < count; ++i)
+    {
+      node = child(node, frames[i]);
+      ++_nodes[node].inclusive;
+    }
+    ++_nodes[node].exclusive;
+  }
+
+  uint64_t samples() const { return _nodes[Root].inclusive; }
+  size_t size() const { return _nodes.size(); }
+  size_t frames() const { return _frames.size(); }
+  const Node& node(NodeId id) const { return _nodes[id]; }
+  const Frame& frame(FrameId id) const { return _frames[id]; }
+  const std::string& function(uint32_t id) const { return _functions[id]; }
+  const std::string& file(uint32_t id) const { return _files[id]; }
+
+  /// Per-line profile of the files, as the reports expect it:
+  /// - DeepSamples: samples with the line on the stack, once per occurrence in the stack
+  /// - ShallowSamples: samples with the line on top of the stack
+  /// - Deep: percentage of DeepSamples in all DeepSamples
+  /// - Shallow: percentage of ShallowSamples in the ShallowSamples of the functions of the line
+  ///   (FunctionShallowSamples; usually one function, several for lambdas or macros on one line)
+  /// Returns the sum of all DeepSamples.
+  uint64_t lines(std::unordered_map<std::string, std::unique_ptr<std::vector<ProfileInfo>>>& mergedInfo) const
+  {
+    std::vector<uint64_t> deep(_frames.size()), shallow(_frames.size());
+    for (NodeId id = Root + 1; id < _nodes.size(); ++id)
+    {
+      deep[_nodes[id].frame] += _nodes[id].inclusive;
+      shallow[_nodes[id].frame] += _nodes[id].exclusive;
+    }
+
+    uint64_t totalDeep = 0;
+    std::vector<uint64_t> functionShallow(_functions.size());
+    for (FrameId id = 0; id < _frames.size(); ++id)
+    {
+      totalDeep += deep[id];
+      functionShallow[_frames[id].function] += shallow[id];
+    }
+
+    std::vector<std::vector<ProfileInfo>*> files(_files.size(), nullptr);
+    for (FrameId id = 0; id < _frames.size(); ++id)
+    {
+      const auto& frame = _frames[id];
+      auto& merged = files[frame.file];
+      if (merged == nullptr)
+      {
+        auto& entry = mergedInfo[_files[frame.file]];
+        if (!entry)
+        {
+          entry = std::make_unique<std::vector<ProfileInfo>>();
+        }
+        merged = entry.get();
+      }
+
+      if (merged->size() <= frame.line)
+      {
+        merged->resize(size_t(frame.line) + 1);
+      }
+
+      // Frames are unique per (function, file, line): each frame of a line adds the total of another function
+      auto& info = (*merged)[frame.line];
+      info.DeepSamples += deep[id];
+      info.ShallowSamples += shallow[id];
+      info.FunctionShallowSamples += functionShallow[frame.function];
+    }
+
+    // Percentages from the counts only, as merges compute them again
+    for (auto* merged : files)
+    {
+      if (merged != nullptr)
+      {
+        for (auto& info : *merged)
+        {
+          info.Deep = ProfileInfo::Percent(info.DeepSamples, totalDeep);
+          info.Shallow = ProfileInfo::Percent(info.ShallowSamples, info.FunctionShallowSamples);
+        }
+      }
+    }
+    return totalDeep;
+  }
+
+private:
+  // Heterogeneous lookup: symbol and file names repeat on every sample, no key is allocated to find them
+  struct StringHash
+  {
+    using is_transparent = void;
+    size_t operator()(std::string_view value) const { return std::hash<std::string_view>()(value); }
+  };
+  using StringIds = std::unordered_map<std::string, uint32_t, StringHash, std::equal_to<>>;
+
+  static uint32_t internString(std::vector<std::string>& strings, StringIds& ids, std::string_view value)
+  {
+    auto it = ids.find(value);
+    if (it != ids.end())
+    {
+      return it->second;
+    }
+    const auto id = uint32_t(strings.size());
+    strings.emplace_back(value);
+    ids.emplace(strings.back(), id);
+    return id;
+  }
+
+  static size_t hash(NodeId parent, FrameId frame)
+  {
+    uint64_t key = (uint64_t(parent) << 32) | frame;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return size_t(key);
+  }
+
+  NodeId child(NodeId parent, FrameId frame)
+  {
+    const size_t mask = _slots.size() - 1;
+    size_t slot = hash(parent, frame) & mask;
+    for (; _slots[slot] != Root; slot = (slot + 1) & mask)
+    {
+      const auto& node = _nodes[_slots[slot]];
+      if (node.parent == parent && node.frame == frame)
+      {
+        return _slots[slot];
+      }
+    }
+
+    const auto id = NodeId(_nodes.size());
+    _nodes.push_back(Node{ frame, parent });
+    _slots[slot] = id;
+
+    // Keep the load factor under 1/2
+    if (_nodes.size() * 2 > _slots.size())
+    {
+      rehash(_slots.size() * 2);
+    }
+    return id;
+  }
+
+  void rehash(size_t capacity)
+  {
+    _slots.assign(capacity, Root);
+    const size_t mask = capacity - 1;
+    for (NodeId id = Root + 1; id < _nodes.size(); ++id)
+    {
+      size_t slot = hash(_nodes[id].parent, _nodes[id].frame) & mask;
+      while (_slots[slot] != Root)
+      {
+        slot = (slot + 1) & mask;
+      }
+      _slots[slot] = id;
+    }
+  }
+
+  std::vector<Node> _nodes;       ///< Arena: nodes are never freed, ids are indexes
+  std::vector<NodeId> _slots;     ///< Open-addressing (parent, frame) -> node; Root marks empty slots
+  std::vector<Frame> _frames;
+  std::unordered_map<Frame, FrameId, FrameHash> _frameIds;
+  std::vector<std::string> _functions;
+  StringIds _functionIds;
+  std::vector<std::string> _files;
+  StringIds _fileIds;
+};
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Compact encodings of NativeV2 line arrays (report version 2.1), stored base64 encoded in
+/// <coverage encoding="..."> instead of the raw little-endian uint16_t words.
+/// Both encodings start with varint(nbLines):
+///  - Rle:    (varint(run length), varint(value))* : runs of identical words.
+///  - Sparse: (varint(gap), varint(value))*        : non-zero words only, gap = number of zero words skipped.
+struct CompactLines
+{
+  static constexpr size_t MaxLines = size_t(1) << 26;  ///< Sanity limit against corrupted line counts
+
+  enum class Encoding
+  {
+    Raw,
+    Rle,
+    Sparse
+  };
+
+  static std::string_view Name(Encoding encoding)
+  {
+    switch (encoding)
+    {
+      case Encoding::Rle:    return "rle";
+      case Encoding::Sparse: return "sparse";
+      default:               return "";
+    }
+  }
+
+  /// Parse an encoding attribute. An empty name is the raw array.
+  static Encoding FromName(std::string_view name)
+  {
+    if (name.empty())
+      return Encoding::Raw;
+    if (name == "rle")
+      return Encoding::Rle;
+    if (name == "sparse")
+      return Encoding::Sparse;
+    throw std::runtime_error("Unsupported line encoding: " + std::string(name));
+  }
+
+  /// Smallest encoding for these lines: the raw array when nothing is gained.
+  static Encoding Choose(std::span<const uint16_t> lines)
+  {
+    size_t rle = VarintSize(lines.size());
+    size_t sparse = rle;
+    size_t gap = 0;
+    for (size_t i = 0; i < lines.size();)
+    {
+      size_t run = 1;
+      while (i + run < lines.size() && lines[i + run] == lines[i])
+      {
+        ++run;
+      }
+      rle += VarintSize(run) + VarintSize(lines[i]);
+
+      if (lines[i] == 0)
+      {
+        gap += run;
+      }
+      else
+      {
+        sparse += VarintSize(gap) + VarintSize(lines[i]) + (run - 1) * (1 + VarintSize(lines[i]));
+        gap = 0;
+      }
+      i += run;
+    }
+
+    const size_t raw = lines.size() * sizeof(uint16_t);
+    if (sparse < rle && sparse < raw)
+      return Encoding::Sparse;
+    if (rle < raw)
+      return Encoding::Rle;
+    return Encoding::Raw;
+  }
+
+  /// Append the encoded lines to \p out (raw = little-endian words).
+  static void Encode(std::span<const uint16_t> lines, Encoding encoding, std::string& out)
+  {
+    if (encoding == Encoding::Raw)
+    {
+      out.append(reinterpret_cast<const char*>(lines.data()), lines.size() * sizeof(uint16_t));
+      return;
+    }
+
+    PutVarint(out, lines.size());
+    size_t gap = 0;
+    for (size_t i = 0; i < lines.size();)
+    {
+      size_t run = 1;
+      while (i + run < lines.size() && lines[i + run] == lines[i])
+      {
+        ++run;
+      }
+
+      if (encoding == Encoding::Rle)
+      {
+        PutVarint(out, run);
+        PutVarint(out, lines[i]);
+      }
+      else if (lines[i] == 0)
+      {
+        gap += run;
+      }
+      else
+      {
+        for (size_t k = 0; k < run; ++k)
+        {
+          PutVarint(out, gap);
+          PutVarint(out, lines[i]);
+          gap = 0;
+        }
+      }
+      i += run;
+    }
+  }
+
+  /// Decode \p data into \p lines. Throws std::runtime_error on malformed data.
+  static void Decode(std::string_view data, Encoding encoding, std::vector<uint16_t>& lines)
+  {
+    if (encoding == Encoding::Raw)
+    {
+      if (data.size() % sizeof(uint16_t) != 0)
+      {
+        throw std::runtime_error("Coverage data size is not a multiple of line size");
+      }
+      lines.resize(data.size() / sizeof(uint16_t));
+      std::memcpy(lines.data(), data.data(), data.size());
+      return;
+    }
+
+    const char* it = data.data();
+    const char* end = it + data.size();
+    const size_t nbLines = GetVarint(it, end);
+    if (nbLines > MaxLines)
+    {
+      throw std::runtime_error("Invalid line count in line encoding");
+    }
+    lines.assign(nbLines, 0);
+
+    size_t index = 0;
+    while (it != end)
+    {
+      const size_t first = GetVarint(it, end);
+      const uint16_t value = GetValue(it, end);
+      if (encoding == Encoding::Rle)
+      {
+        if (first > nbLines - index)
+        {
+          throw std::runtime_error("Line encoding overflows line array");
+        }
+        std::fill_n(lines.begin() + index, first, value);
+        index += first;
+      }
+      else
+      {
+        if (first >= nbLines - index)
+        {
+          throw std::runtime_error("Line encoding overflows line array");
+        }
+        index += first;
+        lines[index++] = value;
+      }
+    }
+
+    if (encoding == Encoding::Rle && index != nbLines)
+    {
+      throw std::runtime_error("Truncated line encoding");
+    }
+  }
+
+  // LEB128 varints, also used by the <profile> payloads of FileCoverageV2
+  static size_t VarintSize(size_t value)
+  {
+    size_t size = 1;
+    while (value >= 0x80)
+    {
+      value >>= 7;
+      ++size;
+    }
+    return size;
+  }
+
+  static void PutVarint(std::string& out, size_t value)
+  {
+    while (value >= 0x80)
+    {
+      out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+  }
+
+  static size_t GetVarint(const char*& it, const char* end)
+  {
+    size_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+      if (it == end)
+      {
+        throw std::runtime_error("Truncated line encoding");
+      }
+      const auto byte = static_cast<uint8_t>(*it++);
+      value |= static_cast<size_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0)
+      {
+        return value;
+      }
+    }
+    throw std::runtime_error("Invalid varint in line encoding");
+  }
+
+private:
+  static uint16_t GetValue(const char*& it, const char* end)
+  {
+    const size_t value = GetVarint(it, end);
+    if (value > UINT16_MAX)
+    {
+      throw std::runtime_error("Invalid line value in line encoding");
+    }
+    return static_cast<uint16_t>(value);
+  }
+};
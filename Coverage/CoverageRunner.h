@@ -4,15 +4,23 @@
 #include "RuntimeOptions.h"
 #include "RuntimeNotifications.h"
 #include "CallbackInfo.h"
+#include "CallingContextTree.h"
+#include "ProfileExport.h"
 #include "ProfileNode.h"
+#include "SampleBuffer.h"
+#include "SampleScheduler.h"
+#include "StackUnwinder.h"
 #include "Util.h"
+#include "WaitReason.h"
 
 #include "Disassembler/ReachabilityAnalysis.h"
 
 #include <algorithm>
+#include <array>
 #include <format>
 #include <iostream>
 #include <filesystem>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -29,8 +37,7 @@ struct CoverageRunner
   CoverageRunner(const RuntimeOptions& opts) : options(opts),
     debugInfoAvailable(false),
     debuggerPresentPatched(false),
-    coverageContext(opts.Executable),
-    profileInfo()
+    coverageContext(opts.Executable)
   {}
 
   static BOOL CALLBACK SymEnumLinesCallback(PSRCCODEINFO lineInfo, PVOID userContext)
@@ -97,7 +104,19 @@ struct CoverageRunner
 
   std::vector<std::tuple<PVOID, BYTE, PVOID, BYTE>> passToCoverageMethods;
 
-  std::unordered_map<std::string, std::unique_ptr<ProfileFrame>> profileInfo;
+  CallingContextTree profileTree;
+  CallingContextTree offCpuTree;            ///< With -profile-off-cpu(-pprof): stacks of the threads blocked at the samples
+  std::array<uint64_t, WaitReason::Count> waitSamples = {};  ///< Off-CPU samples by wait reason
+  SampleBuffer sampleBuffer;                ///< Stacks sampled since the last FlushSamples
+  SymbolCache::Stats symbolStats;           ///< Symbolization of the sampled stacks, of the exited processes
+  StackUnwinder::Stats unwindStats;         ///< Stack walks of the exited processes
+  uint64_t threadsActive = 0;               ///< Threads of the exited processes which ran / were blocked at a sample
+  uint64_t threadsIdle = 0;
+  std::vector<uint64_t> sampleTimestamps;   ///< With -sample-hz: nanoseconds since the sampler start of each sample
+
+  // Processes interrupted by the sampler thread
+  std::mutex sampledProcessesMutex;
+  std::vector<HANDLE> sampledProcesses;
 
   std::string GetFileNameFromHandle(HANDLE hFile)
   {
@@ -296,8 +315,10 @@ struct CoverageRunner
             }
           }
 
+          bool profiled = false;
           if (SymEnumLines(proc->Handle, dllBase, NULL, NULL, SymEnumLinesCallback, &ci))
           {
+            profiled = !ci.breakpointsToSet.empty();
             if (!options.UseStaticCodeAnalysis ||
                 !SymEnumSymbols(proc->Handle, dllBase, NULL, SymEnumSymbolsCallback, &ci) || ci.reachableCode.empty())
             {
@@ -369,6 +390,9 @@ struct CoverageRunner
               std::cout << "[No symbols available: " << Util::GetLastErrorAsString() << "]" << std::endl;
             }
           }
+
+          // Samples in modules without profiled code are not symbolized
+          proc->Symbols.addModule(dllBase, ModuleInfo.ImageSize, profiled);
         }
         else
         {
@@ -403,6 +427,98 @@ struct CoverageRunner
     return result;
   }
 
+  // Tags of the sampled stacks: off-CPU samples carry their WaitReason in the high byte
+  static constexpr uint16_t SampleOnCpu = 0;
+  static constexpr uint16_t SampleOffCpu = 1;
+
+  // Reason of a blocked thread, from the system call stub on top of its stack. Cached by PC: threads wait in a few stubs.
+  static WaitReason::Reason WaitReasonOf(ProcessInfo* process, uint64_t pc)
+  {
+    static SYMBOL_INFO* symbol = reinterpret_cast<SYMBOL_INFO*>(calloc(sizeof(SYMBOL_INFO) + 256 * sizeof(char), 1));
+    symbol->MaxNameLen = 255;
+    symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+
+    auto [it, inserted] = process->WaitReasons.emplace(pc, WaitReason::Unknown);
+    if (inserted && SymFromAddr(process->Handle, pc, 0, symbol))
+    {
+      it->second = WaitReason::FromFunction(symbol->Name);
+    }
+    return it->second;
+  }
+
+  // Symbolize the sampled stacks into the profile. Called while the target runs: samples only record raw PCs.
+  void FlushSamples(const std::unordered_map<DWORD, std::unique_ptr<ProcessInfo>>& processMap)
+  {
+    static SYMBOL_INFO* symbol = reinterpret_cast<SYMBOL_INFO*>(calloc(sizeof(SYMBOL_INFO) + 256 * sizeof(char), 1));
+    symbol->MaxNameLen = 255;
+    symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+
+    std::vector<CallingContextTree::FrameId> callStack;
+    sampleBuffer.drain([&](uint32_t processId, uint16_t tag, const uint64_t* pcs, size_t depth)
+    {
+      const bool onCpu = (tag & 0xFF) == SampleOnCpu;
+      auto& tree = onCpu ? profileTree : offCpuTree;
+      auto it = processMap.find(processId);
+      if (it == processMap.end())
+      {
+        return;
+      }
+
+      auto process = it->second.get();
+      const auto resolve = [&](DWORD64 pc)
+      {
+        DWORD dwDisplacement;
+        IMAGEHLP_LINE64 line;
+
+        line.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
+
+        // Get information from PC; hidden lines (0xfeefee) are not profiled
+        if (SymFromAddr(process->Handle, pc, 0, symbol) &&
+            SymGetLineFromAddr64(process->Handle, pc, &dwDisplacement, &line) && line.LineNumber < 0xf00000 &&
+            coverageContext.PathMatches(line.FileName))
+        {
+          return profileTree.intern(symbol->Name, line.FileName, line.LineNumber);
+        }
+        return SymbolCache::NoFrame;
+      };
+
+      // Frames are interned in the profile tree, whatever the tree of the sample
+      const auto frameOf = [&](CallingContextTree::FrameId frame)
+      {
+        if (&tree == &profileTree)
+        {
+          return frame;
+        }
+        const auto& info = profileTree.frame(frame);
+        return tree.intern(profileTree.function(info.function), profileTree.file(info.file), info.line);
+      };
+
+      // Outermost caller first
+      callStack.clear();
+      for (size_t i = depth; i > 0; --i)
+      {
+        const auto frame = process->Symbols.lookup(pcs[i - 1], resolve);
+        if (frame != SymbolCache::NoFrame)
+        {
+          callStack.push_back(frameOf(frame));
+        }
+      }
+
+      // The wait reason is the leaf of the blocked stacks
+      const auto reason = WaitReason::Reason(tag >> 8);
+      if (!onCpu)
+      {
+        ++waitSamples[reason < WaitReason::Count ? reason : WaitReason::Unknown];
+        if (reason != WaitReason::Unknown)
+        {
+          callStack.push_back(tree.intern("[" + std::string(WaitReason::Name(reason)) + "]", "", 0));
+        }
+      }
+
+      tree.record(callStack.data(), callStack.size());
+    });
+  }
+
   bool Start()
   {
     SymSetOptions(SYMOPT_LOAD_LINES | SYMOPT_LOAD_ANYTHING);
@@ -495,14 +611,38 @@ struct CoverageRunner
 
     std::unordered_map<DWORD, std::unique_ptr<ProcessInfo>> processMap;
 
+    // With -sample-hz, samples are taken on a timer thread; otherwise when no debug event came for 500ms
+    std::unique_ptr<SampleScheduler> sampler;
+    if (options.SampleHz > 0)
+    {
+      sampler = std::make_unique<SampleScheduler>(options.SampleHz, [this]()
+      {
+        std::lock_guard<std::mutex> lock(sampledProcessesMutex);
+        bool interrupted = false;
+        for (auto process : sampledProcesses)
+        {
+          interrupted |= DebugBreakProcess(process) != FALSE;
+        }
+        return interrupted;
+      });
+    }
+
     while (continueDebugging)
     {
-      if (!WaitForDebugEvent(&debugEvent, 500))
+      // Pending samples are symbolized as soon as the target gives the loop some time
+      if (!WaitForDebugEvent(&debugEvent, sampleBuffer.empty() ? 500 : 10))
       {
+        if (!sampleBuffer.empty())
+        {
+          FlushSamples(processMap);
+        }
         // Collect sample:
-        for (auto& proc : processMap)
+        else if (!sampler)
         {
-          DebugBreakProcess(proc.second->Handle);
+          for (auto& proc : processMap)
+          {
+            DebugBreakProcess(proc.second->Handle);
+          }
         }
       }
       else
@@ -516,6 +656,10 @@ struct CoverageRunner
             auto pinfo = new ProcessInfo(debugEvent.dwProcessId, process);
             pinfo->Threads[debugEvent.dwThreadId] = thread;
             processMap[debugEvent.dwProcessId] = std::unique_ptr<ProcessInfo>(pinfo);
+            {
+              std::lock_guard<std::mutex> lock(sampledProcessesMutex);
+              sampledProcesses.push_back(process);
+            }
 
             auto filename = GetFileNameFromHandle(debugEvent.u.CreateProcessInfo.hFile);
             if (options.isAtLeastLevel(VerboseLevel::Info))
@@ -526,6 +670,7 @@ struct CoverageRunner
             InitializeDebugInfo(process);
             initializedDbgInfo = true;
 
+            pinfo->Unwinder.addModule(reinterpret_cast<uint64_t>(debugEvent.u.CreateProcessInfo.lpBaseOfImage));
             ProcessDebugInfo(pinfo, &(debugEvent.u.CreateProcessInfo.hFile), debugEvent.u.CreateProcessInfo.lpBaseOfImage, filename);
           }
           break;
@@ -552,6 +697,7 @@ struct CoverageRunner
 
             auto proc = processMap[debugEvent.dwProcessId].get();
             proc->Threads.erase(proc->Threads.find(debugEvent.dwThreadId));
+            proc->Activity.forget(debugEvent.dwThreadId);
           }
           break;
 
@@ -565,6 +711,16 @@ struct CoverageRunner
             // Success application must return 0 --> Commented out per PR #97.
             // executionSuccess &= (debugEvent.u.ExitProcess.dwExitCode == 0);
 
+            FlushSamples(processMap);
+            if (auto exited = processMap.find(debugEvent.dwProcessId); exited != processMap.end())
+            {
+              std::lock_guard<std::mutex> lock(sampledProcessesMutex);
+              std::erase(sampledProcesses, exited->second->Handle);
+              symbolStats += exited->second->Symbols.stats();
+              unwindStats += exited->second->Unwinder.stats();
+              threadsActive += exited->second->Activity.active();
+              threadsIdle += exited->second->Activity.idle();
+            }
             processMap.erase(debugEvent.dwProcessId);
             
 					  // Get only the latest RC code of latest process.
@@ -589,6 +745,7 @@ struct CoverageRunner
 
             auto process = processMap[debugEvent.dwProcessId].get();
 
+            process->Unwinder.addModule(reinterpret_cast<uint64_t>(debugEvent.u.LoadDll.lpBaseOfDll));
             ProcessDebugInfo(process, &(debugEvent.u.LoadDll.hFile), debugEvent.u.LoadDll.lpBaseOfDll, name);
             TryPatchDebuggerPresent(process->Handle, &(debugEvent.u.LoadDll.hFile), debugEvent.u.LoadDll.lpBaseOfDll, name);
           }
@@ -605,11 +762,15 @@ struct CoverageRunner
                 std::cout << "Unloading: " << idx->second << std::endl;
               }
 
-              // Unload symbols module:
+              // Unload symbols module, once the samples in it are symbolized:
+              FlushSamples(processMap);
               auto process = processMap[debugEvent.dwProcessId].get();
+              process->Unwinder.removeModule(reinterpret_cast<uint64_t>(basePtr));
+              process->WaitReasons.clear();
               auto mod = process->LoadedModules.find(basePtr);
               if (mod != process->LoadedModules.end())
               {
+                process->Symbols.removeModule(mod->second);
                 BOOL result = SymUnloadModule64(process->Handle, mod->second);
                 if (!result)
                 {
@@ -652,6 +813,12 @@ struct CoverageRunner
                 {
                   // std::cout << "Entry breakpoint; ignoring." << std::endl;
                   entryBreakpoint = false;
+
+                  // Sampler breaks must not be taken for the entry breakpoint
+                  if (sampler)
+                  {
+                    sampler->start();
+                  }
                 }
                 else
                 {
@@ -775,6 +942,11 @@ struct CoverageRunner
 #else
                       threadContextInfo.Eip++;
 #endif
+                      if (sampler)
+                      {
+                        sampleTimestamps.push_back(sampler->acknowledge());
+                      }
+
                       // Usually, a breakpoint is *not* a DebugBreak but rather one of our suspend calls.
                       // Iterate all threads, get stack traces:
                       for (auto& threadPair : process->Threads)
@@ -785,88 +957,74 @@ struct CoverageRunner
                           continue;
                         }
 
+                        // Threads which did not run since the previous sample are blocked: only walked for the off-CPU profile
+                        uint64_t cpuTime;
+                        const bool onCpu = !ThreadActivity::CpuTime(threadPair.second, cpuTime) || process->Activity.ran(threadPair.first, cpuTime);
+                        if (!onCpu && options.ProfileOffCpu.empty() && options.ProfileOffCpuPprof.empty())
+                        {
+                          continue;
+                        }
+
                         CONTEXT threadContextInfo;
                         threadContextInfo.ContextFlags = CONTEXT_ALL;
                         GetThreadContext(threadPair.second, &threadContextInfo);
 
+                        // Only the PCs are read while the target is stopped: FlushSamples symbolizes them later
+                        uint64_t callStack[SampleBuffer::MaxDepth];
+                        StackUnwinder::Context unwindContext;
 #if _WIN64
-                        STACKFRAME64 stack = { 0 };
-                        stack.AddrPC.Offset = threadContextInfo.Rip; // EIP - Instruction Pointer
-                        stack.AddrPC.Mode = AddrModeFlat;
-                        stack.AddrFrame.Offset = threadContextInfo.Rsp; // ESP - Stack Pointer
-                        stack.AddrFrame.Mode = AddrModeFlat;
-                        stack.AddrStack.Offset = threadContextInfo.Rsp; // ESP - Stack Pointer (again!)
-                        stack.AddrStack.Mode = AddrModeFlat;
+                        // Rax to R15 follow each other in the CONTEXT, in the x64 encoding order
+                        unwindContext.ip = threadContextInfo.Rip;
+                        std::copy(&threadContextInfo.Rax, &threadContextInfo.Rax + 16, unwindContext.regs);
 #else
-                        STACKFRAME64 stack = { 0 };
-                        stack.AddrPC.Offset = threadContextInfo.Eip; // EIP - Instruction Pointer
-                        stack.AddrPC.Mode = AddrModeFlat;
-                        stack.AddrFrame.Offset = threadContextInfo.Ebp; // EBP
-                        stack.AddrFrame.Mode = AddrModeFlat;
-                        stack.AddrStack.Offset = threadContextInfo.Esp; // ESP - Stack Pointer
-                        stack.AddrStack.Mode = AddrModeFlat;
+                        unwindContext.ip = threadContextInfo.Eip;
+                        unwindContext.regs[StackUnwinder::Context::Sp] = threadContextInfo.Esp;
+                        unwindContext.regs[StackUnwinder::Context::Fp] = threadContextInfo.Ebp;
 #endif
+                        size_t depth = process->Unwinder.unwind(unwindContext, callStack, SampleBuffer::MaxDepth);
 
-                        // Let's initialize this once for our process.
-                        static SYMBOL_INFO* symbol = reinterpret_cast<SYMBOL_INFO*>(calloc(sizeof(SYMBOL_INFO) + 256 * sizeof(char), 1));
-                        symbol->MaxNameLen = 255;
-                        symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+                        // No caller found (no unwind data, no frame pointer): let DbgHelp try
+                        if (depth <= 1)
+                        {
+#if _WIN64
+                          const DWORD machine = IMAGE_FILE_MACHINE_AMD64;
+                          STACKFRAME64 stack = { 0 };
+                          stack.AddrPC.Offset = threadContextInfo.Rip; // EIP - Instruction Pointer
+                          stack.AddrPC.Mode = AddrModeFlat;
+                          stack.AddrFrame.Offset = threadContextInfo.Rsp; // ESP - Stack Pointer
+                          stack.AddrFrame.Mode = AddrModeFlat;
+                          stack.AddrStack.Offset = threadContextInfo.Rsp; // ESP - Stack Pointer (again!)
+                          stack.AddrStack.Mode = AddrModeFlat;
+#else
+                          const DWORD machine = IMAGE_FILE_MACHINE_I386;
+                          STACKFRAME64 stack = { 0 };
+                          stack.AddrPC.Offset = threadContextInfo.Eip; // EIP - Instruction Pointer
+                          stack.AddrPC.Mode = AddrModeFlat;
+                          stack.AddrFrame.Offset = threadContextInfo.Ebp; // EBP
+                          stack.AddrFrame.Mode = AddrModeFlat;
+                          stack.AddrStack.Offset = threadContextInfo.Esp; // ESP - Stack Pointer
+                          stack.AddrStack.Mode = AddrModeFlat;
+#endif
 
-                        BOOL status = TRUE;
+                          BOOL status = TRUE;
+                          depth = 0;
 
-                        std::vector<std::tuple<std::string, DWORD64, std::string>> callStack;
+                          do
+                          {
+                            callStack[depth++] = stack.AddrPC.Offset;
 
-                        do
-                        {
-                          // Process stack item:
-                          std::ostringstream oss;
+                            // Get next item from stack trace:
+                            status = StackWalk64(machine, process->Handle, threadPair.second, &stack,
+                                                 &threadContextInfo, ReadProcessMemoryInt, SymFunctionTableAccess64,
+                                                 SymGetModuleBase64, 0);
+                          } while (status && depth < SampleBuffer::MaxDepth);
+                        }
 
-                          if (!SymFromAddr(process->Handle, stack.AddrPC.Offset, 0, symbol))
-                          {
-                            // Ignore; no source
-                          }
-                          else
-                          {
-                            DWORD dwDisplacement;
-                            IMAGEHLP_LINE64 line;
-
-                            line.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
-
-                            // Get information from PC
-                            if (SymGetLineFromAddr64(process->Handle, stack.AddrPC.Offset, &dwDisplacement, &line))
-                            {
-                              if (coverageContext.PathMatches(line.FileName))
-                              {
-                                std::string filename(line.FileName);
-
-                                callStack.push_back(std::make_tuple(filename, line.LineNumber, symbol->Name));
-                              }
-                            }
-                          }
-
-                          // Get next item from stack trace:
-                          status = StackWalk64(IMAGE_FILE_MACHINE_AMD64, process->Handle, thread, &stack,
-                                               &threadContextInfo, ReadProcessMemoryInt, SymFunctionTableAccess64,
-                                               SymGetModuleBase64, 0);
-                        } while (status);
-
-                        // Update the profile graph:
-                        for (size_t i = callStack.size(); i > 0; --i)
+                        const auto tag = onCpu ? SampleOnCpu : uint16_t(SampleOffCpu | (WaitReasonOf(process, callStack[0]) << 8));
+                        if (depth > 0 && !sampleBuffer.push(debugEvent.dwProcessId, callStack, depth, tag))
                         {
-                          auto& item = callStack[i - 1];
-                          auto line = std::get<1>(item);
-                          auto frame = std::get<2>(item);
-
-                          auto it = profileInfo.find(frame);
-                          if (it == profileInfo.end())
-                          {
-                            ProfileFrame* frameInfo = new ProfileFrame(std::get<0>(item), line, i == 1);
-                            profileInfo[frame] = std::unique_ptr<ProfileFrame>(frameInfo);
-                          }
-                          else
-                          {
-                            it->second->Update(line, i == 1);
-                          }
+                          FlushSamples(processMap);
+                          sampleBuffer.push(debugEvent.dwProcessId, callStack, depth, tag);
                         }
                       }
                     }
@@ -892,9 +1050,55 @@ struct CoverageRunner
         ContinueDebugEvent(debugEvent.dwProcessId, debugEvent.dwThreadId, continueStatus);
 
         continueStatus = DBG_CONTINUE;
+
+        // Do not wait for the buffer to be full: flushing it then would stop the target
+        if (sampleBuffer.used() * 2 > sampleBuffer.capacity())
+        {
+          FlushSamples(processMap);
+        }
+      }
+    }
+
+    if (sampler)
+    {
+      sampler->stop();
+      if (options.isAtLeastLevel(VerboseLevel::Trace))
+      {
+        const double seconds = sampleTimestamps.empty() ? 0 : double(sampleTimestamps.back()) / 1e9;
+        std::cout << "Sampler: " << sampler->samples() << " samples in " << seconds << "s ("
+                  << (seconds > 0 ? double(sampler->samples()) / seconds : 0) << " Hz for " << options.SampleHz << " Hz requested, "
+                  << sampler->skipped() << " ticks skipped)" << std::endl;
       }
     }
 
+    FlushSamples(processMap);
+
+    if (options.isAtLeastLevel(VerboseLevel::Trace))
+    {
+      for (auto& it : processMap)
+      {
+        symbolStats += it.second->Symbols.stats();
+        unwindStats += it.second->Unwinder.stats();
+        threadsActive += it.second->Activity.active();
+        threadsIdle += it.second->Activity.idle();
+      }
+      std::cout << "Sampled threads: " << threadsActive << " on CPU, " << threadsIdle << " blocked" << std::endl;
+      if (!options.ProfileOffCpu.empty() || !options.ProfileOffCpuPprof.empty())
+      {
+        std::cout << "Blocked samples:";
+        for (uint8_t reason = 0; reason < WaitReason::Count; ++reason)
+        {
+          std::cout << ' ' << WaitReason::Name(WaitReason::Reason(reason)) << ' ' << waitSamples[reason];
+        }
+        std::cout << std::endl;
+      }
+      const double lookups = double(symbolStats.lookups == 0 ? 1 : symbolStats.lookups);
+      std::cout << "Symbol cache: " << symbolStats.lookups << " frames, " << (100.0 * symbolStats.hits / lookups) << "% cached, "
+                << (100.0 * symbolStats.skipped / lookups) << "% in modules without profiled code" << std::endl;
+      std::cout << "Stack unwinder: " << unwindStats.unwindFrames << " frames from .pdata, " << unwindStats.chainFrames
+                << " from frame pointers, " << unwindStats.windowMisses << " reads outside the stack window" << std::endl;
+    }
+
     if (initializedDbgInfo)
     {
       for (auto& it : processMap)
@@ -906,71 +1110,33 @@ struct CoverageRunner
     // Group profile data together:
     if (options.isAtLeastLevel(VerboseLevel::Trace))
     {
-      std::cout << "Gathering profile data of " << profileInfo.size() << " sources..." << std::endl;
+      std::cout << "Gathering profile data of " << profileTree.samples() << " samples in " << profileTree.size() << " call paths..." << std::endl;
     }
     std::unordered_map<std::string, std::unique_ptr<std::vector<ProfileInfo>>> mergedInfo;
+    const uint64_t totalSamples = profileTree.lines(mergedInfo);
 
-    float totalDeep = 0;
-    for (auto& it : profileInfo)
+    if (!options.ProfileCollapsed.empty())
     {
-      for (auto& jt : it.second->lineHitCount)
-      {
-        totalDeep += jt.second.Deep;
-      }
+      std::ofstream ofs(options.ProfileCollapsed);
+      ProfileExport::WriteCollapsed(profileTree, ofs);
     }
 
-    if (totalDeep == 0)
+    if (!options.ProfileOffCpu.empty())
     {
-      totalDeep = 1;
+      std::ofstream ofs(options.ProfileOffCpu);
+      ProfileExport::WriteCollapsed(offCpuTree, ofs);
     }
 
-    for (auto& it : profileInfo)
+    if (!options.ProfileOffCpuPprof.empty())
     {
-      DWORD64 max = 0;
-      float totalShallow = 0;
-      for (auto& jt : it.second->lineHitCount)
-      {
-        if (jt.first > max)
-        {
-          max = jt.first;
-        }
-
-        totalShallow += jt.second.Shallow;
-      }
-
-      if (totalShallow == 0)
-      {
-        totalShallow = 1;
-      }
-
-      auto m = mergedInfo.find(it.second->filename);
-      std::vector<ProfileInfo>* merged;
-      if (m == mergedInfo.end())
-      {
-        merged = new std::vector<ProfileInfo>();
-        mergedInfo[it.second->filename] = std::unique_ptr<std::vector<ProfileInfo>>(merged);
-      }
-      else
-      {
-        merged = m->second.get();
-      }
-
-      if (merged->size() <= max)
-      {
-        merged->resize(size_t(max) + 1);
-      }
-
-      for (auto& jt : it.second->lineHitCount)
-      {
-        float deep = (jt.second.Deep / totalDeep) * 100.0f;
-        float shallow = (jt.second.Shallow / totalShallow) * 100.0f;
-
-        deep = (deep < 0) ? 0 : deep;
-        shallow = (shallow < 0) ? 0 : shallow;
+      std::ofstream ofs(options.ProfileOffCpuPprof, std::ios::binary);
+      ProfileExport::WritePprof(offCpuTree, options.SampleHz == 0 ? 0 : 1000000000ull / options.SampleHz, ofs, "wait");
+    }
 
-        (*merged)[size_t(jt.first)].Deep += deep;
-        (*merged)[size_t(jt.first)].Shallow += shallow;
-      }
+    if (!options.ProfilePprof.empty())
+    {
+      std::ofstream ofs(options.ProfilePprof, std::ios::binary);
+      ProfileExport::WritePprof(profileTree, options.SampleHz == 0 ? 0 : 1000000000ull / options.SampleHz, ofs);
     }
 
     if (options.isAtLeastLevel(VerboseLevel::Trace))
@@ -993,8 +1159,9 @@ struct CoverageRunner
 
     // Write report of current execution
     {
-      std::ofstream ofs(outputFile);
-      coverageContext.WriteReport(options.ExportFormat, mergedInfo, ofs);
+      std::ofstream ofs;
+      ReportEmitter::OpenUnbuffered(ofs, outputFile, options.ExportFormat == RuntimeOptions::NativeV3 ? std::ios::binary : std::ios::out);
+      coverageContext.WriteReport(options.ExportFormat, mergedInfo, ofs, totalSamples);
     }
 
     if (options.isAtLeastLevel(VerboseLevel::Info))
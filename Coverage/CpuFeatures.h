@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#  define COVERAGE_X86 1
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#    define COVERAGE_TARGET(isa)
+#  else
+#    include <cpuid.h>
+#    define COVERAGE_TARGET(isa) __attribute__((target(isa)))
+#  endif
+#else
+#  define COVERAGE_X86 0
+#endif
+
+/// SIMD instruction sets usable on this CPU (detected once). Kernels built with COVERAGE_TARGET
+/// must only be called when the matching flag is set.
+struct CpuFeatures
+{
+  bool sse2 = false;
+  bool ssse3 = false;
+  bool avx2 = false;
+
+  static const CpuFeatures& Get()
+  {
+    static const CpuFeatures features = Detect();
+    return features;
+  }
+
+private:
+  static CpuFeatures Detect()
+  {
+    CpuFeatures features;
+#if COVERAGE_X86
+    int info[4] = {};
+    CpuId(info, 0);
+    const int maxLeaf = info[0];
+    if (maxLeaf < 1)
+    {
+      return features;
+    }
+
+    CpuId(info, 1);
+    features.sse2 = (info[3] & (1 << 26)) != 0;
+    features.ssse3 = (info[2] & (1 << 9)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+
+    // AVX2 needs the OS to save YMM registers
+    if (maxLeaf >= 7 && osxsave && avx && (XGetBv() & 0x6) == 0x6)
+    {
+      CpuId(info, 7);
+      features.avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#endif
+    return features;
+  }
+
+#if COVERAGE_X86
+  static void CpuId(int info[4], int leaf)
+  {
+#ifdef _MSC_VER
+    __cpuidex(info, leaf, 0);
+#else
+    __cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+#endif
+  }
+
+  static uint64_t XGetBv()
+  {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+  }
+#endif
+};
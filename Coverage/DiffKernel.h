@@ -0,0 +1,179 @@
+#pragma once
+
+#include "CpuFeatures.h"
+#include "MergeKernel.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+/// Conversion of FileCoverageV2 line arrays into bitsets (bit i of word i / 64 is line i), for the report diff:
+///   isCode    = isCode(line)
+///   isCovered = isCode(line) && count(line) > 0 (as MergeKernel)
+///   changed   = count(a) != count(b)
+/// Bitsets must be zeroed by the caller with Words(size) words: the kernels only set bits.
+struct DiffKernel
+{
+  using Isa = MergeKernel::Isa;
+
+  static constexpr size_t Words(size_t size)
+  {
+    return (size + 63) / 64;
+  }
+
+  static void ToBits(const uint16_t* lines, size_t size, uint64_t* isCode, uint64_t* isCovered, Isa isa = MergeKernel::Supported())
+  {
+    size_t done = 0;
+#if COVERAGE_X86
+    if (isa == Isa::AVX2)
+    {
+      done = ToBitsAVX2(lines, size, isCode, isCovered);
+    }
+    else if (isa == Isa::SSE2)
+    {
+      done = ToBitsSSE2(lines, size, isCode, isCovered);
+    }
+#endif
+    for (size_t i = done; i < size; ++i)
+    {
+      const uint64_t bit = uint64_t(1) << (i % 64);
+      if ((lines[i] & MergeKernel::MaskIsCode) != 0)
+      {
+        isCode[i / 64] |= bit;
+        if ((lines[i] & MergeKernel::MaskCount) != 0)
+        {
+          isCovered[i / 64] |= bit;
+        }
+      }
+    }
+  }
+
+  static void ChangedCounts(const uint16_t* a, const uint16_t* b, size_t size, uint64_t* changed, Isa isa = MergeKernel::Supported())
+  {
+    size_t done = 0;
+#if COVERAGE_X86
+    if (isa == Isa::AVX2)
+    {
+      done = ChangedCountsAVX2(a, b, size, changed);
+    }
+    else if (isa == Isa::SSE2)
+    {
+      done = ChangedCountsSSE2(a, b, size, changed);
+    }
+#endif
+    for (size_t i = done; i < size; ++i)
+    {
+      if ((a[i] & MergeKernel::MaskCount) != (b[i] & MergeKernel::MaskCount))
+      {
+        changed[i / 64] |= uint64_t(1) << (i % 64);
+      }
+    }
+  }
+
+  /// Call \p onLine(index) for each set bit of \p words, in ascending order.
+  template <typename OnLine>
+  static void ForEachBit(const uint64_t* words, size_t nbWords, OnLine&& onLine)
+  {
+    for (size_t w = 0; w < nbWords; ++w)
+    {
+      for (uint64_t word = words[w]; word != 0; word &= word - 1)
+      {
+        onLine(w * 64 + std::countr_zero(word));
+      }
+    }
+  }
+
+private:
+#if COVERAGE_X86
+  // 16 lines per step from line i: signed packing keeps the 0 / -1 masks, movemask gives one bit per line.
+  COVERAGE_TARGET("sse2")
+  static size_t ToBitsSSE2(const uint16_t* lines, size_t size, uint64_t* isCode, uint64_t* isCovered, size_t i = 0)
+  {
+    const __m128i maskCount = _mm_set1_epi16(MergeKernel::MaskCount);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= size; i += 16)
+    {
+      const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lines + i));
+      const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lines + i + 8));
+
+      const __m128i code0 = _mm_srai_epi16(v0, 15);
+      const __m128i code1 = _mm_srai_epi16(v1, 15);
+      const __m128i covered0 = _mm_andnot_si128(_mm_cmpeq_epi16(_mm_and_si128(v0, maskCount), zero), code0);
+      const __m128i covered1 = _mm_andnot_si128(_mm_cmpeq_epi16(_mm_and_si128(v1, maskCount), zero), code1);
+
+      const unsigned shift = i % 64;
+      isCode[i / 64] |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_packs_epi16(code0, code1)))) << shift;
+      isCovered[i / 64] |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_packs_epi16(covered0, covered1)))) << shift;
+    }
+    return i;
+  }
+
+  // 32 lines per step: packing works per 128 bits lane, the permutation restores the line order.
+  COVERAGE_TARGET("avx2")
+  static size_t ToBitsAVX2(const uint16_t* lines, size_t size, uint64_t* isCode, uint64_t* isCovered)
+  {
+    const __m256i maskCount = _mm256_set1_epi16(MergeKernel::MaskCount);
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+      const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lines + i));
+      const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lines + i + 16));
+
+      const __m256i code0 = _mm256_srai_epi16(v0, 15);
+      const __m256i code1 = _mm256_srai_epi16(v1, 15);
+      const __m256i covered0 = _mm256_andnot_si256(_mm256_cmpeq_epi16(_mm256_and_si256(v0, maskCount), zero), code0);
+      const __m256i covered1 = _mm256_andnot_si256(_mm256_cmpeq_epi16(_mm256_and_si256(v1, maskCount), zero), code1);
+
+      const __m256i code = _mm256_permute4x64_epi64(_mm256_packs_epi16(code0, code1), 0xD8);
+      const __m256i covered = _mm256_permute4x64_epi64(_mm256_packs_epi16(covered0, covered1), 0xD8);
+
+      const unsigned shift = i % 64;
+      isCode[i / 64] |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(code))) << shift;
+      isCovered[i / 64] |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(covered))) << shift;
+    }
+
+    // Finish 16 lines blocks with SSE2 (AVX2 implies it)
+    return ToBitsSSE2(lines, size, isCode, isCovered, i);
+  }
+
+  COVERAGE_TARGET("sse2")
+  static size_t ChangedCountsSSE2(const uint16_t* a, const uint16_t* b, size_t size, uint64_t* changed, size_t i = 0)
+  {
+    const __m128i maskCount = _mm_set1_epi16(MergeKernel::MaskCount);
+
+    for (; i + 16 <= size; i += 16)
+    {
+      const __m128i a0 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)), maskCount);
+      const __m128i a1 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 8)), maskCount);
+      const __m128i b0 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)), maskCount);
+      const __m128i b1 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 8)), maskCount);
+
+      const unsigned same = static_cast<uint16_t>(_mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(a0, b0), _mm_cmpeq_epi16(a1, b1))));
+      changed[i / 64] |= uint64_t(~same & 0xFFFFu) << (i % 64);
+    }
+    return i;
+  }
+
+  COVERAGE_TARGET("avx2")
+  static size_t ChangedCountsAVX2(const uint16_t* a, const uint16_t* b, size_t size, uint64_t* changed)
+  {
+    const __m256i maskCount = _mm256_set1_epi16(MergeKernel::MaskCount);
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+      const __m256i a0 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)), maskCount);
+      const __m256i a1 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i + 16)), maskCount);
+      const __m256i b0 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)), maskCount);
+      const __m256i b1 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i + 16)), maskCount);
+
+      const __m256i same = _mm256_permute4x64_epi64(_mm256_packs_epi16(_mm256_cmpeq_epi16(a0, b0), _mm256_cmpeq_epi16(a1, b1)), 0xD8);
+      changed[i / 64] |= uint64_t(~static_cast<uint32_t>(_mm256_movemask_epi8(same))) << (i % 64);
+    }
+    return ChangedCountsSSE2(a, b, size, changed, i);
+  }
+#endif
+};
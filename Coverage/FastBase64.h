@@ -0,0 +1,288 @@
+#pragma once
+
+#include "base64.h"
+#include "CpuFeatures.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+/// Vectorized base64 codec (standard alphabet, '=' padding) working on caller buffers.
+/// Output is byte-identical to Base64: the SIMD kernels handle whole blocks, the scalar code the tail.
+class FastBase64
+{
+public:
+  enum class Isa
+  {
+    Scalar,
+    SSSE3,
+    AVX2
+  };
+
+  /// Best instruction set available on this CPU.
+  static Isa Supported()
+  {
+    const auto& cpu = CpuFeatures::Get();
+    return cpu.avx2 ? Isa::AVX2 : cpu.ssse3 ? Isa::SSSE3 : Isa::Scalar;
+  }
+
+  static constexpr size_t EncodedLength(size_t size)
+  {
+    return Base64::EncodedLength(size);
+  }
+
+  /// Number of bytes Decode writes for this input. Throws if the input is not a base64 length.
+  static size_t DecodedLength(std::string_view input)
+  {
+    if (input.size() % 4 != 0)
+    {
+      throw std::runtime_error("Input data size is not a multiple of 4");
+    }
+
+    size_t size = input.size() / 4 * 3;
+    if (!input.empty() && input[input.size() - 1] == '=')
+      --size;
+    if (input.size() >= 2 && input[input.size() - 2] == '=')
+      --size;
+    return size;
+  }
+
+  /// Encode \p size bytes into \p out, which must hold EncodedLength(size) characters.
+  static void Encode(const uint8_t* data, size_t size, char* out, Isa isa = Supported())
+  {
+    size_t done = 0;
+#if COVERAGE_X86
+    if (isa == Isa::AVX2)
+    {
+      done = EncodeAVX2(data, size, out);
+    }
+    else if (isa == Isa::SSSE3)
+    {
+      done = EncodeSSSE3(data, size, out);
+    }
+#endif
+    // Blocks are multiple of 3 bytes: the tail is a plain base64 encoding
+    Base64::Encode(data + done, size - done, out + done / 3 * 4);
+  }
+
+  /// Decode \p input into \p out, which must hold DecodedLength(input) bytes.
+  /// Throws std::runtime_error on characters outside of the base64 alphabet.
+  static void Decode(std::string_view input, uint8_t* out, Isa isa = Supported())
+  {
+    const size_t outSize = DecodedLength(input);
+
+    size_t done = 0;
+#if COVERAGE_X86
+    if (isa == Isa::AVX2)
+    {
+      done = DecodeAVX2(input.data(), input.size(), out, outSize);
+    }
+    else if (isa == Isa::SSSE3)
+    {
+      done = DecodeSSSE3(input.data(), input.size(), out, outSize);
+    }
+#endif
+    DecodeScalar(input.data() + done, input.size() - done, out + done / 4 * 3, outSize - done / 4 * 3);
+  }
+
+private:
+  static void DecodeScalar(const char* input, size_t size, uint8_t* out, size_t outSize)
+  {
+    static constexpr auto Table = []()
+    {
+      std::array<uint8_t, 256> table{};
+      table.fill(64);
+      constexpr std::string_view alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+      for (size_t i = 0; i < alphabet.size(); ++i)
+      {
+        table[static_cast<uint8_t>(alphabet[i])] = static_cast<uint8_t>(i);
+      }
+      table['='] = 0;
+      return table;
+    }();
+
+    size_t j = 0;
+    for (size_t i = 0; i < size; i += 4)
+    {
+      uint32_t triple = 0;
+      for (size_t k = 0; k < 4; ++k)
+      {
+        const uint8_t value = Table[static_cast<uint8_t>(input[i + k])];
+        if (value == 64)
+        {
+          throw std::runtime_error("Invalid base64 character");
+        }
+        triple = (triple << 6) | value;
+      }
+
+      if (j < outSize)
+        out[j++] = static_cast<uint8_t>(triple >> 16);
+      if (j < outSize)
+        out[j++] = static_cast<uint8_t>(triple >> 8);
+      if (j < outSize)
+        out[j++] = static_cast<uint8_t>(triple);
+    }
+  }
+
+#if COVERAGE_X86
+  // ---- Encoding (W. Mula / D. Lemire): 12 bytes -> 16 characters per 128-bit lane ----
+
+  /// Map 6-bit indices to the base64 alphabet.
+  COVERAGE_TARGET("ssse3")
+  static __m128i EncodeLookup(__m128i indices)
+  {
+    const __m128i shiftLut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(shiftLut, result), indices);
+  }
+
+  /// Split 3 bytes into four 6-bit indices, for 4 groups.
+  COVERAGE_TARGET("ssse3")
+  static __m128i EncodeSplit(__m128i in)
+  {
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+  }
+
+  /// Returns the number of input bytes encoded (a multiple of 3).
+  COVERAGE_TARGET("ssse3")
+  static size_t EncodeSSSE3(const uint8_t* data, size_t size, char* out)
+  {
+    size_t i = 0;
+    // Loads 16 bytes to use 12
+    for (; i + 16 <= size; i += 12, out += 16)
+    {
+      const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), EncodeLookup(EncodeSplit(in)));
+    }
+    return i;
+  }
+
+  COVERAGE_TARGET("avx2")
+  static size_t EncodeAVX2(const uint8_t* data, size_t size, char* out)
+  {
+    const __m256i shuffle = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i shiftLut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                              '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                              'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                              '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+    size_t i = 0;
+    // Each lane loads 16 bytes to use 12
+    for (; i + 28 <= size; i += 24, out += 32)
+    {
+      const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 12));
+      __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+      in = _mm256_shuffle_epi8(in, shuffle);
+      const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+      const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+      const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+      const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+      const __m256i indices = _mm256_or_si256(t1, t3);
+
+      __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+      const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+      result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+      result = _mm256_add_epi8(_mm256_shuffle_epi8(shiftLut, result), indices);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), result);
+    }
+
+    // Finish whole 12-byte blocks with SSSE3 (AVX2 implies it)
+    return i + EncodeSSSE3(data + i, size - i, out);
+  }
+
+  // ---- Decoding (W. Mula / D. Lemire): 16 characters -> 12 bytes per 128-bit lane ----
+
+  /// Returns the number of input characters decoded (a multiple of 4). Stops before padding,
+  /// before the last output bytes (stores are 16/32 bytes wide) and before any invalid character.
+  COVERAGE_TARGET("ssse3")
+  static size_t DecodeSSSE3(const char* input, size_t size, uint8_t* out, size_t outSize)
+  {
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F = _mm_set1_epi8(0x2F);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t i = 0;
+    size_t j = 0;
+    for (; i + 16 < size && j + 16 <= outSize; i += 16, j += 12)
+    {
+      __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+
+      const __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask2F);
+      const __m128i loNibbles = _mm_and_si128(str, mask2F);
+      const __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+      const __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF)
+      {
+        break; // Let the scalar code report it
+      }
+
+      const __m128i eq2F = _mm_cmpeq_epi8(str, mask2F);
+      const __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles));
+      str = _mm_add_epi8(str, roll);
+
+      const __m128i mergeAbBc = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+      const __m128i merged = _mm_madd_epi16(mergeAbBc, _mm_set1_epi32(0x00011000));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j), _mm_shuffle_epi8(merged, pack));
+    }
+    return i;
+  }
+
+  COVERAGE_TARGET("avx2")
+  static size_t DecodeAVX2(const char* input, size_t size, uint8_t* out, size_t outSize)
+  {
+    const __m256i lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                           0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                           0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                             0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask2F = _mm256_set1_epi8(0x2F);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+    size_t i = 0;
+    size_t j = 0;
+    for (; i + 32 < size && j + 32 <= outSize; i += 32, j += 24)
+    {
+      __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+
+      const __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask2F);
+      const __m256i loNibbles = _mm256_and_si256(str, mask2F);
+      const __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+      const __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+      if (!_mm256_testz_si256(lo, hi))
+      {
+        break; // Let the scalar code report it
+      }
+
+      const __m256i eq2F = _mm256_cmpeq_epi8(str, mask2F);
+      const __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2F, hiNibbles));
+      str = _mm256_add_epi8(str, roll);
+
+      const __m256i mergeAbBc = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+      __m256i merged = _mm256_madd_epi16(mergeAbBc, _mm256_set1_epi32(0x00011000));
+      merged = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(merged, pack), lanes);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j), merged);
+    }
+
+    // Finish with SSSE3 (AVX2 implies it)
+    return i + DecodeSSSE3(input + i, size - i, out + j, outSize - j);
+  }
+#endif
+};
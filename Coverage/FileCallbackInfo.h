@@ -7,11 +7,16 @@
 #include "CallbackInfo.h"
 #include "Util.h"
 #include "md5.h"
+#include "NativeV3.h"
+#include "ParallelRenderer.h"
 #include "ProfileNode.h"
+#include "ReportEmitter.h"
 #include "RuntimeNotifications.h"
 
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
@@ -124,184 +129,227 @@ struct FileCallbackInfo
     return newLineData->LineInfo(size_t(lineNumber));
   }
 
-  void WriteReport(RuntimeOptions::ExportFormatType exportFormat, const MergedProfileInfoMap& mergedProfileInfo, std::ostream& stream)
+  /// \param[in] totalSamples: deep samples of the run, written with raw sample counts so that merges can sum profiles.
+  void WriteReport(RuntimeOptions::ExportFormatType exportFormat, const MergedProfileInfoMap& mergedProfileInfo, std::ostream& stream, uint64_t totalSamples = 0)
   {
+    ReportEmitter out(stream);
+    ParallelRenderer renderer;
+    const auto files = SortedFiles();
     switch (exportFormat)
     {
-      case RuntimeOptions::Clover:    WriteClover(stream); break;
-      case RuntimeOptions::Cobertura: WriteCobertura(stream); break;
-      case RuntimeOptions::NativeV2:  WriteNativeV2(stream); break;
-      default: WriteNative(stream, mergedProfileInfo); break;
+      case RuntimeOptions::Clover:    WriteClover(out, renderer, files); break;
+      case RuntimeOptions::Cobertura: WriteCobertura(out, renderer, files); break;
+      case RuntimeOptions::NativeV2:  WriteNativeV2(out, renderer, files, mergedProfileInfo); break;
+      case RuntimeOptions::NativeV3:  WriteNativeV3(out, renderer, files); break;
+      default: WriteNative(out, renderer, files, mergedProfileInfo, totalSamples); break;
     }
   }
 
 private:
+  using FileEntry = FileInfoMap::value_type;
+  using FileList = std::vector<const FileEntry*>;
 
-  void WriteClover(std::ostream& stream)
+  /// Line counters of one file (or of the whole report once reduced).
+  struct FileStats
   {
-    size_t totalFiles = 0;
-    size_t coveredFiles = 0;
-    size_t totalLines = 0;
-    size_t coveredLines = 0;
-    for (auto& it : lineData)
+    size_t codeLines = 0;     ///< Lines with debug info
+    size_t coveredLines = 0;  ///< Lines where every breakpoint was hit
+    size_t debugCount = 0;    ///< Sum of breakpoints
+    size_t hitCount = 0;      ///< Sum of hit breakpoints
+
+    FileStats& operator+=(const FileStats& other)
     {
-      auto ptr = it.second.get();
-      for (size_t i = 0; i < ptr->numberLines; ++i)
+      codeLines += other.codeLines;
+      coveredLines += other.coveredLines;
+      debugCount += other.debugCount;
+      hitCount += other.hitCount;
+      return *this;
+    }
+
+    double lineRate() const
+    {
+      return double(coveredLines) / double(codeLines);
+    }
+  };
+
+  /// Files in a stable order, so the report does not depend on the hash map layout.
+  FileList SortedFiles() const
+  {
+    FileList files;
+    files.reserve(lineData.size());
+    for (const auto& it : lineData)
+    {
+      files.push_back(&it);
+    }
+    std::sort(files.begin(), files.end(), [](const FileEntry* lhs, const FileEntry* rhs) { return lhs->first < rhs->first; });
+    return files;
+  }
+
+  static FileStats ComputeStats(const FileInfo& info)
+  {
+    FileStats stats;
+    for (size_t i = 0; i < info.numberLines; ++i)
+    {
+      const auto& line = info.lines[i];
+      if (info.relevant[i] && line.DebugCount != 0)
       {
-        if (ptr->relevant[i] && ptr->lines[i].DebugCount != 0)
+        ++stats.codeLines;
+        if (line.HitCount == line.DebugCount)
         {
-          ++totalFiles;
-          if (ptr->lines[i].HitCount == ptr->lines[i].DebugCount)
-          {
-            ++coveredFiles;
-          }
-
-          totalLines += ptr->lines[i].DebugCount;
-          coveredLines += ptr->lines[i].HitCount;
+          ++stats.coveredLines;
         }
+        stats.debugCount += line.DebugCount;
+        stats.hitCount += line.HitCount;
       }
     }
+    return stats;
+  }
+
+  /// Compute stats of each file in parallel and return the total.
+  static FileStats ComputeStats(const ParallelRenderer& renderer, const FileList& files, std::vector<FileStats>& perFile)
+  {
+    perFile.resize(files.size());
+    renderer.forEach(files.size(), [&](size_t, size_t index)
+    {
+      perFile[index] = ComputeStats(*files[index]->second);
+    });
+
+    FileStats total;
+    for (const auto& stats : perFile)
+    {
+      total += stats;
+    }
+    return total;
+  }
+
+  void WriteClover(ReportEmitter& out, ParallelRenderer& renderer, const FileList& files)
+  {
+    std::vector<FileStats> perFile;
+    const auto total = ComputeStats(renderer, files, perFile);
 
     time_t t = time(0);   // get time now
-    stream << "<?xml version=\"1.0\" encoding=\"utf-8\"?>" << std::endl;
-    stream << "<clover generated=\"" << t << "\"  clover=\"3.1.5\">" << std::endl;
-    stream << "<project timestamp=\"" << t << "\">" << std::endl;
-    stream << "<metrics classes=\"0\" files=\"" << totalFiles << "\" packages=\"1\"  loc=\"" << totalLines << "\" ncloc = \"" << coveredLines << "\" ";
-    // stream << "coveredstatements=\"300\" statements=\"500\" coveredmethods=\"50\" methods=\"80\" ";
-    // stream << "coveredconditionals=\"100\" conditionals=\"120\" coveredelements=\"900\" elements=\"1000\" ";
-    stream << "complexity=\"0\" />" << std::endl;
-    stream << "<package name=\"" << RuntimeOptions::Instance().PackageName << "\">" << std::endl;
-    for (auto& it : lineData)
+    out << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+    out << "<clover generated=\"" << t << "\"  clover=\"3.1.5\">\n";
+    out << "<project timestamp=\"" << t << "\">\n";
+    out << "<metrics classes=\"0\" files=\"" << total.codeLines << "\" packages=\"1\"  loc=\"" << total.debugCount << "\" ncloc = \"" << total.hitCount << "\" ";
+    // out << "coveredstatements=\"300\" statements=\"500\" coveredmethods=\"50\" methods=\"80\" ";
+    // out << "coveredconditionals=\"100\" conditionals=\"120\" coveredelements=\"900\" elements=\"1000\" ";
+    out << "complexity=\"0\" />\n";
+    out << "<package name=\"" << RuntimeOptions::Instance().PackageName << "\">\n";
+
+    renderer.render(files.size(), out, [&](size_t, size_t index, ReportEmitter& fragment)
     {
-      auto ptr = it.second.get();
+      const auto& [filename, info] = *files[index];
+      auto ptr = info.get();
 
-      stream << "<file name=\"" << it.first << "\">" << std::endl;
+      fragment << "<file name=\"" << filename << "\">\n";
 
       for (size_t i = 0; i < ptr->numberLines; ++i)
       {
         if (ptr->relevant[i] && ptr->lines[i].DebugCount != 0)
         {
+          fragment << "<line num=\"" << i;
           if (ptr->lines[i].HitCount == ptr->lines[i].DebugCount)
           {
-            stream << "<line num=\"" << i << "\" count=\"1\" type=\"stmt\"/>" << std::endl;
+            fragment << "\" count=\"1\" type=\"stmt\"/>\n";
           }
           else
           {
-            stream << "<line num=\"" << i << "\" count=\"0\" type=\"stmt\"/>" << std::endl;
+            fragment << "\" count=\"0\" type=\"stmt\"/>\n";
           }
         }
       }
 
-      stream << "</file>" << std::endl;
-    }
+      fragment << "</file>\n";
+    });
 
-    stream << "</package>" << std::endl;
-    stream << "</project>" << std::endl;
-    stream << "</clover>" << std::endl;
+    out << "</package>\n"
+           "</project>\n"
+           "</clover>\n";
   }
 
-  void WriteCobertura(std::ostream& stream)
+  void WriteCobertura(ReportEmitter& out, ParallelRenderer& renderer, const FileList& files)
   {
-    std::unordered_set<char> sourceList;
-
-    double total = 0;
-    double covered = 0;
-    for (auto& it : lineData)
+    std::set<char> sourceList;
+    for (const auto& it : files)
     {
-      sourceList.insert(it.first.front());
-      auto ptr = it.second.get();
-      for (size_t i = 0; i < ptr->numberLines; ++i)
-      {
-        if (ptr->relevant[i] && ptr->lines[i].DebugCount != 0)
-        {
-          ++total;
-          if (ptr->lines[i].HitCount == ptr->lines[i].DebugCount)
-          {
-            ++covered;
-          }
-        }
-      }
+      sourceList.insert(it->first.front());
     }
 
-    double lineRate = covered / total;
+    std::vector<FileStats> perFile;
+    const double lineRate = ComputeStats(renderer, files, perFile).lineRate();
 
-    stream << "<?xml version=\"1.0\" encoding=\"utf-8\"?>" << std::endl;
-    stream << "<coverage line-rate=\"" << lineRate << "\"" << " " << "version=\"\">" << std::endl;
-    stream << "\t" << "<packages>" << std::endl;
+    out << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+    out << "<coverage line-rate=\"" << lineRate << "\" version=\"\">\n";
+    out << ReportEmitter::Indent(1) << "<packages>\n";
 
-    stream << "\t\t" << "<package name=\"" << RuntimeOptions::Instance().PackageName << "\" line-rate=\"" << lineRate << "\">" << std::endl;
-    stream << "\t\t\t" << "<classes>" << std::endl;
-    for (auto& it : lineData)
+    out << ReportEmitter::Indent(2) << "<package name=\"" << RuntimeOptions::Instance().PackageName << "\" line-rate=\"" << lineRate << "\">\n";
+    out << ReportEmitter::Indent(3) << "<classes>\n";
+
+    renderer.render(files.size(), out, [&](size_t, size_t index, ReportEmitter& fragment)
     {
-      auto ptr = it.second.get();
+      const auto& [filename, info] = *files[index];
+      auto ptr = info.get();
 
-      std::string name = it.first;
+      std::string_view name = filename;
       auto idx = name.find_last_of('\\');
-      if (idx != std::string::npos)
+      if (idx != std::string_view::npos)
       {
         name = name.substr(idx + 1);
       }
 
-      double total = 0;
-      double covered = 0;
-      for (size_t i = 0; i < ptr->numberLines; ++i)
-      {
-        if (ptr->relevant[i] && ptr->lines[i].DebugCount != 0)
-        {
-          ++total;
-          if (ptr->lines[i].HitCount == ptr->lines[i].DebugCount)
-          {
-            ++covered;
-          }
-        }
-      }
-
-      double lineRate = covered / total;
-
-      stream << "\t\t\t\t" << "<class name=\"" << name << "\" filename=\"" << it.first.substr(2) << "\" line-rate=\"" << lineRate << "\">" << std::endl;
-      stream << "\t\t\t\t\t" << "<lines>" << std::endl;
+      fragment << ReportEmitter::Indent(4) << "<class name=\"" << name << "\" filename=\"" << std::string_view(filename).substr(2) << "\" line-rate=\"" << perFile[index].lineRate() << "\">\n";
+      fragment << ReportEmitter::Indent(5) << "<lines>\n";
 
       for (size_t i = 0; i < ptr->numberLines; ++i)
       {
         if (ptr->relevant[i] && ptr->lines[i].DebugCount != 0)
         {
+          fragment << ReportEmitter::Indent(6) << "<line number=\"" << i + 1;
           if (ptr->lines[i].HitCount == ptr->lines[i].DebugCount)
           {
-            stream << "\t\t\t\t\t\t" << "<line number=\"" << i + 1 << "\" hits=\"1\"/>" << std::endl;
+            fragment << "\" hits=\"1\"/>\n";
           }
           else
           {
-            stream << "\t\t\t\t\t\t" << "<line number=\"" << i + 1 << "\" hits=\"0\"/>" << std::endl;
+            fragment << "\" hits=\"0\"/>\n";
           }
         }
       }
 
-      stream << "\t\t\t\t\t" << "</lines>" << std::endl;
-      stream << "\t\t\t\t" << "</class>" << std::endl;
-    }
+      fragment << ReportEmitter::Indent(5) << "</lines>\n";
+      fragment << ReportEmitter::Indent(4) << "</class>\n";
+    });
 
-    stream << "\t\t\t" << "</classes>" << std::endl;
-    stream << "\t\t" << "</package>" << std::endl;
-    stream << "\t" << "</packages>" << std::endl;
-    stream << "\t<sources>" << std::endl;
+    out << ReportEmitter::Indent(3) << "</classes>\n";
+    out << ReportEmitter::Indent(2) << "</package>\n";
+    out << ReportEmitter::Indent(1) << "</packages>\n";
+    out << ReportEmitter::Indent(1) << "<sources>\n";
     for (const auto& source : sourceList)
     {
-      stream << "\t\t<source>" << source << ":</source>" << std::endl;
+      out << ReportEmitter::Indent(2) << "<source>" << source << ":</source>\n";
     }
-    stream << "\t</sources>" << std::endl;
-    stream << "</coverage>" << std::endl;
+    out << ReportEmitter::Indent(1) << "</sources>\n";
+    out << "</coverage>\n";
   }
 
-  void WriteNative(std::ostream& stream, const MergedProfileInfoMap& mergedProfileInfo)
+  void WriteNative(ReportEmitter& out, ParallelRenderer& renderer, const FileList& files, const MergedProfileInfoMap& mergedProfileInfo, uint64_t totalSamples)
   {
-    for (auto& it : lineData)
+    if (totalSamples > 0)
     {
-      stream << "FILE: " << it.first << std::endl;
-      auto ptr = it.second.get();
+      out << "SAMPLES: " << totalSamples << '\n';
+    }
 
-      std::string result;
-      result.reserve(ptr->numberLines + 1);
+    renderer.render(files.size(), out, [&](size_t, size_t index, ReportEmitter& fragment)
+    {
+      const auto& [filename, info] = *files[index];
+      auto ptr = info.get();
 
+      fragment << "FILE: " << filename << '\n';
+
+      // Write the states directly into the output buffer
+      fragment << "RES: ";
+      char* result = fragment.reserve(ptr->numberLines);
       for (size_t i = 0; i < ptr->numberLines; ++i)
       {
         char state = 'i';
@@ -325,115 +373,238 @@ private:
             state = 'p';
           }
         }
-        result.push_back(state);
+        result[i] = state;
       }
+      fragment.commit(ptr->numberLines);
+      fragment << '\n';
 
-      stream << "RES: " << result << std::endl;
-
-      auto profInfo = mergedProfileInfo.find(it.first);
+      auto profInfo = mergedProfileInfo.find(filename);
 
-      if (profInfo == mergedProfileInfo.end())
+      fragment << "PROF: ";
+      if (profInfo != mergedProfileInfo.end())
       {
-        stream << "PROF: " << std::endl;
+        for (auto& it : *(profInfo->second.get()))
+        {
+          fragment << int(it.Deep) << ',' << int(it.Shallow) << ',';
+        }
       }
-      else
+      fragment << '\n';
+
+      // Raw counts: merged reports sum them and compute percentages again
+      if (totalSamples > 0 && profInfo != mergedProfileInfo.end())
       {
-        stream << "PROF: ";
+        fragment << "RAW: ";
+        for (auto& it : *(profInfo->second.get()))
+        {
+          fragment << it.DeepSamples << ',' << it.ShallowSamples << ',';
+        }
+        fragment << '\n';
+
+        // Denominators of the shallow percentages, summed by merges as well
+        fragment << "FUNC: ";
         for (auto& it : *(profInfo->second.get()))
         {
-          stream << int(it.Deep) << ',' << int(it.Shallow) << ',';
+          fragment << it.FunctionShallowSamples << ',';
         }
-        stream << std::endl;
+        fragment << '\n';
       }
+    });
+  }
+
+  static FileCoverageV2 EncodeCoverage(const FileInfo& info)
+  {
+    assert(info.relevant.size() == info.lines.size());
+    auto itRelevant = info.relevant.cbegin();
+    FileCoverageV2 coverage(info.lines.size());
+
+    auto itCoverage = coverage._code.begin();
+
+    for (const auto& line : info.lines)
+    {
+      *itCoverage = coverage.encodeLine(*itRelevant, line);
+      ++itCoverage;
+      ++itRelevant;
     }
+    return coverage;
   }
 
-  void WriteNativeV2(std::ostream& stream)
+  /// Files of a code path, with their path relative to it.
+  struct CodePathFiles
   {
-    const auto encodeCoverage = [](const FileInfo& info) -> FileCoverageV2
+    std::vector<std::string> filepaths;   ///< Relative path of each file (empty when not under the code path)
+    std::vector<size_t> selected;         ///< Index of files under the code path
+    std::vector<char> written;            ///< Files selected by at least one code path
+  };
+
+  static void SelectFiles(const ParallelRenderer& renderer, const FileList& files, const std::string& dirPath, CodePathFiles& result)
+  {
+    result.filepaths.resize(files.size());
+    result.written.resize(files.size(), 0);
+
+    renderer.forEach(files.size(), [&](size_t, size_t index)
     {
-      assert(info.relevant.size() == info.lines.size());
-      auto itRelevant = info.relevant.cbegin();
-      FileCoverageV2 coverage(info.lines.size());
+      auto& filepath = result.filepaths[index];
+      filepath = files[index]->first;
 
-      auto itCoverage = coverage._code.begin();
+      // Check if it's a subpath
+      if (!dirPath.empty())
+      {
+        auto relativeFile = std::filesystem::relative(filepath, dirPath);
+        if (relativeFile.empty() || relativeFile.native().front() == '.')
+        {
+          filepath.clear(); // Skip this item
+          return;
+        }
+        filepath = relativeFile.generic_string();
+      }
+    });
 
-      for (const auto& line : info.lines)
+    result.selected.clear();
+    for (size_t index = 0; index < files.size(); ++index)
+    {
+      if (!result.filepaths[index].empty())
       {
-        *itCoverage = coverage.encodeLine(*itRelevant, line);
-        ++itCoverage;
-        ++itRelevant;
+        result.selected.push_back(index);
+        result.written[index] = 1;
       }
-      return coverage;
-    };
+    }
+  }
 
-    MD5 md5;
+  static void WarnRefusedFiles(const FileList& files, const CodePathFiles& codePathFiles)
+  {
+    const auto& written = codePathFiles.written;
+    if (std::find(written.begin(), written.end(), 0) != written.end() && RuntimeOptions::Instance().isAtLeastLevel(VerboseLevel::Warning))
+    {
+      std::cerr << "List of refuse coverage files (because not relative to any code path):" << std::endl;
 
-    FileCoverageV2::writeHeader(stream);
+      for (size_t index = 0; index < files.size(); ++index)
+      {
+        if (!written[index])
+        {
+          std::cerr << std::format("- {0}", files[index]->first) << std::endl;
+        }
+      }
 
-    std::vector<std::string> filepaths;
-    filepaths.reserve(lineData.size());
+      std::cerr << std::endl << "List of code paths:" << std::endl;
 
-    for (const auto& item : lineData)
-    {
-      filepaths.push_back(item.first);
+      for (const auto& dirPath : RuntimeOptions::Instance().CodePaths)
+      {
+        std::cerr << std::format("- {0}", dirPath) << std::endl;
+      }
     }
+  }
 
-    for (const auto& dirPath : RuntimeOptions::Instance().CodePaths)
+  void WriteNativeV2(ReportEmitter& out, ParallelRenderer& renderer, const FileList& files, const MergedProfileInfoMap& mergedProfileInfo)
+  {
+    // One hash provider per worker
+    std::vector<std::unique_ptr<MD5>> md5(renderer.workers());
+
+    const bool compact = RuntimeOptions::Instance().CompactLines;
+    FileCoverageV2::writeHeader(out, compact, true);
+
+    CodePathFiles codePathFiles;
+    codePathFiles.written.resize(files.size(), 0);
+
+    // Canonical order (see FileCoverageV2::CanonicalLess): sorted code paths, files sorted by relative path
+    std::vector<std::string> dirPaths(RuntimeOptions::Instance().CodePaths.begin(), RuntimeOptions::Instance().CodePaths.end());
+    std::sort(dirPaths.begin(), dirPaths.end(), FileCoverageV2::DirectoryLess);
+    dirPaths.erase(std::unique(dirPaths.begin(), dirPaths.end()), dirPaths.end());
+
+    for (const auto& dirPath : dirPaths)
     {
-      bool dirPartAdded = false;
+      // Step 1: find which files are under this path
+      SelectFiles(renderer, files, dirPath, codePathFiles);
+      auto& selected = codePathFiles.selected;
+      if (selected.empty())
+      {
+        continue;
+      }
+      std::sort(selected.begin(), selected.end(), [&](size_t lhs, size_t rhs) { return codePathFiles.filepaths[lhs] < codePathFiles.filepaths[rhs]; });
 
-      for (auto& it : lineData)
+      // Step 2: render them
+      if (!dirPath.empty())
       {
-        auto filepath = it.first;
+        FileCoverageV2::openDirectory(out, dirPath);
+      }
 
-        // Check if it's a subpath
-        if (!dirPath.empty())
+      renderer.render(selected.size(), out, [&](size_t worker, size_t i, ReportEmitter& fragment)
+      {
+        const auto index = selected[i];
+        if (!md5[worker])
         {
-          auto relativeFile = std::filesystem::relative(filepath, dirPath);
-          if (relativeFile.empty() || relativeFile.native().front() == '.')
-          {
-            continue; // Skip this item
-          }
-          filepath = relativeFile.generic_string();
+          md5[worker] = std::make_unique<MD5>();
         }
 
-        if (!dirPartAdded && !dirPath.empty())
+        auto coverage = EncodeCoverage(*files[index]->second);
+        coverage.md5Code = md5[worker]->encode(files[index]->first);
+
+        // Raw sample counts, as the RAW lines of Native reports
+        auto profInfo = mergedProfileInfo.find(files[index]->first);
+        if (profInfo != mergedProfileInfo.end())
         {
-          dirPartAdded = true;
-          FileCoverageV2::openDirectory(stream, dirPath);
+          const auto& lines = *profInfo->second;
+          coverage._samples.resize(coverage._code.size());
+          for (size_t line = 0; line < coverage._samples.size() && line < lines.size(); ++line)
+          {
+            coverage._samples[line] = { lines[line].DeepSamples, lines[line].ShallowSamples };
+          }
         }
+        coverage.write(codePathFiles.filepaths[index], fragment, compact);
+      });
 
-        auto coverage = encodeCoverage(*it.second.get());
-        coverage.md5Code = md5.encode(it.first);
-        coverage.write(filepath, stream);
-
-        filepaths.erase(std::remove(filepaths.begin(), filepaths.end(), it.first), filepaths.end());
-      }
-
-      if (dirPartAdded && !dirPath.empty())
+      if (!dirPath.empty())
       {
-        FileCoverageV2::closeDirectory(stream);
+        FileCoverageV2::closeDirectory(out);
       }
     }
 
-    if (!filepaths.empty() && RuntimeOptions::Instance().isAtLeastLevel(VerboseLevel::Warning))
-    {
-      std::cerr << "List of refuse coverage files (because not relative to any code path):" << std::endl;
+    WarnRefusedFiles(files, codePathFiles);
+
+    FileCoverageV2::writeFooter(out);
+  }
+
+  void WriteNativeV3(ReportEmitter& out, ParallelRenderer& renderer, const FileList& files)
+  {
+    // One hash provider per worker
+    std::vector<std::unique_ptr<MD5>> md5(renderer.workers());
 
-      for (const auto& path : filepaths)
+    // Coverage arrays must stay alive until the writer is done
+    std::vector<std::pair<std::string, std::vector<FileCoverageV2>>> coverages;
+    NativeV3::Writer writer;
+
+    CodePathFiles codePathFiles;
+    codePathFiles.written.resize(files.size(), 0);
+
+    for (const auto& dirPath : RuntimeOptions::Instance().CodePaths)
+    {
+      SelectFiles(renderer, files, dirPath, codePathFiles);
+      const auto& selected = codePathFiles.selected;
+      if (selected.empty())
       {
-        std::cerr << std::format("- {0}", path) << std::endl;
+        continue;
       }
 
-      std::cerr << std::endl << "List of code paths:" << std::endl;
+      auto& [directory, encoded] = coverages.emplace_back(dirPath, std::vector<FileCoverageV2>(selected.size()));
+      renderer.forEach(selected.size(), [&](size_t worker, size_t i)
+      {
+        const auto index = selected[i];
+        if (!md5[worker])
+        {
+          md5[worker] = std::make_unique<MD5>();
+        }
 
-      for (const auto& dirPath : RuntimeOptions::Instance().CodePaths)
+        encoded[i] = EncodeCoverage(*files[index]->second);
+        encoded[i].md5Code = md5[worker]->encode(files[index]->first);
+      });
+
+      for (size_t i = 0; i < selected.size(); ++i)
       {
-        std::cerr << std::format("- {0}", dirPath) << std::endl;
+        writer.add(directory, codePathFiles.filepaths[selected[i]], encoded[i]);
       }
     }
 
-    FileCoverageV2::writeFooter(stream);
+    WarnRefusedFiles(files, codePathFiles);
+
+    writer.write(out);
   }
-};
+};
\ No newline at end of file
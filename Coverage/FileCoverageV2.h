@@ -1,10 +1,14 @@
 #pragma once
 
-#include "base64.h"
+#include "CompactLines.h"
+#include "FastBase64.h"
 #include "FileInfo.h"
+#include "MergeKernel.h"
+#include "ReportEmitter.h"
 
-#include <format>
-#include <fstream>
+#include <algorithm>
+#include <span>
+#include <string_view>
 
 struct FileCoverageV2
 {
@@ -14,6 +18,14 @@ struct FileCoverageV2
 
   using LineArray = std::vector<uint16_t>;
   LineArray _code;
+
+  /// Raw profiler counts of a line (see ProfileInfo), summed by merges.
+  struct LineSamples
+  {
+    uint64_t deep = 0;      ///< Samples with the line on the stack
+    uint64_t shallow = 0;   ///< Samples with the line on top of the stack
+  };
+  std::vector<LineSamples> _samples;    ///< Empty without profile, else one per line of _code
   size_t _nbLinesFile = 0;
   size_t _nbLinesCode = 0;
   size_t _nbLinesCovered = 0;
@@ -67,56 +79,180 @@ struct FileCoverageV2
 
   bool merge(const FileCoverageV2& other)
   {
-    if (_code.size() != other._code.size())
+    if (!merge(std::span<const uint16_t>(other._code.data(), other._code.size())))
       return false;
 
-    auto src = other._code.cbegin();
+    // Profiles are summed: a file profiled in one report only keeps its counts
+    if (!other._samples.empty())
+    {
+      _samples.resize(_code.size());
+      for (size_t i = 0; i < _samples.size() && i < other._samples.size(); ++i)
+      {
+        _samples[i].deep += other._samples[i].deep;
+        _samples[i].shallow += other._samples[i].shallow;
+      }
+    }
+    return true;
+  }
+
+  /// Merge a line array (in memory or mapped) and update covered lines in the same pass.
+  bool merge(std::span<const uint16_t> other)
+  {
+    if (_code.size() != other.size())
+      return false;
 
-    for (auto& line : _code)
+    _nbLinesCovered = MergeKernel::Merge(_code.data(), other.data(), _code.data(), _code.size());
+    return true;
+  }
+
+  bool hasSamples() const
+  {
+    return std::any_of(_samples.begin(), _samples.end(), [](const LineSamples& line) { return line.deep != 0 || line.shallow != 0; });
+  }
+
+  /// <profile> payload: varint(nbLines), then (varint(gap), varint(deep), varint(shallow))* for the sampled lines only,
+  /// gap = number of lines without samples skipped.
+  void encodeSamples(std::string& out) const
+  {
+    CompactLines::PutVarint(out, _code.size());
+    size_t gap = 0;
+    for (size_t i = 0; i < _code.size(); ++i)
+    {
+      const auto line = i < _samples.size() ? _samples[i] : LineSamples();
+      if (line.deep == 0 && line.shallow == 0)
+      {
+        ++gap;
+        continue;
+      }
+      CompactLines::PutVarint(out, gap);
+      CompactLines::PutVarint(out, line.deep);
+      CompactLines::PutVarint(out, line.shallow);
+      gap = 0;
+    }
+  }
+
+  /// Decode a <profile> payload into _samples, for the lines of _code. Throws std::runtime_error on malformed data.
+  void decodeSamples(std::string_view data)
+  {
+    const char* it = data.data();
+    const char* end = it + data.size();
+    if (CompactLines::GetVarint(it, end) != _code.size())
     {
-      const size_t count = (size_t) (line & maskCount) + (size_t) (*src & maskCount);
+      throw std::runtime_error("Profile and coverage line counts differ");
+    }
+    _samples.assign(_code.size(), LineSamples());
 
-      const bool isCode = (line & maskIsCode) == maskIsCode;
-      const bool isPartial = (line & maskIsPartial) == maskIsPartial && (*src & maskIsPartial) == maskIsPartial;
+    size_t index = 0;
+    while (it != end)
+    {
+      const size_t gap = CompactLines::GetVarint(it, end);
+      if (gap >= _samples.size() - index)
+      {
+        throw std::runtime_error("Profile overflows line array");
+      }
+      index += gap;
+      _samples[index].deep = CompactLines::GetVarint(it, end);
+      _samples[index].shallow = CompactLines::GetVarint(it, end);
+      ++index;
+    }
+  }
 
-      line = (uint16_t) std::min<size_t>(count, maskCount);
-      line |= isCode ? maskIsCode : 0;
-      line |= isPartial ? maskIsPartial : 0;
+  static constexpr std::string_view Version = "2.0";
+  static constexpr std::string_view CompactVersion = "2.1";   ///< Line arrays may use CompactLines encodings
+  static constexpr std::string_view SortedLayout = "sorted";  ///< layout attribute of reports in canonical order
 
-      ++src;
+  /// \param[in] compact: announce CompactLines encodings (older readers reject version 2.1).
+  /// \param[in] sorted: announce the canonical order of directories and files (see CanonicalLess).
+  static void writeHeader(ReportEmitter& out, bool compact = false, bool sorted = false)
+  {
+    out << R"(<?xml version="1.0" encoding="utf-8"?>)" "\n"
+           R"(<CppCoverage version=")" << (compact ? CompactVersion : Version) << '"';
+    if (sorted)
+    {
+      out << R"( layout=")" << SortedLayout << '"';
     }
-    updateStats();
-    return true;
+    out << ">\n";
   }
 
-  static void writeHeader(std::ostream& ofs)
+  /// Canonical order of directories: by path, files outside any directory ("") last.
+  static bool DirectoryLess(std::string_view lhs, std::string_view rhs)
   {
-    const std::string version("2.0");
+    if (lhs.empty() || rhs.empty())
+    {
+      return !lhs.empty() && rhs.empty();
+    }
+    return lhs < rhs;
+  }
 
-    ofs << R"(<?xml version="1.0" encoding="utf-8"?>)" << std::endl;
-    ofs << std::format(R"(<CppCoverage version="{0}">)", version) << std::endl;
+  /// Canonical order of files: by directory, then by path.
+  static bool CanonicalLess(std::string_view lhsDirectory, std::string_view lhsPath, std::string_view rhsDirectory, std::string_view rhsPath)
+  {
+    if (lhsDirectory != rhsDirectory)
+    {
+      return DirectoryLess(lhsDirectory, rhsDirectory);
+    }
+    return lhsPath < rhsPath;
   }
 
-  static void openDirectory(std::ostream& ofs, const std::string& aDir)
+  static void openDirectory(ReportEmitter& out, const std::string& aDir)
   {
-    ofs << std::format(R"(	<directory path="{0}">)", aDir) << std::endl;
+    out << R"(	<directory path=")" << aDir << "\">\n";
   }
 
-  static void closeDirectory(std::ostream& ofs)
+  static void closeDirectory(ReportEmitter& out)
   {
-    ofs << "	</directory>" << std::endl;
+    out << "	</directory>\n";
   }
 
-  static void writeFooter(std::ostream& ofs)
+  static void writeFooter(ReportEmitter& out)
   {
-    ofs << "</CppCoverage>" << std::endl;
+    out << "</CppCoverage>\n";
   }
 
-  void write(const std::string& filepath, std::ostream& ofs) const
+  /// \param[in] compact: use the smallest CompactLines encoding (the header must be written compact too).
+  void write(std::string_view filepath, ReportEmitter& out, bool compact = false) const
   {
-    ofs << std::format(R"(		<file path="{0}" md5="{1}">)", filepath, md5Code) << std::endl;
-    ofs << std::format(R"(			<stats nbLinesInFile="{0}" nbLinesOfCode="{1}" nbLinesCovered="{2}"/>)", _nbLinesFile, _nbLinesCode, _nbLinesCovered) << std::endl;
-    ofs << R"(			<coverage>)" << Base64::Encode(std::string(reinterpret_cast<const char*>(_code.data()), _code.size() * sizeof(LineArray::value_type))) << "</coverage>" << std::endl;
-    ofs << R"(		</file>)" << std::endl;
+    out << R"(		<file path=")" << filepath << R"(" md5=")" << md5Code << "\">\n";
+    out << R"(			<stats nbLinesInFile=")" << _nbLinesFile
+        << R"(" nbLinesOfCode=")" << _nbLinesCode
+        << R"(" nbLinesCovered=")" << _nbLinesCovered << "\"/>\n";
+
+    const auto encoding = compact ? CompactLines::Choose(_code) : CompactLines::Encoding::Raw;
+    if (encoding == CompactLines::Encoding::Raw)
+    {
+      // Encode straight into the output buffer
+      const size_t size = _code.size() * sizeof(LineArray::value_type);
+      const size_t encodedSize = FastBase64::EncodedLength(size);
+      out << R"(			<coverage>)";
+      FastBase64::Encode(reinterpret_cast<const uint8_t*>(_code.data()), size, out.reserve(encodedSize));
+      out.commit(encodedSize);
+    }
+    else
+    {
+      // Reports are rendered by several threads: one scratch buffer each
+      thread_local std::string data;
+      data.clear();
+      CompactLines::Encode(_code, encoding, data);
+
+      const size_t encodedSize = FastBase64::EncodedLength(data.size());
+      out << R"(			<coverage encoding=")" << CompactLines::Name(encoding) << "\">";
+      FastBase64::Encode(reinterpret_cast<const uint8_t*>(data.data()), data.size(), out.reserve(encodedSize));
+      out.commit(encodedSize);
+    }
+    out << "</coverage>\n";
+
+    if (hasSamples())
+    {
+      thread_local std::string samples;
+      samples.clear();
+      encodeSamples(samples);
+
+      const size_t encodedSize = FastBase64::EncodedLength(samples.size());
+      out << R"(			<profile>)";
+      FastBase64::Encode(reinterpret_cast<const uint8_t*>(samples.data()), samples.size(), out.reserve(encodedSize));
+      out.commit(encodedSize);
+      out << "</profile>\n";
+    }
+    out << "		</file>\n";
   }
 };
\ No newline at end of file
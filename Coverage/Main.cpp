@@ -1,6 +1,10 @@
 #include "CoverageRunner.h"
 #include "RuntimeOptions.h"
 #include "MergeRunner.h"
+#include "MergeService.h"
+#include "MultiMergeRunner.h"
+#include "ReportConverter.h"
+#include "ReportDiff.h"
 
 #include <algorithm>
 #include <iostream>
@@ -15,12 +19,32 @@ void ShowHelp()
   std::cout << "Options:" << std::endl;
   std::cout << "  -quiet:             Suppress output information from coverage tool. Equivalent to -verbose=none" << std::endl;
   std::cout << "  -verbose [level]:   Allow to show a level of log. The accepted level flags are: error / warning / info / trace / none. By default is setup to 'trace'" << std::endl;
-  std::cout << "  -format [fmt]:      Specify 'native', 'nativeV2' for native coverage format or 'cobertura' for cobertura XML or 'clover' for Clover" << std::endl;
+  std::cout << "  -format [fmt]:      Specify 'native', 'nativeV2', 'nativeV3' for native coverage format or 'cobertura' for cobertura XML or 'clover' for Clover" << std::endl;
+  std::cout << "  -compact:           With nativeV2, write run-length/sparse encoded line arrays (report version 2.1)" << std::endl;
   std::cout << "  -o [name]:          Write output information to the given filename" << std::endl;
   std::cout << "  -p [name]:          Assume source code can be found in the given path name" << std::endl;
   std::cout << "                      Convert only file under this path (the path to file will be in relative format)." << std::endl;
   std::cout << "  -w [name]:          Working directory where we execute the given executable filename" << std::endl;
   std::cout << "  -m [name]:          Merge current output to given path name or copy output if not existing" << std::endl;
+  std::cout << "  -lock-timeout [s]:  Wait at most s seconds for other processes merging into -m, or for the merge service (default 300)" << std::endl;
+  std::cout << "  -merge-input [name]: Merge this report into -m (no executable is run). Can be repeated." << std::endl;
+  std::cout << "                      Accept wildcards in file name (shard*.cov) or @name for a file listing one input per line." << std::endl;
+  std::cout << "  -serve [name]:      Run a merge service on pipe name, merging the received nativeV2 reports in memory" << std::endl;
+  std::cout << "                      and into -m on request, with the merges of other processes (no executable is run)." << std::endl;
+  std::cout << "  -checkpoint-interval [s]: With -serve, also write -m every s seconds when new reports were merged." << std::endl;
+  std::cout << "  -submit [name]:     Send the -o report (or -merge-input reports) to the merge service on pipe name instead of -m." << std::endl;
+  std::cout << "  -service-command [cmd]: With -submit, send 'checkpoint' or 'stop' to the merge service after the -merge-input reports (no executable is run)." << std::endl;
+  std::cout << "  -convert [name]:    Convert the given nativeV2/nativeV3 report to -format into -o (no executable is run)" << std::endl;
+  std::cout << "  -diff [base] [name]: Compare report name to report base, write new covered/uncovered lines into -o or on the console" << std::endl;
+  std::cout << "                      Reports are native, nativeV2 or nativeV3 (no executable is run)." << std::endl;
+  std::cout << "  -sample-hz [n]:     Take n profiling samples per second on a dedicated timer, whatever the debug events of the target." << std::endl;
+  std::cout << "                      By default a sample is taken each time the target sends no debug event for 500ms." << std::endl;
+  std::cout << "  -profile-collapsed [name]: Write the sampled call stacks in collapsed format (flame graphs) into name" << std::endl;
+  std::cout << "  -profile-pprof [name]: Write the sampled call stacks as a pprof profile into name" << std::endl;
+  std::cout << "  -profile-off-cpu [name]: Write the call stacks of the threads which did not run since the previous sample" << std::endl;
+  std::cout << "                      in collapsed format into name, with the reason they wait for (futex, sleep, read, poll...)" << std::endl;
+  std::cout << "                      as leaf frame. By default these threads are not sampled." << std::endl;
+  std::cout << "  -profile-off-cpu-pprof [name]: Write the call stacks of the blocked threads as a pprof profile into name" << std::endl;
   std::cout << "  -pkg [name]:        Name of package under test (executable or dll)" << std::endl;
   std::cout << "  -help:              Show help" << std::endl;
   std::cout << "  -solution [name]:   Convert only file under this path (the path to file will be in relative format)." << std::endl;
@@ -34,11 +58,23 @@ void ShowHelp()
   std::cout << "  2:                  Coverage failure" << std::endl;
   std::cout << "  3:                  Merge failure" << std::endl;
   std::cout << "  4:                  Application return error code" << std::endl;
+  std::cout << "  5:                  Conversion failure" << std::endl;
+  std::cout << "  6:                  Merge service failure" << std::endl;
+  std::cout << "  7:                  Diff failure" << std::endl;
   std::cout << "Example:" << std::endl;
   std::cout << "  coverage.exe -- myProgram.exe -param 1" << std::endl;
   std::cout << "    Run coverage on myProgram.exe with argument -param 1" << std::endl;
   std::cout << "  coverage.exe -o coverageLocal.cov -m fullcoverage.cov -- myProgram.exe" << std::endl;
   std::cout << "    Run coverage on myProgram.exe and create coverageLocal.cov coverage result and merge this result with anothers into fullcoverage.cov" << std::endl;
+  std::cout << "  coverage.exe -format nativeV3 -o fullcoverage.cov3 -convert fullcoverage.cov" << std::endl;
+  std::cout << "    Convert nativeV2 report fullcoverage.cov into nativeV3 report fullcoverage.cov3" << std::endl;
+  std::cout << "  coverage.exe -o diff.txt -diff main.cov pr.cov" << std::endl;
+  std::cout << "    Write lines newly covered, newly uncovered or with another hit count in pr.cov compared to main.cov" << std::endl;
+  std::cout << "  coverage.exe -format nativeV2 -m fullcoverage.cov -merge-input shards\\*.cov" << std::endl;
+  std::cout << "    Merge all shards\\*.cov reports (and fullcoverage.cov if existing) into fullcoverage.cov" << std::endl;
+  std::cout << "  coverage.exe -format nativeV2 -m fullcoverage.cov -serve coverage -checkpoint-interval 60" << std::endl;
+  std::cout << "  coverage.exe -format nativeV2 -o shard.cov -submit coverage -- myProgram.exe" << std::endl;
+  std::cout << "    Accumulate coverage of all shards in a merge service, written into fullcoverage.cov every minute" << std::endl;
   std::cout << std::endl;
 }
 
@@ -125,6 +161,10 @@ void ParseCommandLine(int argc, const char** argv)
       {
         opts.ExportFormat = RuntimeOptions::NativeV2;
       }
+      else if (t == "nativeV3")
+      {
+        opts.ExportFormat = RuntimeOptions::NativeV3;
+      }
       else if (t == "cobertura")
       {
         opts.ExportFormat = RuntimeOptions::Cobertura;
@@ -138,6 +178,10 @@ void ParseCommandLine(int argc, const char** argv)
         throw std::exception("Unsupported export type. Export type should be cobertura or native.");
       }
     }
+    else if (s == "-compact")
+    {
+      opts.CompactLines = true;
+    }
     else if (s == "-o")
     {
       ++i;
@@ -182,6 +226,118 @@ void ParseCommandLine(int argc, const char** argv)
       std::string t(argv[i]);
       opts.MergedOutput = t;
     }
+    else if (s == "-lock-timeout")
+    {
+      ++i;
+      if (i == argc)
+      {
+        throw std::exception("Unexpected end of parameters. Expected lock timeout in seconds.");
+      }
+
+      opts.MergeLockTimeout = static_cast<unsigned>(std::stoul(argv[i]));
+    }
+    else if (s == "-merge-input")
+    {
+      ++i;
+      if (i == argc)
+      {
+        throw std::exception("Unexpected end of parameters. Expected report file name to merge.");
+      }
+
+      std::string t(argv[i]);
+      opts.MergeInputs.push_back(t);
+    }
+    else if (s == "-serve")
+    {
+      ++i;
+      if (i == argc)
+      {
+        throw std::exception("Unexpected end of parameters. Expected merge service pipe name.");
+      }
+
+      std::string t(argv[i]);
+      opts.ServeChannel = t;
+    }
+    else if (s == "-checkpoint-interval")
+    {
+      ++i;
+      if (i == argc)
+      {
+        throw std::exception("Unexpected end of parameters. Expected checkpoint interval in seconds.");
+      }
+
+      opts.CheckpointInterval = static_cast<unsigned>(std::stoul(argv[i]));
+    }
+    else if (s == "-submit")
+    {
+      ++i;
+      if (i == argc)
+      {
+        throw std::exception("Unexpected end of parameters. Expected merge service pipe name.");
+      }
+
+      std::string t(argv[i]);
+      opts.SubmitChannel = t;
+    }
+    else if (s == "-service-command")
+    {
+      ++i;
+      if (i == argc)
+      {
+        throw std::exception("Unexpected end of parameters. Expected merge service command.");
+      }
+
+      std::string t(argv[i]);
+      if (t != "checkpoint" && t != "stop")
+      {
+        throw std::exception("Unsupported merge service command. Command should be checkpoint or stop.");
+      }
+      opts.ServiceCommand = t;
+    }
+    else if (s == "-convert")
+    {
+      ++i;
+      if (i == argc)
+      {
+        throw std::exception("Unexpected end of parameters. Expected report file name to convert.");
+      }
+
+      std::string t(argv[i]);
+      opts.ConvertInput = t;
+    }
+    else if (s == "-sample-hz")
+    {
+      ++i;
+      if (i == argc)
+      {
+        throw std::exception("Unexpected end of parameters. Expected number of samples per second.");
+      }
+
+      opts.SampleHz = static_cast<unsigned>(std::stoul(argv[i]));
+    }
+    else if (s == "-profile-collapsed" || s == "-profile-pprof" || s == "-profile-off-cpu" || s == "-profile-off-cpu-pprof")
+    {
+      ++i;
+      if (i == argc)
+      {
+        throw std::exception("Unexpected end of parameters. Expected profile file name.");
+      }
+
+      std::string t(argv[i]);
+      (s == "-profile-collapsed" ? opts.ProfileCollapsed : s == "-profile-pprof" ? opts.ProfilePprof :
+       s == "-profile-off-cpu" ? opts.ProfileOffCpu : opts.ProfileOffCpuPprof) = t;
+    }
+    else if (s == "-diff")
+    {
+      i += 2;
+      if (i >= argc)
+      {
+        throw std::exception("Unexpected end of parameters. Expected baseline and report file names to compare.");
+      }
+
+      opts.DiffBaseline = argv[i - 1];
+      opts.DiffInput = argv[i];
+    }
     else if (s == "-pkg")
     {
       ++i;
@@ -217,10 +373,65 @@ void ParseCommandLine(int argc, const char** argv)
     }
   }
 
-  // Check we can merge
-  if ((opts.ExportFormat != RuntimeOptions::Native && opts.ExportFormat != RuntimeOptions::NativeV2) && !opts.MergedOutput.empty())
+  // Merge service does not run any executable
+  if (!opts.ServeChannel.empty())
   {
-    throw std::exception("Merge mode is only for RuntimeOptions::Native or NativeV2 mode.");
+    if (opts.MergedOutput.empty())
+    {
+      throw std::exception("Merge service needs a merge file name (-m).");
+    }
+    if (opts.ExportFormat != RuntimeOptions::NativeV2)
+    {
+      throw std::exception("Merge service is only for nativeV2 mode.");
+    }
+    return;
+  }
+
+  if (!opts.SubmitChannel.empty() && opts.ExportFormat != RuntimeOptions::NativeV2)
+  {
+    throw std::exception("Reports sent to the merge service must be in nativeV2 mode.");
+  }
+  if (!opts.ServiceCommand.empty())
+  {
+    if (opts.SubmitChannel.empty())
+    {
+      throw std::exception("Merge service command needs a merge service pipe name (-submit).");
+    }
+    return;
+  }
+
+  // Merge of several reports does not run any executable
+  if (!opts.MergeInputs.empty())
+  {
+    if (!opts.SubmitChannel.empty())
+    {
+      return;
+    }
+    if (opts.MergedOutput.empty())
+    {
+      throw std::exception("Merging several reports needs a merge file name (-m).");
+    }
+    if (opts.ExportFormat == RuntimeOptions::NativeV3)
+    {
+      throw std::exception("Merging several reports is not available in nativeV3 mode.");
+    }
+    return;
+  }
+
+  // Diff does not run any executable
+  if (!opts.DiffInput.empty())
+  {
+    return;
+  }
+
+  // Conversion does not run any executable
+  if (!opts.ConvertInput.empty())
+  {
+    if (opts.OutputFile.empty())
+    {
+      throw std::exception("Conversion needs an output file name (-o).");
+    }
+    return;
   }
 
   auto idx = cmdLine.find(" -- ");
@@ -256,6 +467,19 @@ void ParseCommandLine(int argc, const char** argv)
 #endif
 }
 
+void SubmitToService(const RuntimeOptions& opts, const std::string& request)
+{
+  const std::string answer = MergeService::Send(opts.SubmitChannel, request, RetryPolicy::WithTimeout(std::chrono::seconds(opts.MergeLockTimeout)));
+  if (!answer.starts_with("OK"))
+  {
+    throw std::exception(("Merge service: " + answer).c_str());
+  }
+  if (opts.isAtLeastLevel(VerboseLevel::Info))
+  {
+    std::cout << "Merge service: " << request << ": " << answer << std::endl;
+  }
+}
+
 class UTF8CodePage {
 public:
   UTF8CodePage() : oldCodePage(::GetConsoleOutputCP())
@@ -303,6 +527,106 @@ int main(int argc, const char** argv)
     return 1; // Command error
   }
 
+  // Merge service
+  if (!opts.ServeChannel.empty())
+  {
+    try
+    {
+      MergeService service(opts);
+      service.run();
+    }
+    catch (const std::exception& e)
+    {
+      if (RuntimeOptions::Instance().isAtLeastLevel(VerboseLevel::Error))
+      {
+        std::cerr << "Error: " << e.what() << std::endl;
+      }
+      return 6; // Merge service error
+    }
+    return 0;
+  }
+
+  // Send reports or a command to the merge service
+  if (!opts.SubmitChannel.empty() && (!opts.ServiceCommand.empty() || !opts.MergeInputs.empty()))
+  {
+    try
+    {
+      for (const auto& input : MultiMergeRunner::ExpandInputs(opts.MergeInputs))
+      {
+        SubmitToService(opts, "MERGE " + std::filesystem::absolute(input).string());
+      }
+      // After the merges: a checkpoint includes them, a stop does not lose them
+      if (!opts.ServiceCommand.empty())
+      {
+        SubmitToService(opts, opts.ServiceCommand == "stop" ? "STOP" : "CHECKPOINT");
+      }
+    }
+    catch (const std::exception& e)
+    {
+      if (RuntimeOptions::Instance().isAtLeastLevel(VerboseLevel::Error))
+      {
+        std::cerr << "Error: " << e.what() << std::endl;
+      }
+      return 3; // Merge error
+    }
+    return 0;
+  }
+
+  // Merge several reports
+  if (!opts.MergeInputs.empty())
+  {
+    try
+    {
+      MultiMergeRunner merge(opts);
+      merge.execute();
+    }
+    catch (const std::exception& e)
+    {
+      if (RuntimeOptions::Instance().isAtLeastLevel(VerboseLevel::Error))
+      {
+        std::cerr << "Error: " << e.what() << std::endl;
+      }
+      return 3; // Merge error
+    }
+    return 0;
+  }
+
+  // Compare reports
+  if (!opts.DiffInput.empty())
+  {
+    try
+    {
+      ReportDiff::execute(opts);
+    }
+    catch (const std::exception& e)
+    {
+      if (RuntimeOptions::Instance().isAtLeastLevel(VerboseLevel::Error))
+      {
+        std::cerr << "Error: " << e.what() << std::endl;
+      }
+      return 7; // Diff error
+    }
+    return 0;
+  }
+
+  // Convert
+  if (!opts.ConvertInput.empty())
+  {
+    try
+    {
+      ReportConverter::execute(opts);
+    }
+    catch (const std::exception& e)
+    {
+      if (RuntimeOptions::Instance().isAtLeastLevel(VerboseLevel::Error))
+      {
+        std::cerr << "Error: " << e.what() << std::endl;
+      }
+      return 5; // Conversion error
+    }
+    return 0;
+  }
+
   try
   {
     if (opts.Executable.empty())
@@ -333,7 +657,11 @@ int main(int argc, const char** argv)
   // Merge
   try
   {
-    if (!opts.MergedOutput.empty())
+    if (!opts.SubmitChannel.empty())
+    {
+      SubmitToService(opts, "MERGE " + std::filesystem::absolute(opts.OutputFile).string());
+    }
+    else if (!opts.MergedOutput.empty())
     {
       if (RuntimeOptions::Instance().isAtLeastLevel(VerboseLevel::Info))
       {
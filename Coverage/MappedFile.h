@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Util.h"
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <Windows.h>
+
+/// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+  explicit MappedFile(const std::string& filename)
+  {
+    _file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (_file == INVALID_HANDLE_VALUE)
+    {
+      throw std::runtime_error("Impossible to open file: " + filename + " (" + Util::GetLastErrorAsString() + ")");
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size))
+    {
+      CloseHandle(_file);
+      throw std::runtime_error("Impossible to read size of file: " + filename);
+    }
+    _size = static_cast<size_t>(size.QuadPart);
+
+    // An empty file cannot be mapped: keep an empty view
+    if (_size > 0)
+    {
+      _mapping = CreateFileMapping(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (_mapping != NULL)
+      {
+        _data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+      }
+
+      if (_data == nullptr)
+      {
+        const auto error = Util::GetLastErrorAsString();
+        close();
+        throw std::runtime_error("Impossible to map file: " + filename + " (" + error + ")");
+      }
+    }
+  }
+
+  // Avoid copy constructor
+  MappedFile(const MappedFile&) = delete;
+
+  ~MappedFile()
+  {
+    close();
+  }
+
+  const char* data() const { return _data; }
+  size_t size() const { return _size; }
+  std::string_view view() const { return std::string_view(_data, _size); }
+
+private:
+  void close()
+  {
+    if (_data != nullptr)
+    {
+      UnmapViewOfFile(_data);
+      _data = nullptr;
+    }
+    if (_mapping != NULL)
+    {
+      CloseHandle(_mapping);
+      _mapping = NULL;
+    }
+    if (_file != INVALID_HANDLE_VALUE)
+    {
+      CloseHandle(_file);
+      _file = INVALID_HANDLE_VALUE;
+    }
+  }
+
+  HANDLE _file = INVALID_HANDLE_VALUE;
+  HANDLE _mapping = NULL;
+  const char* _data = nullptr;
+  size_t _size = 0;
+};
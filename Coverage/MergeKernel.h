@@ -0,0 +1,173 @@
+#pragma once
+
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+/// Merge of two FileCoverageV2 line arrays in one pass:
+///   count   = min(count(a) + count(b), maskCount)
+///   isCode  = isCode(a)
+///   partial = partial(a) && partial(b)
+/// and number of covered lines of the result (is code with count > 0), as FileCoverageV2::updateStats.
+/// Inputs are read-only (in-memory or mapped arrays), \p out may be one of them.
+struct MergeKernel
+{
+  enum class Isa
+  {
+    Scalar,
+    SSE2,
+    AVX2
+  };
+
+  static constexpr uint16_t MaskCount = 0x3FFF;
+  static constexpr uint16_t MaskIsCode = 0x8000;
+  static constexpr uint16_t MaskIsPartial = 0x4000;
+
+  /// Best instruction set available on this CPU.
+  static Isa Supported()
+  {
+    const auto& cpu = CpuFeatures::Get();
+    return cpu.avx2 ? Isa::AVX2 : cpu.sse2 ? Isa::SSE2 : Isa::Scalar;
+  }
+
+  /// Returns the number of covered lines of \p out.
+  static size_t Merge(const uint16_t* a, const uint16_t* b, uint16_t* out, size_t size, Isa isa = Supported())
+  {
+    size_t covered = 0;
+    size_t done = 0;
+#if COVERAGE_X86
+    if (isa == Isa::AVX2)
+    {
+      done = MergeAVX2(a, b, out, size, covered);
+    }
+    else if (isa == Isa::SSE2)
+    {
+      done = MergeSSE2(a, b, out, size, covered);
+    }
+#endif
+    return covered + MergeScalar(a + done, b + done, out + done, size - done);
+  }
+
+  /// dst[i] = min(dst[i], src[i]): merge of Native "RES:" states.
+  static void MinBytes(uint8_t* dst, const uint8_t* src, size_t size, Isa isa = Supported())
+  {
+    size_t done = 0;
+#if COVERAGE_X86
+    if (isa == Isa::AVX2)
+    {
+      done = MinBytesAVX2(dst, src, size);
+    }
+    else if (isa == Isa::SSE2)
+    {
+      done = MinBytesSSE2(dst, src, size);
+    }
+#endif
+    for (size_t i = done; i < size; ++i)
+    {
+      dst[i] = std::min(dst[i], src[i]);
+    }
+  }
+
+private:
+  static size_t MergeScalar(const uint16_t* a, const uint16_t* b, uint16_t* out, size_t size)
+  {
+    size_t covered = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+      const size_t count = std::min<size_t>(size_t(a[i] & MaskCount) + size_t(b[i] & MaskCount), MaskCount);
+      const uint16_t flags = (a[i] & MaskIsCode) | (a[i] & b[i] & MaskIsPartial);
+      out[i] = static_cast<uint16_t>(count | flags);
+      covered += ((flags & MaskIsCode) != 0 && count > 0) ? 1 : 0;
+    }
+    return covered;
+  }
+
+#if COVERAGE_X86
+  // Saturation: counts are added with a 0xC000 bias so that unsigned saturation (0xFFFF) is maskCount.
+  COVERAGE_TARGET("sse2")
+  static size_t MergeSSE2(const uint16_t* a, const uint16_t* b, uint16_t* out, size_t size, size_t& covered)
+  {
+    const __m128i maskCount = _mm_set1_epi16(MaskCount);
+    const __m128i bias = _mm_set1_epi16(static_cast<short>(0xFFFF - MaskCount));
+    const __m128i maskFlags = _mm_set1_epi16(static_cast<short>(MaskIsCode));
+    const __m128i maskPartial = _mm_set1_epi16(MaskIsPartial);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+      const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+
+      const __m128i sum = _mm_adds_epu16(_mm_or_si128(_mm_and_si128(va, maskCount), bias), _mm_and_si128(vb, maskCount));
+      const __m128i count = _mm_sub_epi16(sum, bias);
+      const __m128i flags = _mm_or_si128(_mm_and_si128(va, maskFlags), _mm_and_si128(_mm_and_si128(va, vb), maskPartial));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(count, flags));
+
+      // isCode (sign bit) and count != 0
+      const __m128i isCode = _mm_srai_epi16(va, 15);
+      const __m128i isCovered = _mm_andnot_si128(_mm_cmpeq_epi16(count, zero), isCode);
+      covered += std::popcount(static_cast<unsigned>(_mm_movemask_epi8(isCovered))) / 2;
+    }
+    return i;
+  }
+
+  COVERAGE_TARGET("avx2")
+  static size_t MergeAVX2(const uint16_t* a, const uint16_t* b, uint16_t* out, size_t size, size_t& covered)
+  {
+    const __m256i maskCount = _mm256_set1_epi16(MaskCount);
+    const __m256i bias = _mm256_set1_epi16(static_cast<short>(0xFFFF - MaskCount));
+    const __m256i maskFlags = _mm256_set1_epi16(static_cast<short>(MaskIsCode));
+    const __m256i maskPartial = _mm256_set1_epi16(MaskIsPartial);
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+      const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+
+      const __m256i sum = _mm256_adds_epu16(_mm256_or_si256(_mm256_and_si256(va, maskCount), bias), _mm256_and_si256(vb, maskCount));
+      const __m256i count = _mm256_sub_epi16(sum, bias);
+      const __m256i flags = _mm256_or_si256(_mm256_and_si256(va, maskFlags), _mm256_and_si256(_mm256_and_si256(va, vb), maskPartial));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_or_si256(count, flags));
+
+      const __m256i isCode = _mm256_srai_epi16(va, 15);
+      const __m256i isCovered = _mm256_andnot_si256(_mm256_cmpeq_epi16(count, zero), isCode);
+      covered += std::popcount(static_cast<unsigned>(_mm256_movemask_epi8(isCovered))) / 2;
+    }
+
+    // Finish 8 lines blocks with SSE2 (AVX2 implies it)
+    return i + MergeSSE2(a + i, b + i, out + i, size - i, covered);
+  }
+
+  COVERAGE_TARGET("sse2")
+  static size_t MinBytesSSE2(uint8_t* dst, const uint8_t* src, size_t size)
+  {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_min_epu8(a, b));
+    }
+    return i;
+  }
+
+  COVERAGE_TARGET("avx2")
+  static size_t MinBytesAVX2(uint8_t* dst, const uint8_t* src, size_t size)
+  {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+      const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+      const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_min_epu8(a, b));
+    }
+    return i + MinBytesSSE2(dst + i, src + i, size - i);
+  }
+#endif
+};
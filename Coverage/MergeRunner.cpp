@@ -2,6 +2,8 @@
 
 #include "MergeRunnerV1.h"
 #include "MergeRunnerV2.h"
+#include "MergeRunnerV3.h"
+#include "MergeRunnerXml.h"
 
 std::unique_ptr<MergeRunner> MergeRunner::createMergeRunner(const RuntimeOptions& opts)
 {
@@ -11,6 +13,11 @@ std::unique_ptr<MergeRunner> MergeRunner::createMergeRunner(const RuntimeOptions
       return std::make_unique<MergeRunnerV1>(opts);
     case RuntimeOptions::NativeV2:
       return std::make_unique<MergeRunnerV2>(opts);
+    case RuntimeOptions::NativeV3:
+      return std::make_unique<MergeRunnerV3>(opts);
+    case RuntimeOptions::Cobertura:
+    case RuntimeOptions::Clover:
+      return std::make_unique<MergeRunnerXml>(opts);
   }
   throw std::runtime_error("This format does not support merge feature !");
 }
\ No newline at end of file
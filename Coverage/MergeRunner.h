@@ -1,5 +1,6 @@
 #pragma once
 
+#include "MergedFile.h"
 #include "RuntimeOptions.h"
 
 #include <cassert>
@@ -22,6 +23,12 @@ protected:
     assert(!_options.OutputFile.empty());
   }
 
+  /// Wait policy when another process merges into the same file.
+  RetryPolicy retryPolicy() const
+  {
+    return RetryPolicy::WithTimeout(std::chrono::seconds(_options.MergeLockTimeout));
+  }
+
 public:
   virtual ~MergeRunner() = default;
 
@@ -1,61 +1,206 @@
 #pragma once
 
+#include "MergeKernel.h"
 #include "MergeRunner.h"
+#include "ProfileNode.h"
+#include "ReportEmitter.h"
 
+#include <charconv>
 #include <filesystem>
 #include <fstream>
 #include <map>
 #include <iostream>
+#include <vector>
 
 class MergeRunnerV1 : public MergeRunner
 {
-private:
+public:
   struct Profile
   {
     std::string res;
     std::string prof;
+    std::vector<uint64_t> samples;    ///< Raw (deep, shallow) sample counts per line behind prof, empty in older reports
+    std::vector<uint64_t> functionSamples;  ///< Shallow samples of the functions of each line, empty in older reports
   };
 
-  using DictCoverage = std::map<std::string, Profile>;
-
-  DictCoverage makeDictionary(const std::string& filename)
+  /// File path -> profile, with the number of samples of the profiled runs (0 without raw samples).
+  struct DictCoverage : std::map<std::string, Profile>
   {
-    DictCoverage dictOutput;
+    uint64_t totalSamples = 0;
+  };
 
-    std::fstream outputFile(filename.c_str(), std::fstream::in);
-    if (!outputFile.is_open())
+  /// Sequential reader of FILE:/RES:/PROF:[/RAW:[/FUNC:]] records and of the SAMPLES: header.
+  class Reader
+  {
+  public:
+    explicit Reader(const std::string& filename) :
+      _filename(filename),
+      _stream(filename.c_str(), std::fstream::in)
     {
-      const std::string msg = "Merge failure: Impossible to open file: " + filename;
-      throw std::exception(msg.c_str());
+      if (!_stream.is_open())
+      {
+        const std::string msg = "Merge failure: Impossible to open file: " + filename;
+        throw std::exception(msg.c_str());
+      }
     }
 
-    std::string buffer;
-    while (std::getline(outputFile, buffer))
+    /// Read next record, false at end of file.
+    bool next(std::string& file, Profile& profile)
     {
-      //Search FILE:
-      if (buffer.find_first_of("FILE:") != std::string::npos)
+      while (_pending || std::getline(_stream, _buffer))
       {
-        std::string filename = buffer.substr(6);
+        _pending = false;
+        if (_buffer.starts_with("FILE: "))
+        {
+          file.assign(_buffer, 6);
+          readField("RES: ", profile.res);
+          readField("PROF: ", profile.prof);
+
+          // Optional raw samples
+          profile.samples.clear();
+          profile.functionSamples.clear();
+          if (readNumbers("RAW: ", profile.samples))
+          {
+            readNumbers("FUNC: ", profile.functionSamples);
+          }
+          return true;
+        }
+        else if (_buffer.starts_with("SAMPLES: "))
+        {
+          std::vector<uint64_t> total;
+          parseNumbers(std::string_view(_buffer).substr(9), total);
+          _totalSamples += total.empty() ? 0 : total.front();
+        }
+      }
+      return false;
+    }
 
-        Profile profile;
+    /// Samples of the profiled runs, known once the first record is read.
+    uint64_t totalSamples() const { return _totalSamples; }
 
-        // Read next line (we suppose file is not corrupt)
-        std::getline(outputFile, buffer);
-        assert(buffer.find_first_of("RES:") != std::string::npos);
-        profile.res = buffer.substr(5);
+  private:
+    /// Read the optional \p prefix line of the record into \p values. False when the next line is something else.
+    bool readNumbers(std::string_view prefix, std::vector<uint64_t>& values)
+    {
+      if (!std::getline(_stream, _buffer))
+      {
+        return false;
+      }
+      if (!_buffer.starts_with(prefix))
+      {
+        _pending = true;
+        return false;
+      }
+      parseNumbers(std::string_view(_buffer).substr(prefix.size()), values);
+      return true;
+    }
 
-        std::getline(outputFile, buffer);
-        assert(buffer.find_first_of("PROF:") != std::string::npos);
-        profile.prof = buffer.substr(6);
+    void readField(std::string_view prefix, std::string& value)
+    {
+      if (!std::getline(_stream, _buffer) || !_buffer.starts_with(prefix))
+      {
+        const std::string msg = "Merge failure: Missing " + std::string(prefix) + "line in file: " + _filename;
+        throw std::exception(msg.c_str());
+      }
+      value.assign(_buffer, prefix.size());
+    }
 
-        dictOutput[filename] = profile;
+    /// Comma separated numbers (with a trailing comma).
+    void parseNumbers(std::string_view text, std::vector<uint64_t>& values) const
+    {
+      const char* pos = text.data();
+      const char* end = text.data() + text.size();
+      while (pos < end)
+      {
+        uint64_t value = 0;
+        const auto [ptr, ec] = std::from_chars(pos, end, value);
+        if (ec != std::errc() || (ptr != end && *ptr != ','))
+        {
+          const std::string msg = "Merge failure: Invalid sample count in file: " + _filename;
+          throw std::exception(msg.c_str());
+        }
+        values.push_back(value);
+        pos = ptr + 1;
       }
     }
-    outputFile.close();
+
+    std::string _filename;
+    std::ifstream _stream;
+    std::string _buffer;
+    bool _pending = false;
+    uint64_t _totalSamples = 0;
+  };
+
+  /// Read a whole Native report: file path -> profile.
+  static DictCoverage makeDictionary(const std::string& filename)
+  {
+    DictCoverage dictOutput;
+
+    Reader reader(filename);
+    std::string file;
+    Profile profile;
+    while (reader.next(file, profile))
+    {
+      dictOutput[file] = profile;
+    }
+    dictOutput.totalSamples = reader.totalSamples();
     return dictOutput;
   }
 
-  void merge(const DictCoverage& dictOutput, DictCoverage& dictMerge)
+  /// True when FILE: records are in strictly increasing order (as written by the coverage and the merges).
+  static bool isSorted(const std::string& filename)
+  {
+    Reader reader(filename);
+    std::string previous;
+    std::string file;
+    Profile profile;
+    bool first = true;
+    while (reader.next(file, profile))
+    {
+      if (!first && !(previous < file))
+      {
+        return false;
+      }
+      previous.swap(file);
+      first = false;
+    }
+    return true;
+  }
+
+  /// Merge \p src states and samples into \p dst.
+  static void merge(const std::string& file, const Profile& src, Profile& dst)
+  {
+    if (dst.res.size() == src.res.size())
+    {
+      // Rules: c > p > u > _
+      // In ASCII or UTF8  c < p < u < _ !!!
+      MergeKernel::MinBytes(reinterpret_cast<uint8_t*>(dst.res.data()), reinterpret_cast<const uint8_t*>(src.res.data()), dst.res.size());
+    }
+    else
+    {
+      // Source is different from both version ?
+      std::cerr << "Merge warning: impossible to merge " << file << ": size between src/dst is not same." << std::endl;
+    }
+
+    // Samples add up: percentages are computed again when written
+    add(src.samples, dst.samples);
+    add(src.functionSamples, dst.functionSamples);
+  }
+
+  static void add(const std::vector<uint64_t>& src, std::vector<uint64_t>& dst)
+  {
+    if (dst.size() < src.size())
+    {
+      dst.resize(src.size(), 0);
+    }
+    for (size_t i = 0; i < src.size(); ++i)
+    {
+      dst[i] += src[i];
+    }
+  }
+
+  /// Merge \p dictOutput into \p dictMerge.
+  static void merge(const DictCoverage& dictOutput, DictCoverage& dictMerge)
   {
     auto itOutput = dictOutput.cbegin();
     while (itOutput != dictOutput.cend())
@@ -63,23 +208,7 @@ private:
       auto itMerge = dictMerge.find(itOutput->first);
       if (itMerge != dictMerge.end())
       {
-        if (itMerge->second.res.size() == itOutput->second.res.size())
-        {
-          auto src = itOutput->second.res.cbegin();
-          for (auto& dst : itMerge->second.res)
-          {
-            // Rules: c > p > u > _
-            // In ASCII or UTF8  c < p < u < _ !!!
-            if (dst > *src)
-              dst = *src; // So easy !
-            ++src;
-          }
-        }
-        else
-        {
-          // Source is different from both version ?
-          std::cerr << "Merge warning: impossible to merge " << itOutput->first << ": size between src/dst is not same." << std::endl;
-        }
+        merge(itOutput->first, itOutput->second, itMerge->second);
       }
       else
       {
@@ -88,9 +217,120 @@ private:
 
       ++itOutput;
     }
+    dictMerge.totalSamples += dictOutput.totalSamples;
+  }
+
+  /// PROF: percentages of the raw samples of \p profile, as CallingContextTree::lines computes them for a run: deep
+  /// samples of the line over all samples of the runs, shallow samples of the line over the shallow samples of its
+  /// functions. Older reports without FUNC: use the shallow samples of the file instead.
+  static void writeProfile(const Profile& profile, uint64_t totalSamples, ReportEmitter& out)
+  {
+    const auto& samples = profile.samples;
+    uint64_t fileShallow = 0;
+    for (size_t i = 1; i < samples.size(); i += 2)
+    {
+      fileShallow += samples[i];
+    }
+
+    const bool byFunction = profile.functionSamples.size() * 2 == samples.size();
+    for (size_t i = 0; i + 1 < samples.size(); i += 2)
+    {
+      const float deep = ProfileInfo::Percent(samples[i], totalSamples);
+      const float shallow = ProfileInfo::Percent(samples[i + 1], byFunction ? profile.functionSamples[i / 2] : fileShallow);
+      out << int(deep) << ',' << int(shallow) << ',';
+    }
+  }
+
+  static void write(const std::string& file, const Profile& profile, uint64_t totalSamples, ReportEmitter& out)
+  {
+    out << "FILE: " << file << '\n';
+    out << "RES: " << profile.res << '\n';
+    out << "PROF: ";
+    if (profile.samples.empty())
+    {
+      out << profile.prof;
+    }
+    else
+    {
+      writeProfile(profile, totalSamples, out);
+    }
+    out << '\n';
+
+    if (!profile.samples.empty())
+    {
+      out << "RAW: ";
+      for (const auto count : profile.samples)
+      {
+        out << count << ',';
+      }
+      out << '\n';
+    }
+
+    if (!profile.functionSamples.empty())
+    {
+      out << "FUNC: ";
+      for (const auto count : profile.functionSamples)
+      {
+        out << count << ',';
+      }
+      out << '\n';
+    }
+  }
+
+  static void writeHeader(uint64_t totalSamples, ReportEmitter& out)
+  {
+    if (totalSamples > 0)
+    {
+      out << "SAMPLES: " << totalSamples << '\n';
+    }
+  }
+
+  static void write(const DictCoverage& dict, ReportEmitter& out)
+  {
+    writeHeader(dict.totalSamples, out);
+    for (const auto& cover : dict)
+    {
+      write(cover.first, cover.second, dict.totalSamples, out);
+    }
+  }
+
+  /// Merge-join of two sorted reports, one record of each in memory at a time.
+  static void mergeSorted(const std::string& outputFile, const std::string& mergedFile, ReportEmitter& out)
+  {
+    Reader output(outputFile);
+    Reader merged(mergedFile);
+
+    std::string fileOutput, fileMerged;
+    Profile profileOutput, profileMerged;
+    bool hasOutput = output.next(fileOutput, profileOutput);
+    bool hasMerged = merged.next(fileMerged, profileMerged);
+
+    // SAMPLES: headers come before the first record
+    const uint64_t totalSamples = output.totalSamples() + merged.totalSamples();
+    writeHeader(totalSamples, out);
+
+    while (hasOutput || hasMerged)
+    {
+      if (!hasMerged || (hasOutput && fileOutput < fileMerged))
+      {
+        write(fileOutput, profileOutput, totalSamples, out);
+        hasOutput = output.next(fileOutput, profileOutput);
+      }
+      else if (!hasOutput || fileMerged < fileOutput)
+      {
+        write(fileMerged, profileMerged, totalSamples, out);
+        hasMerged = merged.next(fileMerged, profileMerged);
+      }
+      else
+      {
+        merge(fileOutput, profileOutput, profileMerged);
+        write(fileMerged, profileMerged, totalSamples, out);
+        hasOutput = output.next(fileOutput, profileOutput);
+        hasMerged = merged.next(fileMerged, profileMerged);
+      }
+    }
   }
 
-public:
   /// Constructor
   /// \param[in] opts: application option. Need MergedOutput and OutputFile valid and defined + ExportFormat MUST BE Native.
   MergeRunnerV1(const RuntimeOptions& opts) :
@@ -112,29 +352,44 @@ public:
       throw std::exception(msg.c_str());
     }
 
+    // Concurrent merges into the same file wait for each other
+    const auto retry = retryPolicy();
+    MergeLock lock(_options.MergedOutput, retry);
+
     // Nothing to merge = Copy and quit
     if (!std::filesystem::exists(mergedPath))
     {
-      std::filesystem::copy(outputPath, mergedPath);
+      MergedFile::Copy(_options.OutputFile, _options.MergedOutput, retry);
       return;
     }
 
     // ---- Make merge ---------------------------------------------------------------
-    // Step 1: Parse output files and define a dictionary
-    DictCoverage dictOutput = makeDictionary(_options.OutputFile);
-    DictCoverage dictMerge = makeDictionary(_options.MergedOutput);
-
-    // Step 2: Parse merge
-    merge(dictOutput, dictMerge);
+    // Sorted reports (every report since files are written in order) are streamed beside the merged file,
+    // older unordered ones go through a dictionary.
+    const bool sorted = isSorted(_options.OutputFile) && isSorted(_options.MergedOutput);
 
-    // Step 3: Write dictionary (on empty file)
-    std::fstream mergeFile(_options.MergedOutput.c_str(), std::fstream::out);
-    for (const auto& cover : dictMerge)
+    DictCoverage dictMerge;
+    if (!sorted)
     {
-      mergeFile << "FILE: " << cover.first << std::endl;
-      mergeFile << "RES: " << cover.second.res << std::endl;
-      mergeFile << "PROF: " << cover.second.prof << std::endl;
+      // Step 1: Parse output files and define a dictionary
+      DictCoverage dictOutput = makeDictionary(_options.OutputFile);
+      dictMerge = makeDictionary(_options.MergedOutput);
+
+      // Step 2: Parse merge
+      merge(dictOutput, dictMerge);
     }
-    mergeFile.close();
+
+    // Step 3: Write result beside the merged file and replace it
+    MergedFile::Write(_options.MergedOutput, [&](ReportEmitter& out)
+    {
+      if (sorted)
+      {
+        mergeSorted(_options.OutputFile, _options.MergedOutput, out);
+      }
+      else
+      {
+        write(dictMerge, out);
+      }
+    }, std::ios::out, retry);
   }
-};
\ No newline at end of file
+};
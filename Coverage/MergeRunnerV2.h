@@ -1,183 +1,283 @@
 #pragma once
 
-#include "base64.h"
 #include "FileCallbackInfo.h"
+#include "MappedFile.h"
 #include "MergeRunner.h"
+#include "NativeV2Parser.h"
+#include "ReportEmitter.h"
 
+#include <algorithm>
 #include <filesystem>
-#include <sstream>
-#include <map>
-#include <regex>
-
-namespace TestFormat
-{
-  class TestNativeV2;
-}
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 class MergeRunnerV2 : public MergeRunner
 {
 public:
-  friend class TestFormat::TestNativeV2;
-private:
   using CodeCoverage = std::unordered_map<std::string, FileCoverageV2>;
   using DictCoverage = std::unordered_map<std::string, CodeCoverage>;
 
-  std::string clean(const std::string& content) const
+  /// Read a whole NativeV2 report: directory -> (file path -> coverage). Files outside any directory use "".
+  static DictCoverage makeDictionary(const std::string& filename)
   {
-    // Need to remove return line (not supported by regex)
-    const std::regex PatternClean("\r|\n|\t", std::regex_constants::ECMAScript);
-    return  std::regex_replace(content, PatternClean, "");
+    const auto mapping = map(filename);
+    return createDictionary(filename, mapping->view());
   }
 
-  std::string getDir(const std::string& line) const
+  static std::unique_ptr<MappedFile> map(const std::string& filename)
   {
-    std::regex pattern(R"(<directory path=\"([^\"]*)\")", std::regex_constants::ECMAScript | std::regex_constants::icase);
-    std::smatch regex_result;
-    std::regex_search(line, regex_result, pattern);
-    if (!regex_result.ready())
+    try
     {
-      return "";
+      return std::make_unique<MappedFile>(filename);
+    }
+    catch (const std::runtime_error&)
+    {
+      const std::string msg = "Merge failure: Impossible to open file: " + filename;
+      throw std::exception(msg.c_str());
     }
-
-    return regex_result.str(1);
   }
 
-  void parseFile(const std::string& filename, std::istream& stream, CodeCoverage& codeCoverage, const std::string& fileline) const
+  /// Build the dictionary of an in-memory NativeV2 report.
+  static DictCoverage createDictionary(const std::string& filename, std::string_view content)
   {
+    DictCoverage dictOutput;
+    CodeCoverage* codeCoverage = nullptr;
+    std::string_view currentDir;
+
     try
     {
-      // read whole data about file
-      std::string filedata = fileline;
-      std::string line;
-      while (std::getline(stream, line))
+      NativeV2Parser parser(content);
+      parser.parse([&](const NativeV2Parser::FileElement& file)
       {
-        static constexpr std::string_view END_FILE = "</file>";
-        const auto pos = line.find(END_FILE);
-        if (pos == std::string::npos)
+        if (codeCoverage == nullptr || file.directory != currentDir)
         {
-          filedata += clean(line);
+          currentDir = file.directory;
+          codeCoverage = &dictOutput[std::string(currentDir)];
         }
-        else
+
+        FileCoverageV2 profile;
+        try
         {
-          filedata += clean(line.substr(0, pos + END_FILE.size()));
-          break;
+          file.decode(profile);
         }
-      }
-
-      std::regex pattern(R"(<file path=\"([^\"]*)\" md5=\"(\w{32})\"><stats nbLinesInFile=\"(\d*)\" nbLinesOfCode=\"(\d*)\" nbLinesCovered=\"(\d*)\"\/><coverage>([^<]*)<)",
-                         std::regex_constants::ECMAScript | std::regex_constants::icase);
-      std::smatch regex_result;
-      std::regex_search(filedata, regex_result, pattern);
-      if (!regex_result.ready())
-      {
-        return;
-      }
-
-      const auto filename = regex_result.str(1);
-      const auto md5Code = regex_result.str(2);
-
-      std::string values;
-      Base64::Decode(regex_result.str(6), values);
-      assert(values.size() % 2 == 0);
-
-      FileCoverageV2 profile(values.size() / sizeof(FileCoverageV2::LineArray::value_type));
-      profile._nbLinesFile = std::stoi(regex_result.str(3));
-      profile._nbLinesCode = std::stoi(regex_result.str(4));
-      profile._nbLinesCovered = std::stoi(regex_result.str(5));
-
-      profile.md5Code = regex_result.str(2);
-      std::memcpy(profile._code.data(), values.data(), values.size());
-
-      codeCoverage[filename] = profile;
-    }
-    catch (const std::regex_error& e)
-    {
-      std::cerr << "Bad regexp: " << e.what() << std::endl;
+        catch (const std::runtime_error& e)
+        {
+          std::cerr << "Bad data into " << filename << " for " << file.path << " with error: " << e.what() << std::endl;
+          return;
+        }
+        (*codeCoverage)[std::string(file.path)] = std::move(profile);
+      });
     }
     catch (const std::runtime_error& e)
     {
-      std::cerr << "Bad data into " << filename << " with error: " << e.what() << std::endl;
+      const std::string msg = "Merge failure: " + std::string(e.what()) + " in file: " + filename;
+      throw std::exception(msg.c_str());
     }
+
+    // Directories without valid files are not kept
+    std::erase_if(dictOutput, [](const auto& directory) { return directory.second.empty(); });
+    return dictOutput;
   }
 
-  DictCoverage makeDictionary(const std::string& filename) const
+  /// Merge \p dictOutput into \p dictMerge.
+  static void merge(const DictCoverage& dictOutput, DictCoverage& dictMerge)
   {
-    std::ifstream outputFile(filename.c_str(), std::fstream::in);
-    if (!outputFile.is_open())
+    auto itDirOutput = dictOutput.cbegin();
+    while (itDirOutput != dictOutput.cend())
     {
-      const std::string msg = "Merge failure: Impossible to open file: " + filename;
-      throw std::exception(msg.c_str());
-    }
+      auto itDirMerge = dictMerge.find(itDirOutput->first);
+      if (itDirMerge != dictMerge.end())
+      {
+        auto itFileOutput = itDirOutput->second.cbegin();
+        while (itFileOutput != itDirOutput->second.cend())
+        {
+          auto fileMerge = itDirMerge->second.find(itFileOutput->first);
+          if (fileMerge == itDirMerge->second.end())
+          {
+            itDirMerge->second.emplace(itFileOutput->first, itFileOutput->second);
+          }
+          else if (!fileMerge->second.merge(itFileOutput->second))
+          {
+            // Source is different from both version ?
+            std::cerr << "Merge warning: impossible to merge " << fileMerge->first << ": size between src/dst is not same." << std::endl;
+          }
+          ++itFileOutput;
+        }
+      }
+      else
+      {
+        dictMerge[itDirOutput->first] = itDirOutput->second;
+      }
 
-    return createDictionary(filename, outputFile);
+      ++itDirOutput;
+    }
   }
 
-  DictCoverage createDictionary(const std::string& filename, std::istream& stream) const
+  /// Write \p dict in canonical order (see FileCoverageV2::CanonicalLess).
+  static void write(const DictCoverage& dict, ReportEmitter& out, bool compact)
   {
-    DictCoverage dictOutput;
-    CodeCoverage codeCoverage;
-    std::string currentDir;
+    FileCoverageV2::writeHeader(out, compact, true);
 
-    std::string line;
-    while (std::getline(stream, line))
+    std::vector<const DictCoverage::value_type*> directories;
+    directories.reserve(dict.size());
+    for (const auto& directory : dict)
     {
-      std::string lineClean = clean(line);
-      line.clear();
+      directories.push_back(&directory);
+    }
+    std::sort(directories.begin(), directories.end(), [](const auto* lhs, const auto* rhs) { return FileCoverageV2::DirectoryLess(lhs->first, rhs->first); });
 
-      if (lineClean.starts_with("<directory"))
+    std::vector<const CodeCoverage::value_type*> files;
+    for (const auto* directory : directories)
+    {
+      files.clear();
+      for (const auto& file : directory->second)
       {
-        currentDir = getDir(lineClean);
+        files.push_back(&file);
       }
-      else if (lineClean.starts_with("<file"))
+      std::sort(files.begin(), files.end(), [](const auto* lhs, const auto* rhs) { return lhs->first < rhs->first; });
+
+      const auto& dirName = directory->first;
+      if (!dirName.empty())
       {
-        parseFile(filename, stream, codeCoverage, lineClean);
+        FileCoverageV2::openDirectory(out, dirName);
       }
-      else if (lineClean.starts_with("</directory>"))
+      for (const auto* cover : files)
       {
-        if (!codeCoverage.empty())
-        {
-          dictOutput[currentDir] = codeCoverage;
-        }
-
-        codeCoverage.clear();
-        currentDir.clear();
+        cover->second.write(cover->first, out, compact);
+      }
+      if (!dirName.empty())
+      {
+        FileCoverageV2::closeDirectory(out);
       }
     }
 
-    if (!codeCoverage.empty())
-    {
-      dictOutput[""] = codeCoverage;
-    }
-
-    return dictOutput;
+    FileCoverageV2::writeFooter(out);
   }
 
-  void merge(const DictCoverage& dictOutput, DictCoverage& dictMerge)
+  /// Merge-join of two reports in canonical order: files are decoded one at a time, no dictionary is built.
+  /// Same result as makeDictionary + merge + write. Throws std::runtime_error when a report is not in canonical order.
+  static void mergeSorted(std::string_view outputContent, std::string_view mergedContent, ReportEmitter& out, bool compact)
   {
-    auto itDirOutput = dictOutput.cbegin();
-    while (itDirOutput != dictOutput.cend())
+    SortedStream output(outputContent);
+    SortedStream merged(mergedContent);
+
+    FileCoverageV2::writeHeader(out, compact, true);
+
+    std::string currentDir;
+    const auto emit = [&](const NativeV2Parser::FileElement& file, const FileCoverageV2& coverage)
     {
-      auto itDirMerge = dictMerge.find(itDirOutput->first);
-      if (itDirMerge != dictMerge.end())
+      if (file.directory != currentDir)
       {
-        auto itFileOutput = itDirOutput->second.cbegin();
-        while (itFileOutput != itDirOutput->second.cend())
+        if (!currentDir.empty())
         {
-          auto fileMerge = itDirMerge->second.find(itFileOutput->first);
-          if (!fileMerge->second.merge(itFileOutput->second))
+          FileCoverageV2::closeDirectory(out);
+        }
+        currentDir = file.directory;
+        if (!currentDir.empty())
+        {
+          FileCoverageV2::openDirectory(out, currentDir);
+        }
+      }
+      coverage.write(std::string(file.path), out, compact);
+    };
+
+    FileCoverageV2 coverageOutput;
+    FileCoverageV2 coverageMerged;
+    while (output.valid() || merged.valid())
+    {
+      if (!merged.valid() || (output.valid() && output.before(merged)))
+      {
+        if (decode(output.file(), coverageOutput))
+        {
+          emit(output.file(), coverageOutput);
+        }
+        output.advance();
+      }
+      else if (!output.valid() || merged.before(output))
+      {
+        if (decode(merged.file(), coverageMerged))
+        {
+          emit(merged.file(), coverageMerged);
+        }
+        merged.advance();
+      }
+      else
+      {
+        const bool validOutput = decode(output.file(), coverageOutput);
+        const bool validMerged = decode(merged.file(), coverageMerged);
+        if (validMerged)
+        {
+          if (validOutput && !coverageMerged.merge(coverageOutput))
           {
             // Source is different from both version ?
-            std::cerr << "Merge warning: impossible to merge " << fileMerge->first << ": size between src/dst is not same." << std::endl;
+            std::cerr << "Merge warning: impossible to merge " << merged.file().path << ": size between src/dst is not same." << std::endl;
           }
-          ++itFileOutput;
+          emit(merged.file(), coverageMerged);
+        }
+        else if (validOutput)
+        {
+          emit(output.file(), coverageOutput);
         }
+        output.advance();
+        merged.advance();
       }
-      else
+    }
+
+    if (!currentDir.empty())
+    {
+      FileCoverageV2::closeDirectory(out);
+    }
+    FileCoverageV2::writeFooter(out);
+  }
+
+private:
+  /// Files of a report, checking the canonical order announced by its header.
+  class SortedStream
+  {
+  public:
+    explicit SortedStream(std::string_view content) :
+      _parser(content)
+    {
+      _valid = _parser.next(_file);
+    }
+
+    bool valid() const { return _valid; }
+    const NativeV2Parser::FileElement& file() const { return _file; }
+
+    bool before(const SortedStream& other) const
+    {
+      return FileCoverageV2::CanonicalLess(_file.directory, _file.path, other._file.directory, other._file.path);
+    }
+
+    void advance()
+    {
+      const auto directory = _file.directory;
+      const auto path = _file.path;
+      _valid = _parser.next(_file);
+      if (_valid && !FileCoverageV2::CanonicalLess(directory, path, _file.directory, _file.path))
       {
-        dictMerge[itDirOutput->first] = itDirOutput->second;
+        throw std::runtime_error("Report is not in canonical order at " + std::string(_file.path));
       }
+    }
 
-      ++itDirOutput;
+  private:
+    NativeV2Parser _parser;
+    NativeV2Parser::FileElement _file;
+    bool _valid = false;
+  };
+
+  static bool decode(const NativeV2Parser::FileElement& file, FileCoverageV2& coverage)
+  {
+    try
+    {
+      file.decode(coverage);
+      return true;
+    }
+    catch (const std::runtime_error& e)
+    {
+      std::cerr << "Bad data for " << file.path << " with error: " << e.what() << std::endl;
+      return false;
     }
   }
 
@@ -203,14 +303,47 @@ public:
       throw std::exception(msg.c_str());
     }
 
+    // Concurrent merges into the same file wait for each other
+    const auto retry = retryPolicy();
+    MergeLock lock(_options.MergedOutput, retry);
+
     // Nothing to merge = Copy and quit
     if (!std::filesystem::exists(mergedPath))
     {
-      std::filesystem::copy(outputPath, mergedPath);
+      MergedFile::Copy(_options.OutputFile, _options.MergedOutput, retry);
       return;
     }
 
     // ---- Make merge ---------------------------------------------------------------
+    // Reports in canonical order are merge-joined without building dictionaries
+    const std::string tmpOutput = MergedFile::TempName(_options.MergedOutput);
+    bool joined = false;
+    {
+      const auto output = map(_options.OutputFile);
+      const auto merged = map(_options.MergedOutput);
+      if (NativeV2Parser(output->view()).sorted() && NativeV2Parser(merged->view()).sorted())
+      {
+        try
+        {
+          MergedFile::WriteTemp(tmpOutput, [&](ReportEmitter& out) { mergeSorted(output->view(), merged->view(), out, _options.CompactLines); });
+          joined = true;
+        }
+        catch (const std::runtime_error& e)
+        {
+          if (_options.isAtLeastLevel(VerboseLevel::Warning))
+          {
+            std::cerr << "Merge warning: " << e.what() << ", merging with dictionaries." << std::endl;
+          }
+        }
+      }
+    }
+    if (joined)
+    {
+      // Mappings are closed: the merged report can be replaced
+      MergedFile::Commit(tmpOutput, _options.MergedOutput, retry);
+      return;
+    }
+
     // Step 1: Parse output files and define a dictionary
     DictCoverage dictOutput = makeDictionary(_options.OutputFile);
     DictCoverage dictMerge = makeDictionary(_options.MergedOutput);
@@ -218,30 +351,7 @@ public:
     // Step 2: Parse merge
     merge(dictOutput, dictMerge);
 
-    // Step 3: Write dictionary (on empty file)
-    std::ofstream ofs(_options.MergedOutput);
-
-    FileCoverageV2::writeHeader(ofs);
-
-    for (const auto& directories : dictMerge)
-    {
-      const auto& dirName = directories.first;
-      if (!dirName.empty())
-      {
-        FileCoverageV2::openDirectory(ofs, dirName);
-      }
-      for (const auto& cover : directories.second)
-      {
-        cover.second.write(cover.first, ofs);
-      }
-      if (!dirName.empty())
-      {
-        FileCoverageV2::closeDirectory(ofs);
-      }
-    }
-
-    FileCoverageV2::writeFooter(ofs);
-
-    ofs.close();
+    // Step 3: Write dictionary beside the merged file and replace it
+    MergedFile::Write(_options.MergedOutput, [&](ReportEmitter& out) { write(dictMerge, out, _options.CompactLines); }, std::ios::out, retry);
   }
 };
\ No newline at end of file
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "MergeRunner.h"
+#include "NativeV3.h"
+#include "ReportEmitter.h"
+
+#include <deque>
+#include <filesystem>
+#include <iostream>
+
+class MergeRunnerV3 : public MergeRunner
+{
+private:
+  /// Walk both sorted indexes together: only files present in both reports are decoded and merged,
+  /// every other line array and profile is copied as is from the mapping.
+  static void merge(const NativeV3::Reader& output, const NativeV3::Reader& merged, NativeV3::Writer& writer, std::deque<FileCoverageV2>& storage)
+  {
+    const auto add = [&](const NativeV3::Reader& reader, std::string_view directory, const NativeV3::FileEntry& entry)
+    {
+      writer.add(directory, reader.string(entry.path), entry.nbLinesFile, entry.nbLinesCode, entry.nbLinesCovered, reader.md5(entry), reader.lines(entry), reader.samples(entry));
+    };
+
+    const auto addDirectory = [&](const NativeV3::Reader& reader, const NativeV3::DirectoryEntry& dir)
+    {
+      const auto directory = reader.string(dir.path);
+      for (const auto& entry : reader.files(dir))
+      {
+        add(reader, directory, entry);
+      }
+    };
+
+    const auto outDirs = output.directories();
+    const auto mergeDirs = merged.directories();
+    auto itOut = outDirs.begin();
+    auto itMerge = mergeDirs.begin();
+
+    while (itOut != outDirs.end() || itMerge != mergeDirs.end())
+    {
+      if (itMerge == mergeDirs.end() || (itOut != outDirs.end() && output.string(itOut->path) < merged.string(itMerge->path)))
+      {
+        addDirectory(output, *itOut++);
+        continue;
+      }
+      if (itOut == outDirs.end() || merged.string(itMerge->path) < output.string(itOut->path))
+      {
+        addDirectory(merged, *itMerge++);
+        continue;
+      }
+
+      // Same directory: merge-join on files
+      const auto directory = merged.string(itMerge->path);
+      const auto outFiles = output.files(*itOut++);
+      const auto mergeFiles = merged.files(*itMerge++);
+      auto jtOut = outFiles.begin();
+      auto jtMerge = mergeFiles.begin();
+
+      while (jtOut != outFiles.end() || jtMerge != mergeFiles.end())
+      {
+        if (jtMerge == mergeFiles.end() || (jtOut != outFiles.end() && output.string(jtOut->path) < merged.string(jtMerge->path)))
+        {
+          add(output, directory, *jtOut++);
+        }
+        else if (jtOut == outFiles.end() || merged.string(jtMerge->path) < output.string(jtOut->path))
+        {
+          add(merged, directory, *jtMerge++);
+        }
+        else
+        {
+          // Profiles are summed with the decoded file, line arrays are merged in place
+          auto& coverage = storage.emplace_back(merged.coverage(*jtMerge));
+          if (!(jtOut->samplesSize == 0 ? coverage.merge(output.lines(*jtOut)) : coverage.merge(output.coverage(*jtOut))))
+          {
+            // Source is different from both version ?
+            std::cerr << "Merge warning: impossible to merge " << merged.string(jtMerge->path) << ": size between src/dst is not same." << std::endl;
+          }
+          writer.add(directory, merged.string(jtMerge->path), coverage);
+          ++jtOut;
+          ++jtMerge;
+        }
+      }
+    }
+  }
+
+public:
+  /// Constructor
+  /// \param[in] opts: application option. Need MergedOutput and OutputFile valid and defined + ExportFormat MUST BE NativeV3.
+  MergeRunnerV3(const RuntimeOptions& opts) :
+    MergeRunner(opts)
+  {
+    assert(_options.ExportFormat == RuntimeOptions::NativeV3); // Support only this !
+  }
+
+  /// Run merge
+  void execute() override
+  {
+    std::filesystem::path outputPath(_options.OutputFile);
+    std::filesystem::path mergedPath(_options.MergedOutput);
+
+    // Check we have data
+    if (!std::filesystem::exists(outputPath))
+    {
+      const std::string msg = "Merge failure: Impossible to find output file: " + _options.OutputFile;
+      throw std::exception(msg.c_str());
+    }
+
+    // Concurrent merges into the same file wait for each other
+    const auto retry = retryPolicy();
+    MergeLock lock(_options.MergedOutput, retry);
+
+    // Nothing to merge = Copy and quit
+    if (!std::filesystem::exists(mergedPath))
+    {
+      MergedFile::Copy(_options.OutputFile, _options.MergedOutput, retry);
+      return;
+    }
+
+    // ---- Make merge ---------------------------------------------------------------
+    // The merged report is mapped while we write: write beside it, then replace it.
+    const std::string tmpOutput = MergedFile::TempName(_options.MergedOutput);
+    {
+      // Step 1: Map both reports and merge their indexes
+      NativeV3::Reader output(_options.OutputFile);
+      NativeV3::Reader merged(_options.MergedOutput);
+
+      NativeV3::Writer writer;
+      std::deque<FileCoverageV2> storage;
+      merge(output, merged, writer, storage);
+
+      // Step 2: Write dictionary
+      MergedFile::WriteTemp(tmpOutput, [&](ReportEmitter& out) { writer.write(out); }, std::ios::binary);
+    }
+
+    // Step 3: Replace merged file (mappings are closed)
+    MergedFile::Commit(tmpOutput, _options.MergedOutput, retry);
+  }
+};
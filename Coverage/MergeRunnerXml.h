@@ -0,0 +1,393 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "MergeRunner.h"
+#include "ReportEmitter.h"
+#include "XmlScanner.h"
+
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/// Merge of Cobertura and Clover reports written by FileCallbackInfo. Only <line> elements are kept:
+/// hits of the same line are summed, line-rate (Cobertura) and metrics (Clover) are recomputed from the result.
+class MergeRunnerXml : public MergeRunner
+{
+public:
+  struct Line
+  {
+    size_t number = 0;  ///< As written: 1-based for Cobertura, 0-based for Clover
+    uint64_t hits = 0;
+  };
+
+  struct FileLines
+  {
+    std::string name;           ///< Cobertura class name (Clover: the key)
+    std::vector<Line> lines;    ///< By ascending number, one entry per number
+    size_t covered = 0;         ///< Lines with hits
+
+    /// Add hits of \p other: merge-join of both line arrays.
+    void merge(const FileLines& other)
+    {
+      std::vector<Line> result;
+      result.reserve(std::max(lines.size(), other.lines.size()));
+
+      auto it = lines.cbegin();
+      auto itOther = other.lines.cbegin();
+      while (it != lines.cend() || itOther != other.lines.cend())
+      {
+        if (itOther == other.lines.cend() || (it != lines.cend() && it->number < itOther->number))
+        {
+          result.push_back(*it++);
+        }
+        else if (it == lines.cend() || itOther->number < it->number)
+        {
+          result.push_back(*itOther++);
+        }
+        else
+        {
+          result.push_back({ it->number, it->hits + itOther->hits });
+          ++it;
+          ++itOther;
+        }
+      }
+      lines = std::move(result);
+      updateStats();
+    }
+
+    /// Sort lines by number (reports of this tool are already sorted), sum duplicates and count covered lines.
+    void normalize()
+    {
+      if (!std::is_sorted(lines.cbegin(), lines.cend(), [](const Line& lhs, const Line& rhs) { return lhs.number < rhs.number; }))
+      {
+        std::stable_sort(lines.begin(), lines.end(), [](const Line& lhs, const Line& rhs) { return lhs.number < rhs.number; });
+      }
+
+      auto last = lines.begin();
+      for (auto it = lines.begin(); it != lines.end(); ++it)
+      {
+        if (it != lines.begin() && it->number == (last - 1)->number)
+        {
+          (last - 1)->hits += it->hits;
+        }
+        else
+        {
+          *last++ = *it;
+        }
+      }
+      lines.erase(last, lines.end());
+      updateStats();
+    }
+
+    void updateStats()
+    {
+      covered = std::count_if(lines.cbegin(), lines.cend(), [](const Line& line) { return line.hits != 0; });
+    }
+
+    double lineRate() const
+    {
+      return double(covered) / double(lines.size());
+    }
+  };
+
+  /// File key (Cobertura filename, Clover name) -> lines. Sorted like the reports.
+  struct DictCoverage : std::map<std::string, FileLines>
+  {
+    std::set<std::string> sources;  ///< Cobertura <source> entries
+  };
+
+  /// Elements and attributes of one format.
+  struct Schema
+  {
+    std::string_view format;
+    std::string_view fileTag;
+    std::string_view keyAttribute;
+    std::string_view numberAttribute;
+    std::string_view hitsAttribute;
+  };
+
+  static const Schema& SchemaOf(RuntimeOptions::ExportFormatType format)
+  {
+    static const Schema cobertura{ "Cobertura", "class", "filename", "number", "hits" };
+    static const Schema clover{ "Clover", "file", "name", "num", "count" };
+    assert(format == RuntimeOptions::Cobertura || format == RuntimeOptions::Clover);
+    return format == RuntimeOptions::Cobertura ? cobertura : clover;
+  }
+
+  /// Pull reader of the files of a report, in document order.
+  class Reader
+  {
+  public:
+    Reader(std::string_view content, const Schema& schema) :
+      _scanner(content, schema.format),
+      _schema(schema)
+    {}
+
+    /// Read the next file. Returns false at the end of the report.
+    /// Throws std::runtime_error on broken structure or invalid number.
+    bool next(std::string& key, FileLines& file)
+    {
+      bool inFile = false;
+      std::string_view tag;
+      while (_scanner.nextTag(tag))
+      {
+        if (XmlScanner::isDeclaration(tag))
+        {
+          continue;
+        }
+
+        const auto name = XmlScanner::tagName(tag);
+        if (name == _schema.fileTag)
+        {
+          key = _scanner.attribute(tag, _schema.keyAttribute);
+          file.name = _scanner.attribute(tag, "name");
+          file.lines.clear();
+          inFile = true;
+        }
+        else if (name == "line" && inFile)
+        {
+          file.lines.push_back({ _scanner.number(_scanner.attribute(tag, _schema.numberAttribute)),
+                                 _scanner.number<uint64_t>(_scanner.attribute(tag, _schema.hitsAttribute)) });
+        }
+        else if (name.starts_with('/') && name.substr(1) == _schema.fileTag && inFile)
+        {
+          if (key.empty())
+          {
+            throw std::runtime_error("Missing " + std::string(_schema.keyAttribute) + " of <" + std::string(_schema.fileTag) + ">");
+          }
+          file.normalize();
+          return true;
+        }
+        else if (name == "source")
+        {
+          const auto source = _scanner.text();
+          if (!source.empty())
+          {
+            _sources.emplace(source);
+          }
+        }
+      }
+
+      if (inFile)
+      {
+        throw std::runtime_error("Unterminated <" + std::string(_schema.fileTag) + "> " + key);
+      }
+      return false;
+    }
+
+    /// Cobertura <source> entries read so far (all of them once next() returned false).
+    const std::set<std::string>& sources() const { return _sources; }
+
+  private:
+    XmlScanner _scanner;
+    const Schema& _schema;
+    std::set<std::string> _sources;
+  };
+
+  static std::unique_ptr<MappedFile> map(const std::string& filename)
+  {
+    try
+    {
+      return std::make_unique<MappedFile>(filename);
+    }
+    catch (const std::runtime_error&)
+    {
+      const std::string msg = "Merge failure: Impossible to open file: " + filename;
+      throw std::exception(msg.c_str());
+    }
+  }
+
+  /// Read a whole report.
+  static DictCoverage makeDictionary(const std::string& filename, RuntimeOptions::ExportFormatType format)
+  {
+    DictCoverage dict;
+    fold(filename, format, dict);
+    return dict;
+  }
+
+  /// Merge each file of report \p filename into \p dict as it is read: no dictionary of the report is built.
+  static void fold(const std::string& filename, RuntimeOptions::ExportFormatType format, DictCoverage& dict)
+  {
+    const auto mapping = map(filename);
+    try
+    {
+      Reader reader(mapping->view(), SchemaOf(format));
+      std::string key;
+      FileLines file;
+      while (reader.next(key, file))
+      {
+        auto it = dict.find(key);
+        if (it == dict.end())
+        {
+          dict.emplace(key, file);
+        }
+        else
+        {
+          it->second.merge(file);
+        }
+      }
+      dict.sources.insert(reader.sources().cbegin(), reader.sources().cend());
+    }
+    catch (const std::runtime_error& e)
+    {
+      const std::string msg = "Merge failure: " + std::string(e.what()) + " in file: " + filename;
+      throw std::exception(msg.c_str());
+    }
+  }
+
+  /// Merge \p dictOutput into \p dictMerge.
+  static void merge(const DictCoverage& dictOutput, DictCoverage& dictMerge)
+  {
+    for (const auto& [key, file] : dictOutput)
+    {
+      auto it = dictMerge.find(key);
+      if (it == dictMerge.end())
+      {
+        dictMerge.emplace(key, file);
+      }
+      else
+      {
+        it->second.merge(file);
+      }
+    }
+    dictMerge.sources.insert(dictOutput.sources.cbegin(), dictOutput.sources.cend());
+  }
+
+  /// Write \p dict with the layout of FileCallbackInfo.
+  static void write(const DictCoverage& dict, RuntimeOptions::ExportFormatType format, const std::string& packageName, ReportEmitter& out)
+  {
+    size_t nbLines = 0;
+    size_t nbCovered = 0;
+    for (const auto& file : dict)
+    {
+      nbLines += file.second.lines.size();
+      nbCovered += file.second.covered;
+    }
+
+    if (format == RuntimeOptions::Cobertura)
+    {
+      writeCobertura(dict, packageName, double(nbCovered) / double(nbLines), out);
+    }
+    else
+    {
+      writeClover(dict, packageName, nbLines, nbCovered, out);
+    }
+  }
+
+  /// Constructor
+  /// \param[in] opts: application option. Need MergedOutput and OutputFile valid and defined + ExportFormat MUST BE Cobertura or Clover.
+  MergeRunnerXml(const RuntimeOptions& opts) :
+    MergeRunner(opts)
+  {
+    assert(_options.ExportFormat == RuntimeOptions::Cobertura || _options.ExportFormat == RuntimeOptions::Clover); // Support only this !
+  }
+
+  /// Run merge
+  void execute() override
+  {
+    std::filesystem::path outputPath(_options.OutputFile);
+    std::filesystem::path mergedPath(_options.MergedOutput);
+
+    // Check we have data
+    if (!std::filesystem::exists(outputPath))
+    {
+      const std::string msg = "Merge failure: Impossible to find output file: " + _options.OutputFile;
+      throw std::exception(msg.c_str());
+    }
+
+    // Concurrent merges into the same file wait for each other
+    const auto retry = retryPolicy();
+    MergeLock lock(_options.MergedOutput, retry);
+
+    // Nothing to merge = Copy and quit
+    if (!std::filesystem::exists(mergedPath))
+    {
+      MergedFile::Copy(_options.OutputFile, _options.MergedOutput, retry);
+      return;
+    }
+
+    // ---- Make merge ---------------------------------------------------------------
+    // Step 1: Parse merged file, then fold the output into it
+    DictCoverage dictMerge = makeDictionary(_options.MergedOutput, _options.ExportFormat);
+    fold(_options.OutputFile, _options.ExportFormat, dictMerge);
+
+    // Step 2: Write dictionary beside the merged file and replace it
+    MergedFile::Write(_options.MergedOutput, [&](ReportEmitter& out) { write(dictMerge, _options.ExportFormat, _options.PackageName, out); }, std::ios::out, retry);
+  }
+
+private:
+  static void writeCobertura(const DictCoverage& dict, const std::string& packageName, double lineRate, ReportEmitter& out)
+  {
+    out << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+    out << "<coverage line-rate=\"" << lineRate << "\" version=\"\">\n";
+    out << ReportEmitter::Indent(1) << "<packages>\n";
+
+    out << ReportEmitter::Indent(2) << "<package name=\"" << packageName << "\" line-rate=\"" << lineRate << "\">\n";
+    out << ReportEmitter::Indent(3) << "<classes>\n";
+
+    for (const auto& [filename, file] : dict)
+    {
+      std::string_view name = file.name;
+      if (name.empty())
+      {
+        name = filename;
+        auto idx = name.find_last_of('\\');
+        if (idx != std::string_view::npos)
+        {
+          name = name.substr(idx + 1);
+        }
+      }
+
+      out << ReportEmitter::Indent(4) << "<class name=\"" << name << "\" filename=\"" << filename << "\" line-rate=\"" << file.lineRate() << "\">\n";
+      out << ReportEmitter::Indent(5) << "<lines>\n";
+      for (const auto& line : file.lines)
+      {
+        out << ReportEmitter::Indent(6) << "<line number=\"" << line.number << "\" hits=\"" << line.hits << "\"/>\n";
+      }
+      out << ReportEmitter::Indent(5) << "</lines>\n";
+      out << ReportEmitter::Indent(4) << "</class>\n";
+    }
+
+    out << ReportEmitter::Indent(3) << "</classes>\n";
+    out << ReportEmitter::Indent(2) << "</package>\n";
+    out << ReportEmitter::Indent(1) << "</packages>\n";
+    out << ReportEmitter::Indent(1) << "<sources>\n";
+    for (const auto& source : dict.sources)
+    {
+      out << ReportEmitter::Indent(2) << "<source>" << source << "</source>\n";
+    }
+    out << ReportEmitter::Indent(1) << "</sources>\n";
+    out << "</coverage>\n";
+  }
+
+  /// Breakpoint counts are not in the report: loc is the number of lines and ncloc the number of covered lines.
+  static void writeClover(const DictCoverage& dict, const std::string& packageName, size_t nbLines, size_t nbCovered, ReportEmitter& out)
+  {
+    time_t t = time(0);   // get time now
+    out << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+    out << "<clover generated=\"" << t << "\"  clover=\"3.1.5\">\n";
+    out << "<project timestamp=\"" << t << "\">\n";
+    out << "<metrics classes=\"0\" files=\"" << nbLines << "\" packages=\"1\"  loc=\"" << nbLines << "\" ncloc = \"" << nbCovered << "\" ";
+    out << "complexity=\"0\" />\n";
+    out << "<package name=\"" << packageName << "\">\n";
+
+    for (const auto& [filename, file] : dict)
+    {
+      out << "<file name=\"" << filename << "\">\n";
+      for (const auto& line : file.lines)
+      {
+        out << "<line num=\"" << line.number << "\" count=\"" << line.hits << "\" type=\"stmt\"/>\n";
+      }
+      out << "</file>\n";
+    }
+
+    out << "</package>\n"
+           "</project>\n"
+           "</clover>\n";
+  }
+};
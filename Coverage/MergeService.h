@@ -0,0 +1,362 @@
+#pragma once
+
+#include "MergedFile.h"
+#include "MergeRunnerV2.h"
+#include "ReportEmitter.h"
+#include "RuntimeOptions.h"
+#include "Util.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <Windows.h>
+
+/// Long-running NativeV2 merge accumulator: shards send their reports on the named pipe \\.\pipe\<name> and
+/// they are merged in memory, so each merge costs the shard report only. They are folded into MergedOutput on
+/// CHECKPOINT, on STOP and every CheckpointInterval seconds when something was merged. The checkpoint re-reads
+/// MergedOutput under its MergeLock: other processes may merge into it with -m while the service runs.
+///
+/// One request per pipe message, the first line is the command:
+///   MERGE <report path>                              merge a NativeV2 report file
+///   LINES <nbLines>\t<directory>\t<file path>\n<data>  merge nbLines raw uint16 lines (FileCoverageV2 layout)
+///   CHECKPOINT                                       write MergedOutput now
+///   STOP                                             write MergedOutput and stop the service
+/// The answer is "OK ..." or "ERROR <message>".
+class MergeService
+{
+public:
+  static constexpr std::string_view PipePrefix = "\\\\.\\pipe\\";
+  static constexpr DWORD PipeBufferSize = 64 * 1024;
+
+  /// \param[in] opts: application option. Need MergedOutput, ServeChannel + ExportFormat NativeV2.
+  MergeService(const RuntimeOptions& opts) :
+    _options(opts)
+  {
+    assert(!_options.MergedOutput.empty());
+  }
+
+  // Avoid copy constructor
+  MergeService(const MergeService&) = delete;
+
+  /// Serve requests until STOP.
+  void run()
+  {
+    const std::string pipeName = std::string(PipePrefix) + _options.ServeChannel;
+
+    std::thread timer;
+    if (_options.CheckpointInterval > 0)
+    {
+      timer = std::thread([this]() { checkpointLoop(); });
+    }
+
+    if (_options.isAtLeastLevel(VerboseLevel::Info))
+    {
+      std::cout << "Merge service listening on " << pipeName << " into " << _options.MergedOutput << std::endl;
+    }
+
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+    try
+    {
+      pipe = CreatePipeInstance(pipeName);
+      while (!stopped())
+      {
+        if (!ConnectNamedPipe(pipe, NULL) && GetLastError() != ERROR_PIPE_CONNECTED)
+        {
+          DisconnectNamedPipe(pipe);
+          continue;
+        }
+
+        // The pipe always has a free instance: shards connecting while this one is served wait in the next one
+        // instead of failing to find the pipe
+        HANDLE next = CreatePipeInstance(pipeName);
+        std::string request;
+        if (ReadMessage(pipe, request))
+        {
+          const std::string answer = handle(request);
+          WriteMessage(pipe, answer);
+          FlushFileBuffers(pipe);
+        }
+        DisconnectNamedPipe(pipe);
+        CloseHandle(pipe);
+        pipe = next;
+      }
+      CloseHandle(pipe);
+    }
+    catch (...)
+    {
+      if (pipe != INVALID_HANDLE_VALUE)
+      {
+        CloseHandle(pipe);
+      }
+      stop();
+      if (timer.joinable())
+      {
+        timer.join();
+      }
+      throw;
+    }
+
+    if (timer.joinable())
+    {
+      timer.join();
+    }
+  }
+
+  /// Execute one request and return the answer.
+  std::string handle(std::string_view request)
+  {
+    const size_t endLine = request.find('\n');
+    const std::string_view command = request.substr(0, endLine);
+    const std::string_view payload = endLine == std::string_view::npos ? std::string_view() : request.substr(endLine + 1);
+
+    const size_t space = command.find(' ');
+    const std::string_view verb = command.substr(0, space);
+    const std::string_view argument = space == std::string_view::npos ? std::string_view() : command.substr(space + 1);
+
+    try
+    {
+      if (verb == "MERGE")
+      {
+        return mergeReport(std::string(argument));
+      }
+      else if (verb == "LINES")
+      {
+        return mergeLines(argument, payload);
+      }
+      else if (verb == "CHECKPOINT")
+      {
+        checkpoint();
+        return "OK";
+      }
+      else if (verb == "STOP")
+      {
+        checkpoint();
+        stop();
+        return "OK";
+      }
+      return "ERROR Unknown request: " + std::string(verb);
+    }
+    catch (const std::exception& e)
+    {
+      return "ERROR " + std::string(e.what());
+    }
+  }
+
+  /// Merge the requests received since the last checkpoint into MergedOutput, like -m.
+  void checkpoint()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_dirty && std::filesystem::exists(_options.MergedOutput))
+    {
+      return;
+    }
+
+    // The report is read under the lock: merges of other processes with -m since the last checkpoint are kept
+    const auto retry = RetryPolicy::WithTimeout(std::chrono::seconds(_options.MergeLockTimeout));
+    MergeLock mergeLock(_options.MergedOutput, retry);
+    MergeRunnerV2::DictCoverage merged;
+    if (std::filesystem::exists(_options.MergedOutput))
+    {
+      merged = MergeRunnerV2::makeDictionary(_options.MergedOutput);
+    }
+    MergeRunnerV2::merge(_dict, merged);
+    MergedFile::Write(_options.MergedOutput, [&](ReportEmitter& out) { MergeRunnerV2::write(merged, out, _options.CompactLines); }, std::ios::out, retry);
+    _dict.clear();
+    _dirty = false;
+  }
+
+  void stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopped = true;
+    }
+    _wakeUp.notify_all();
+  }
+
+  bool stopped() const
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stopped;
+  }
+
+  /// Requests merged since the last checkpoint.
+  const MergeRunnerV2::DictCoverage& dictionary() const { return _dict; }
+
+  /// Client side: send \p request to the service \p channel and return its answer.
+  /// \param[in] retry: how long to wait for the service to have a free pipe instance (starting service, busy instances).
+  static std::string Send(const std::string& channel, std::string_view request, const RetryPolicy& retry = RetryPolicy())
+  {
+    const std::string pipeName = std::string(PipePrefix) + channel;
+
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+    DWORD error = ERROR_SUCCESS;
+    const bool connected = retry.run([&]()
+    {
+      pipe = CreateFileA(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+      if (pipe != INVALID_HANDLE_VALUE)
+      {
+        return true;
+      }
+      // All instances busy: the service is answering other shards. No pipe: the service is not started yet.
+      error = GetLastError();
+      if (error == ERROR_PIPE_BUSY)
+      {
+        WaitNamedPipeA(pipeName.c_str(), static_cast<DWORD>(retry.maxDelay.count()));
+      }
+      return error != ERROR_PIPE_BUSY && error != ERROR_FILE_NOT_FOUND;
+    });
+    if (!connected || pipe == INVALID_HANDLE_VALUE)
+    {
+      SetLastError(error);
+      throw std::runtime_error("Merge service: Impossible to connect to " + pipeName + " (" + Util::GetLastErrorAsString() + ")");
+    }
+
+    DWORD mode = PIPE_READMODE_MESSAGE;
+    std::string answer;
+    const bool ok = SetNamedPipeHandleState(pipe, &mode, NULL, NULL) && WriteMessage(pipe, request) && ReadMessage(pipe, answer);
+    CloseHandle(pipe);
+    if (!ok)
+    {
+      throw std::runtime_error("Merge service: Communication failure with " + pipeName);
+    }
+    return answer;
+  }
+
+  /// Client side: "LINES" request of a raw line array.
+  static std::string LinesRequest(const std::string& directory, const std::string& path, std::span<const uint16_t> lines)
+  {
+    std::string request = "LINES " + std::to_string(lines.size()) + '\t' + directory + '\t' + path + '\n';
+    const size_t header = request.size();
+    request.resize(header + lines.size_bytes());
+    std::memcpy(request.data() + header, lines.data(), lines.size_bytes());
+    return request;
+  }
+
+private:
+  std::string mergeReport(const std::string& filename)
+  {
+    // Parse without lock: the periodic checkpoints are not delayed by the parse (requests are served one at a time)
+    const auto dictReport = MergeRunnerV2::makeDictionary(filename);
+
+    size_t nbFiles = 0;
+    for (const auto& directory : dictReport)
+    {
+      nbFiles += directory.second.size();
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    MergeRunnerV2::merge(dictReport, _dict);
+    _dirty = true;
+    return "OK " + std::to_string(nbFiles);
+  }
+
+  std::string mergeLines(std::string_view argument, std::string_view payload)
+  {
+    const size_t tab1 = argument.find('\t');
+    const size_t tab2 = tab1 == std::string_view::npos ? std::string_view::npos : argument.find('\t', tab1 + 1);
+    if (tab2 == std::string_view::npos)
+    {
+      throw std::runtime_error("Bad LINES request: expected <nbLines>\\t<directory>\\t<path>");
+    }
+
+    const size_t nbLines = std::stoull(std::string(argument.substr(0, tab1)));
+    const std::string directory(argument.substr(tab1 + 1, tab2 - tab1 - 1));
+    const std::string path(argument.substr(tab2 + 1));
+    if (path.empty() || payload.size() != nbLines * sizeof(uint16_t))
+    {
+      throw std::runtime_error("Bad LINES request for " + path + ": " + std::to_string(payload.size()) + " bytes for " + std::to_string(nbLines) + " lines");
+    }
+
+    FileCoverageV2 coverage(nbLines);
+    std::memcpy(coverage._code.data(), payload.data(), payload.size());
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& files = _dict[directory];
+    auto it = files.find(path);
+    if (it == files.end())
+    {
+      coverage._nbLinesCode = std::count_if(coverage._code.begin(), coverage._code.end(),
+                                            [](uint16_t line) { return (line & FileCoverageV2::maskIsCode) != 0; });
+      coverage.updateStats();
+      files.emplace(path, std::move(coverage));
+    }
+    else if (!it->second.merge(coverage))
+    {
+      throw std::runtime_error("Impossible to merge " + path + ": size between src/dst is not same.");
+    }
+    _dirty = true;
+    return "OK 1";
+  }
+
+  void checkpointLoop()
+  {
+    const auto interval = std::chrono::seconds(_options.CheckpointInterval);
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_wakeUp.wait_for(lock, interval, [this]() { return _stopped; }))
+    {
+      lock.unlock();
+      try
+      {
+        checkpoint();
+      }
+      catch (const std::exception& e)
+      {
+        std::cerr << "Merge service: checkpoint failure: " << e.what() << std::endl;
+      }
+      lock.lock();
+    }
+  }
+
+  static HANDLE CreatePipeInstance(const std::string& pipeName)
+  {
+    HANDLE pipe = CreateNamedPipeA(pipeName.c_str(), PIPE_ACCESS_DUPLEX, PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT,
+                                   PIPE_UNLIMITED_INSTANCES, PipeBufferSize, PipeBufferSize, 0, NULL);
+    if (pipe == INVALID_HANDLE_VALUE)
+    {
+      throw std::runtime_error("Merge service: Impossible to create pipe " + pipeName + " (" + Util::GetLastErrorAsString() + ")");
+    }
+    return pipe;
+  }
+
+  static bool ReadMessage(HANDLE pipe, std::string& message)
+  {
+    message.clear();
+    char buffer[PipeBufferSize];
+    for (;;)
+    {
+      DWORD read = 0;
+      const BOOL ok = ReadFile(pipe, buffer, sizeof(buffer), &read, NULL);
+      message.append(buffer, read);
+      if (ok)
+      {
+        return true;
+      }
+      if (GetLastError() != ERROR_MORE_DATA)
+      {
+        return false;
+      }
+    }
+  }
+
+  static bool WriteMessage(HANDLE pipe, std::string_view message)
+  {
+    DWORD written = 0;
+    return WriteFile(pipe, message.data(), static_cast<DWORD>(message.size()), &written, NULL) && written == message.size();
+  }
+
+  RuntimeOptions _options;    ///< Copy local of option.
+  MergeRunnerV2::DictCoverage _dict;   ///< Merged since the last checkpoint
+  mutable std::mutex _mutex;
+  std::condition_variable _wakeUp;
+  bool _dirty = false;
+  bool _stopped = false;
+};
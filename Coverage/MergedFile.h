@@ -0,0 +1,219 @@
+#pragma once
+
+#include "ReportEmitter.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <Windows.h>
+
+/// Wait policy of concurrent merges: exponential backoff with jitter until a timeout.
+struct RetryPolicy
+{
+  std::chrono::milliseconds initialDelay{ 10 };
+  std::chrono::milliseconds maxDelay{ 1000 };
+  std::chrono::milliseconds timeout{ 300000 };
+
+  static RetryPolicy WithTimeout(std::chrono::seconds seconds)
+  {
+    RetryPolicy policy;
+    policy.timeout = seconds;
+    return policy;
+  }
+
+  /// Call \p attempt until it returns true. Returns false on timeout.
+  template <typename Attempt>
+  bool run(Attempt&& attempt) const
+  {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::minstd_rand random(static_cast<unsigned>(GetCurrentProcessId()));
+    auto delay = initialDelay;
+    for (;;)
+    {
+      if (attempt())
+      {
+        return true;
+      }
+
+      const auto now = std::chrono::steady_clock::now();
+      if (now >= deadline)
+      {
+        return false;
+      }
+
+      // Jitter: processes started together do not retry together
+      const auto sleep = std::chrono::milliseconds(delay.count() / 2 + random() % (delay.count() / 2 + 1));
+      std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(sleep, deadline - now));
+      delay = std::min(delay * 2, maxDelay);
+    }
+  }
+};
+
+/// Exclusive advisory lock of a merged report for a whole read-merge-replace. The lock is taken on
+/// "<report>.lock" because the report itself is replaced by the merge.
+class MergeLock
+{
+public:
+  MergeLock(const std::string& report, const RetryPolicy& retry = RetryPolicy()) :
+    _filename(report + ".lock")
+  {
+    const bool locked = retry.run([&]()
+    {
+      if (_file == INVALID_HANDLE_VALUE)
+      {
+        _file = CreateFileA(_filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (_file == INVALID_HANDLE_VALUE)
+        {
+          return false;
+        }
+      }
+
+      OVERLAPPED overlapped = {};
+      return LockFileEx(_file, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, MAXDWORD, MAXDWORD, &overlapped) != FALSE;
+    });
+
+    if (!locked)
+    {
+      const std::string error = Util::GetLastErrorAsString();
+      close();
+      throw std::runtime_error("Merge failure: Impossible to lock " + _filename + " (" + error + ")");
+    }
+  }
+
+  // Avoid copy constructor
+  MergeLock(const MergeLock&) = delete;
+  MergeLock& operator=(const MergeLock&) = delete;
+
+  ~MergeLock()
+  {
+    if (_file != INVALID_HANDLE_VALUE)
+    {
+      OVERLAPPED overlapped = {};
+      UnlockFileEx(_file, 0, MAXDWORD, MAXDWORD, &overlapped);
+    }
+    // The lock file is kept: removing it would let a waiting process lock a file nobody else sees
+    close();
+  }
+
+private:
+  void close()
+  {
+    if (_file != INVALID_HANDLE_VALUE)
+    {
+      CloseHandle(_file);
+      _file = INVALID_HANDLE_VALUE;
+    }
+  }
+
+  std::string _filename;
+  HANDLE _file = INVALID_HANDLE_VALUE;
+};
+
+/// Crash and reader safe replace of a report: write a temporary file beside it, flush it to disk and
+/// rename it over the report. Readers see either the old or the new report, never a partial one.
+struct MergedFile
+{
+  /// Temporary name beside \p target, unique per process.
+  static std::string TempName(const std::string& target)
+  {
+    return target + "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+  }
+
+  /// Write \p target with \p write(ReportEmitter&).
+  template <typename Writer>
+  static void Write(const std::string& target, Writer&& write, std::ios::openmode mode = std::ios::out, const RetryPolicy& retry = RetryPolicy())
+  {
+    const std::string tmpOutput = TempName(target);
+    WriteTemp(tmpOutput, write, mode);
+    Commit(tmpOutput, target, retry);
+  }
+
+  /// First half of Write: write \p tmpOutput (removed on failure), to Commit once inputs mapping the target are closed.
+  template <typename Writer>
+  static void WriteTemp(const std::string& tmpOutput, Writer&& write, std::ios::openmode mode = std::ios::out)
+  {
+    try
+    {
+      std::ofstream ofs;
+      ReportEmitter::OpenUnbuffered(ofs, tmpOutput, mode);
+      if (!ofs.is_open())
+      {
+        throw std::runtime_error("Merge failure: Impossible to write file: " + tmpOutput);
+      }
+      {
+        ReportEmitter out(ofs);
+        write(out);
+      }
+      ofs.close();
+      if (ofs.fail())
+      {
+        throw std::runtime_error("Merge failure: Impossible to write file: " + tmpOutput);
+      }
+    }
+    catch (...)
+    {
+      std::error_code ignored;
+      std::filesystem::remove(tmpOutput, ignored);
+      throw;
+    }
+  }
+
+  /// Copy \p source as \p target.
+  static void Copy(const std::string& source, const std::string& target, const RetryPolicy& retry = RetryPolicy())
+  {
+    const std::string tmpOutput = TempName(target);
+    try
+    {
+      std::filesystem::copy_file(source, tmpOutput, std::filesystem::copy_options::overwrite_existing);
+    }
+    catch (...)
+    {
+      std::error_code ignored;
+      std::filesystem::remove(tmpOutput, ignored);
+      throw;
+    }
+    Commit(tmpOutput, target, retry);
+  }
+
+  /// Flush \p tmpOutput to disk and rename it over \p target. Rename is retried while readers hold the target open.
+  /// \p tmpOutput is removed on failure.
+  static void Commit(const std::string& tmpOutput, const std::string& target, const RetryPolicy& retry = RetryPolicy())
+  {
+    try
+    {
+      HANDLE file = CreateFileA(tmpOutput.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+      if (file == INVALID_HANDLE_VALUE)
+      {
+        throw std::runtime_error("Merge failure: Impossible to open file: " + tmpOutput + " (" + Util::GetLastErrorAsString() + ")");
+      }
+      const bool flushed = FlushFileBuffers(file) != FALSE;
+      CloseHandle(file);
+      if (!flushed)
+      {
+        throw std::runtime_error("Merge failure: Impossible to flush file: " + tmpOutput + " (" + Util::GetLastErrorAsString() + ")");
+      }
+
+      const bool renamed = retry.run([&]()
+      {
+        return MoveFileExA(tmpOutput.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+      });
+      if (!renamed)
+      {
+        throw std::runtime_error("Merge failure: Impossible to replace file: " + target + " (" + Util::GetLastErrorAsString() + ")");
+      }
+    }
+    catch (...)
+    {
+      std::error_code ignored;
+      std::filesystem::remove(tmpOutput, ignored);
+      throw;
+    }
+  }
+};
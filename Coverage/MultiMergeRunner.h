@@ -0,0 +1,254 @@
+#pragma once
+
+#include "MergeRunnerV1.h"
+#include "MergeRunnerV2.h"
+#include "MergeRunnerXml.h"
+#include "MergedFile.h"
+#include "ParallelRenderer.h"
+#include "ReportEmitter.h"
+#include "RuntimeOptions.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// Merge many Native/NativeV2/Cobertura/Clover reports in one run: inputs are parsed concurrently, each worker folds its
+/// reports into its own dictionary, the worker dictionaries are reduced pairwise and the result is written once.
+/// Peak memory is about (workers + 1) x the union of files, whatever the number of inputs.
+class MultiMergeRunner
+{
+public:
+  /// \param[in] opts: application option. Need MergeInputs and MergedOutput + ExportFormat Native, NativeV2, Cobertura or Clover.
+  MultiMergeRunner(const RuntimeOptions& opts) :
+    _options(opts)
+  {
+    assert(!_options.MergedOutput.empty());
+  }
+
+  // Avoid copy constructor
+  MultiMergeRunner(const MultiMergeRunner&) = delete;
+
+  /// Run merge
+  void execute()
+  {
+    auto inputs = ExcludeOutput(ExpandInputs(_options.MergeInputs), _options.MergedOutput);
+
+    // Concurrent merges into the same file wait for each other
+    const auto retry = RetryPolicy::WithTimeout(std::chrono::seconds(_options.MergeLockTimeout));
+    MergeLock lock(_options.MergedOutput, retry);
+
+    // Merge into an existing result, like -m
+    if (std::filesystem::exists(_options.MergedOutput))
+    {
+      inputs.push_back(_options.MergedOutput);
+    }
+    if (inputs.empty())
+    {
+      throw std::exception("Merge failure: No input file to merge.");
+    }
+
+    if (_options.isAtLeastLevel(VerboseLevel::Info))
+    {
+      std::cout << "Merge " << inputs.size() << " files into " << _options.MergedOutput << std::endl;
+    }
+
+    ParallelRenderer renderer(std::min<size_t>(ParallelRenderer::DefaultWorkers(), inputs.size()));
+    switch (_options.ExportFormat)
+    {
+      case RuntimeOptions::Native:
+      {
+        const auto dict = MergeAll<MergeRunnerV1>(renderer, inputs.size(), [&](size_t index) { return MergeRunnerV1::makeDictionary(inputs[index]); });
+        MergedFile::Write(_options.MergedOutput, [&](ReportEmitter& out) { MergeRunnerV1::write(dict, out); }, std::ios::out, retry);
+        break;
+      }
+      case RuntimeOptions::NativeV2:
+      {
+        const auto dict = MergeAll<MergeRunnerV2>(renderer, inputs.size(), [&](size_t index) { return MergeRunnerV2::makeDictionary(inputs[index]); });
+        MergedFile::Write(_options.MergedOutput, [&](ReportEmitter& out) { MergeRunnerV2::write(dict, out, _options.CompactLines); }, std::ios::out, retry);
+        break;
+      }
+      case RuntimeOptions::Cobertura:
+      case RuntimeOptions::Clover:
+      {
+        const auto format = _options.ExportFormat;
+        const auto dict = MergeAll<MergeRunnerXml>(renderer, inputs.size(), [&](size_t index) { return MergeRunnerXml::makeDictionary(inputs[index], format); });
+        MergedFile::Write(_options.MergedOutput, [&](ReportEmitter& out) { MergeRunnerXml::write(dict, format, _options.PackageName, out); }, std::ios::out, retry);
+        break;
+      }
+      default:
+        throw std::exception("Merge of several files is only for Native, NativeV2, Cobertura or Clover mode.");
+    }
+  }
+
+  /// Load \p count reports with \p load(index) on all workers and merge them with Runner::merge.
+  template <typename Runner, typename Load>
+  static typename Runner::DictCoverage MergeAll(ParallelRenderer& renderer, size_t count, Load&& load)
+  {
+    // Step 1: each worker folds the reports it parses
+    std::vector<typename Runner::DictCoverage> partial(renderer.workers());
+    renderer.forEach(count, [&](size_t worker, size_t index)
+    {
+      auto dict = load(index);
+      auto& accumulator = partial[worker];
+      if (accumulator.empty())
+      {
+        accumulator = std::move(dict);
+      }
+      else
+      {
+        Runner::merge(dict, accumulator);
+      }
+    });
+
+    // Step 2: tree reduction of worker dictionaries
+    for (size_t step = 1; step < partial.size(); step *= 2)
+    {
+      const size_t nbPairs = (partial.size() + 2 * step - 1) / (2 * step);
+      renderer.forEach(nbPairs, [&](size_t, size_t pair)
+      {
+        const size_t dst = pair * 2 * step;
+        const size_t src = dst + step;
+        if (src < partial.size())
+        {
+          Runner::merge(partial[src], partial[dst]);
+          partial[src] = {};
+        }
+      });
+    }
+    return std::move(partial.front());
+  }
+
+  /// Expand inputs: plain paths, wildcards ('*', '?') in the file name part or "@list" files with one input per line.
+  /// Result is sorted and without duplicates.
+  static std::vector<std::string> ExpandInputs(const std::list<std::string>& inputs)
+  {
+    std::vector<std::string> files;
+    for (const auto& input : inputs)
+    {
+      if (input.starts_with("@"))
+      {
+        std::ifstream list(input.substr(1));
+        if (!list.is_open())
+        {
+          const std::string msg = "Merge failure: Impossible to open list file: " + input.substr(1);
+          throw std::exception(msg.c_str());
+        }
+
+        std::list<std::string> listed;
+        std::string line;
+        while (std::getline(list, line))
+        {
+          const auto begin = line.find_first_not_of(" \t\r");
+          if (begin != std::string::npos)
+          {
+            listed.push_back(line.substr(begin, line.find_last_not_of(" \t\r") + 1 - begin));
+          }
+        }
+        const auto expanded = ExpandInputs(listed);
+        files.insert(files.end(), expanded.begin(), expanded.end());
+      }
+      else if (input.find_first_of("*?") != std::string::npos)
+      {
+        const std::filesystem::path pattern(input);
+        const auto directory = pattern.has_parent_path() ? pattern.parent_path() : std::filesystem::path(".");
+        const auto name = pattern.filename().string();
+        if (!std::filesystem::is_directory(directory))
+        {
+          const std::string msg = "Merge failure: Impossible to find directory: " + directory.string();
+          throw std::exception(msg.c_str());
+        }
+
+        for (const auto& entry : std::filesystem::directory_iterator(directory))
+        {
+          if (entry.is_regular_file() && MatchWildcard(name, entry.path().filename().string()))
+          {
+            files.push_back(entry.path().string());
+          }
+        }
+      }
+      else
+      {
+        if (!std::filesystem::exists(input))
+        {
+          const std::string msg = "Merge failure: Impossible to find input file: " + input;
+          throw std::exception(msg.c_str());
+        }
+        files.push_back(input);
+      }
+    }
+
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return files;
+  }
+
+  /// Remove \p output, its lock and the temporary files of its merges from \p inputs: wildcards over the output
+  /// directory match them, and the existing output is merged once by execute.
+  static std::vector<std::string> ExcludeOutput(std::vector<std::string> inputs, const std::string& output)
+  {
+    const std::filesystem::path outputPath(output);
+    const auto outputDirectory = outputPath.has_parent_path() ? outputPath.parent_path() : std::filesystem::path(".");
+    const auto outputName = outputPath.filename().string();
+
+    std::erase_if(inputs, [&](const std::string& input)
+    {
+      std::error_code error;
+      const std::filesystem::path path(input);
+      if (std::filesystem::equivalent(path, outputPath, error))
+      {
+        return true;
+      }
+
+      // "<output>.lock" and "<output>.<pid>.tmp"
+      const auto directory = path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+      const auto name = path.filename().string();
+      return std::filesystem::equivalent(directory, outputDirectory, error) &&
+             (MatchWildcard(outputName + ".lock", name) || MatchWildcard(outputName + ".*.tmp", name));
+    });
+    return inputs;
+  }
+
+  /// Case insensitive match of \p name against \p pattern with '*' (any sequence) and '?' (any character).
+  static bool MatchWildcard(std::string_view pattern, std::string_view name)
+  {
+    size_t p = 0;
+    size_t n = 0;
+    size_t star = std::string_view::npos;
+    size_t resume = 0;
+    while (n < name.size())
+    {
+      if (p < pattern.size() && (pattern[p] == '?' || std::tolower(static_cast<unsigned char>(pattern[p])) == std::tolower(static_cast<unsigned char>(name[n]))))
+      {
+        ++p;
+        ++n;
+      }
+      else if (p < pattern.size() && pattern[p] == '*')
+      {
+        // Try to match nothing first, come back here on mismatch
+        star = p++;
+        resume = n;
+      }
+      else if (star != std::string_view::npos)
+      {
+        p = star + 1;
+        n = ++resume;
+      }
+      else
+      {
+        return false;
+      }
+    }
+    while (p < pattern.size() && pattern[p] == '*')
+    {
+      ++p;
+    }
+    return p == pattern.size();
+  }
+
+private:
+  RuntimeOptions _options;    ///< Copy local of option.
+};
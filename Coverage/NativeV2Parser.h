@@ -0,0 +1,181 @@
+#pragma once
+
+#include "CompactLines.h"
+#include "FastBase64.h"
+#include "FileCoverageV2.h"
+#include "XmlScanner.h"
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/// Single pass scanner over a whole NativeV2 report (usually a memory mapping).
+/// Only the elements written by FileCoverageV2 are recognized: <CppCoverage>, <directory>, <file>, <stats>, <coverage>
+/// and <profile>.
+/// Attribute values are views into the content: nothing is copied until the caller decides to keep it.
+class NativeV2Parser
+{
+public:
+  /// One <file> element. Views are valid as long as the parsed content.
+  struct FileElement
+  {
+    std::string_view directory;     ///< Enclosing <directory> path, empty outside any directory
+    std::string_view path;
+    std::string_view md5;
+    size_t nbLinesFile = 0;
+    size_t nbLinesCode = 0;
+    size_t nbLinesCovered = 0;
+    std::string_view encoding;      ///< CompactLines encoding name, empty for raw lines
+    std::string_view coverage;      ///< Base64 payload
+    std::string_view samples;       ///< Base64 <profile> payload, empty when the file was not profiled
+
+    /// Decode the payload straight into \p profile line array, with stats and md5.
+    /// Throws std::runtime_error on invalid payload.
+    void decode(FileCoverageV2& profile) const
+    {
+      const auto lineEncoding = CompactLines::FromName(encoding);
+      const size_t size = FastBase64::DecodedLength(coverage);
+
+      if (lineEncoding == CompactLines::Encoding::Raw)
+      {
+        if (size % sizeof(FileCoverageV2::LineArray::value_type) != 0)
+        {
+          throw std::runtime_error("Coverage data size is not a multiple of line size");
+        }
+        profile._code.resize(size / sizeof(FileCoverageV2::LineArray::value_type));
+        FastBase64::Decode(coverage, reinterpret_cast<uint8_t*>(profile._code.data()));
+      }
+      else
+      {
+        thread_local std::string data;
+        data.resize(size);
+        FastBase64::Decode(coverage, reinterpret_cast<uint8_t*>(data.data()));
+        CompactLines::Decode(data, lineEncoding, profile._code);
+      }
+
+      profile._samples.clear();
+      if (!samples.empty())
+      {
+        thread_local std::string data;
+        data.resize(FastBase64::DecodedLength(samples));
+        FastBase64::Decode(samples, reinterpret_cast<uint8_t*>(data.data()));
+        profile.decodeSamples(data);
+      }
+
+      profile._nbLinesFile = nbLinesFile;
+      profile._nbLinesCode = nbLinesCode;
+      profile._nbLinesCovered = nbLinesCovered;
+      profile.md5Code = md5;
+    }
+  };
+
+  explicit NativeV2Parser(std::string_view content) :
+    _scanner(content, "NativeV2")
+  {}
+
+  /// Read the <CppCoverage> header (done by next() when not called before).
+  /// Throws std::runtime_error on unsupported version.
+  void header()
+  {
+    if (_header)
+    {
+      return;
+    }
+
+    std::string_view tag;
+    while (_scanner.nextTag(tag))
+    {
+      if (XmlScanner::tagName(tag) == "CppCoverage")
+      {
+        const auto version = _scanner.attribute(tag, "version");
+        if (version != FileCoverageV2::Version && version != FileCoverageV2::CompactVersion)
+        {
+          throw std::runtime_error("Unsupported NativeV2 version " + std::string(version));
+        }
+        _sorted = _scanner.attribute(tag, "layout") == FileCoverageV2::SortedLayout;
+        break;
+      }
+    }
+    _header = true;
+  }
+
+  /// True when the header declares the canonical order of FileCoverageV2::CanonicalLess.
+  bool sorted()
+  {
+    header();
+    return _sorted;
+  }
+
+  /// Read the next <file> element, in document order. Returns false at the end of the report.
+  /// Throws std::runtime_error on unsupported version or broken structure.
+  bool next(FileElement& file)
+  {
+    header();
+
+    bool inFile = false;
+    std::string_view tag;
+    while (_scanner.nextTag(tag))
+    {
+      if (XmlScanner::isDeclaration(tag))
+      {
+        continue;
+      }
+
+      const auto name = XmlScanner::tagName(tag);
+      if (name == "directory")
+      {
+        _directory = _scanner.attribute(tag, "path");
+      }
+      else if (name == "/directory")
+      {
+        _directory = {};
+      }
+      else if (name == "file")
+      {
+        file = FileElement();
+        file.directory = _directory;
+        file.path = _scanner.attribute(tag, "path");
+        file.md5 = _scanner.attribute(tag, "md5");
+        inFile = true;
+      }
+      else if (name == "stats" && inFile)
+      {
+        file.nbLinesFile = _scanner.number(_scanner.attribute(tag, "nbLinesInFile"));
+        file.nbLinesCode = _scanner.number(_scanner.attribute(tag, "nbLinesOfCode"));
+        file.nbLinesCovered = _scanner.number(_scanner.attribute(tag, "nbLinesCovered"));
+      }
+      else if (name == "coverage" && inFile)
+      {
+        file.encoding = _scanner.attribute(tag, "encoding");
+        file.coverage = _scanner.text();
+      }
+      else if (name == "profile" && inFile)
+      {
+        file.samples = _scanner.text();
+      }
+      else if (name == "/file" && inFile)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Call \p onFile(const FileElement&) for each <file> element, in document order.
+  /// Throws std::runtime_error on unsupported version or broken structure.
+  template <typename OnFile>
+  void parse(OnFile&& onFile)
+  {
+    FileElement file;
+    while (next(file))
+    {
+      onFile(static_cast<const FileElement&>(file));
+    }
+  }
+
+private:
+  XmlScanner _scanner;
+  std::string_view _directory;
+  bool _header = false;
+  bool _sorted = false;
+};
@@ -0,0 +1,397 @@
+#pragma once
+
+#include "FileCoverageV2.h"
+#include "MappedFile.h"
+#include "ReportEmitter.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// Binary coverage format, designed to be memory mapped.
+///
+/// Layout (little endian, native structures):
+/// | Header | DirectoryEntry[nbDirectories] | FileEntry[nbFiles] | string table | line arrays | profiles |
+///
+/// Directories are sorted by path, files are sorted by (directory, path): any file can be found
+/// by binary search without reading the rest of the report. Line arrays use the NativeV2 encoding
+/// (see FileCoverageV2) and are aligned on LinesAlignment bytes, so they can be used in place.
+/// Profiles are the sample counts of the profiled files, in the NativeV2 <profile> encoding.
+namespace NativeV3
+{
+  static constexpr std::array<char, 8> Magic = { 'C', 'P', 'P', 'C', 'O', 'V', '3', '\0' };
+  static constexpr uint32_t Version = 4;
+  static constexpr size_t LinesAlignment = 64;
+  static constexpr size_t Md5Size = 32;
+
+  struct StringRef
+  {
+    uint32_t offset;  ///< Offset into the string table
+    uint32_t size;
+  };
+
+  struct Header
+  {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t nbDirectories;
+    uint32_t nbFiles;
+    uint64_t directoriesOffset;
+    uint64_t filesOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t fileSize;
+  };
+  static_assert(sizeof(Header) == 64);
+
+  struct DirectoryEntry
+  {
+    StringRef path;       ///< Empty for files outside any directory
+    uint32_t firstFile;
+    uint32_t nbFiles;
+  };
+  static_assert(sizeof(DirectoryEntry) == 16);
+
+  struct FileEntry
+  {
+    StringRef path;
+    uint32_t directory;   ///< Index of DirectoryEntry
+    uint32_t nbLines;     ///< Size of line array
+    uint64_t nbLinesFile;
+    uint64_t nbLinesCode;
+    uint64_t nbLinesCovered;
+    uint64_t linesOffset; ///< Offset from begin of file, aligned on LinesAlignment
+    std::array<char, Md5Size> md5;
+    uint64_t samplesOffset; ///< Offset from begin of file of the profile (see FileCoverageV2::encodeSamples)
+    uint64_t samplesSize;   ///< 0 when the file has no samples
+  };
+  static_assert(sizeof(FileEntry) == 96);
+
+  /// Check if the content starts as a NativeV3 report.
+  inline bool IsNativeV3(std::string_view content)
+  {
+    return content.size() >= Magic.size() && std::memcmp(content.data(), Magic.data(), Magic.size()) == 0;
+  }
+
+  /// Build a report: add() every file then write() once.
+  class Writer
+  {
+  public:
+    /// Add a file. Line array is NOT copied: it must stay valid until write().
+    void add(std::string_view directory, std::string_view path, const FileCoverageV2& coverage)
+    {
+      std::string samples;
+      if (coverage.hasSamples())
+      {
+        coverage.encodeSamples(samples);
+      }
+      add(directory, path, coverage._nbLinesFile, coverage._nbLinesCode, coverage._nbLinesCovered, coverage.md5Code,
+          std::span<const uint16_t>(coverage._code.data(), coverage._code.size()), samples);
+    }
+
+    /// \param[in] samples: encoded profile (see FileCoverageV2::encodeSamples), empty without samples. Copied.
+    void add(std::string_view directory, std::string_view path, uint64_t nbLinesFile, uint64_t nbLinesCode, uint64_t nbLinesCovered,
+             std::string_view md5, std::span<const uint16_t> lines, std::string_view samples = {})
+    {
+      Item item;
+      item.directory = directory;
+      item.path = path;
+      item.nbLinesFile = nbLinesFile;
+      item.nbLinesCode = nbLinesCode;
+      item.nbLinesCovered = nbLinesCovered;
+      item.md5.fill('\0');
+      std::memcpy(item.md5.data(), md5.data(), std::min<size_t>(md5.size(), Md5Size));
+      item.lines = lines;
+      item.samples = samples;
+      _items.push_back(std::move(item));
+    }
+
+    size_t size() const { return _items.size(); }
+
+    void write(ReportEmitter& out)
+    {
+      std::sort(_items.begin(), _items.end(), [](const Item& lhs, const Item& rhs)
+      {
+        return lhs.directory != rhs.directory ? lhs.directory < rhs.directory : lhs.path < rhs.path;
+      });
+
+      // Build tables
+      std::vector<DirectoryEntry> directories;
+      std::vector<FileEntry> files;
+      files.reserve(_items.size());
+
+      std::string strings;
+      std::unordered_map<std::string_view, StringRef> interned;
+      const auto intern = [&](const std::string& value) -> StringRef
+      {
+        auto it = interned.find(value);
+        if (it != interned.end())
+        {
+          return it->second;
+        }
+        StringRef ref{ static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(value.size()) };
+        strings += value;
+        interned.emplace(value, ref); // Items are not modified anymore: view stays valid
+        return ref;
+      };
+
+      for (const auto& item : _items)
+      {
+        if (directories.empty() || directoryName(directories.back(), strings) != item.directory)
+        {
+          directories.push_back(DirectoryEntry{ intern(item.directory), static_cast<uint32_t>(files.size()), 0 });
+        }
+        directories.back().nbFiles++;
+
+        FileEntry entry{};
+        entry.path = intern(item.path);
+        entry.directory = static_cast<uint32_t>(directories.size() - 1);
+        entry.nbLines = static_cast<uint32_t>(item.lines.size());
+        entry.nbLinesFile = item.nbLinesFile;
+        entry.nbLinesCode = item.nbLinesCode;
+        entry.nbLinesCovered = item.nbLinesCovered;
+        entry.md5 = item.md5;
+        files.push_back(entry);
+      }
+
+      // Compute offsets
+      Header header{};
+      header.magic = Magic;
+      header.version = Version;
+      header.nbDirectories = static_cast<uint32_t>(directories.size());
+      header.nbFiles = static_cast<uint32_t>(files.size());
+      header.directoriesOffset = sizeof(Header);
+      header.filesOffset = header.directoriesOffset + directories.size() * sizeof(DirectoryEntry);
+      header.stringsOffset = header.filesOffset + files.size() * sizeof(FileEntry);
+      header.stringsSize = strings.size();
+
+      uint64_t offset = header.stringsOffset + header.stringsSize;
+      for (size_t i = 0; i < files.size(); ++i)
+      {
+        offset = align(offset);
+        files[i].linesOffset = offset;
+        offset += files[i].nbLines * sizeof(uint16_t);
+      }
+      for (size_t i = 0; i < files.size(); ++i)
+      {
+        if (!_items[i].samples.empty())
+        {
+          files[i].samplesOffset = offset;
+          files[i].samplesSize = _items[i].samples.size();
+          offset += files[i].samplesSize;
+        }
+      }
+      header.fileSize = offset;
+
+      // Write everything
+      out << bytes(&header, sizeof(header));
+      out << bytes(directories.data(), directories.size() * sizeof(DirectoryEntry));
+      out << bytes(files.data(), files.size() * sizeof(FileEntry));
+      out << std::string_view(strings);
+
+      offset = header.stringsOffset + header.stringsSize;
+      for (size_t i = 0; i < files.size(); ++i)
+      {
+        static constexpr char Padding[LinesAlignment] = {};
+        out << std::string_view(Padding, files[i].linesOffset - offset);
+        out << bytes(_items[i].lines.data(), _items[i].lines.size() * sizeof(uint16_t));
+        offset = files[i].linesOffset + files[i].nbLines * sizeof(uint16_t);
+      }
+      for (const auto& item : _items)
+      {
+        out << std::string_view(item.samples);
+      }
+    }
+
+  private:
+    struct Item
+    {
+      std::string directory;
+      std::string path;
+      uint64_t nbLinesFile;
+      uint64_t nbLinesCode;
+      uint64_t nbLinesCovered;
+      std::array<char, Md5Size> md5;
+      std::span<const uint16_t> lines;
+      std::string samples;
+    };
+
+    static uint64_t align(uint64_t offset)
+    {
+      return (offset + LinesAlignment - 1) & ~uint64_t(LinesAlignment - 1);
+    }
+
+    static std::string_view bytes(const void* data, size_t size)
+    {
+      return std::string_view(static_cast<const char*>(data), size);
+    }
+
+    static std::string_view directoryName(const DirectoryEntry& entry, const std::string& strings)
+    {
+      return std::string_view(strings).substr(entry.path.offset, entry.path.size);
+    }
+
+    std::vector<Item> _items;
+  };
+
+  /// Random access to a report, without decoding anything that is not requested.
+  class Reader
+  {
+  public:
+    /// Map the given file.
+    explicit Reader(const std::string& filename) :
+      _mapping(std::make_unique<MappedFile>(filename))
+    {
+      open(_mapping->view(), filename);
+    }
+
+    /// Use a report already in memory (must be 8 bytes aligned and outlive the reader).
+    explicit Reader(std::string_view content)
+    {
+      open(content, "<memory>");
+    }
+
+    // Avoid copy constructor
+    Reader(const Reader&) = delete;
+
+    std::span<const DirectoryEntry> directories() const
+    {
+      return std::span<const DirectoryEntry>(reinterpret_cast<const DirectoryEntry*>(_content.data() + _header->directoriesOffset), _header->nbDirectories);
+    }
+
+    std::span<const FileEntry> files() const
+    {
+      return std::span<const FileEntry>(reinterpret_cast<const FileEntry*>(_content.data() + _header->filesOffset), _header->nbFiles);
+    }
+
+    std::span<const FileEntry> files(const DirectoryEntry& directory) const
+    {
+      if (size_t(directory.firstFile) + directory.nbFiles > _header->nbFiles)
+      {
+        throw std::runtime_error("Corrupted NativeV3 report: bad directory entry.");
+      }
+      return files().subspan(directory.firstFile, directory.nbFiles);
+    }
+
+    std::string_view string(const StringRef& ref) const
+    {
+      if (uint64_t(ref.offset) + ref.size > _header->stringsSize)
+      {
+        throw std::runtime_error("Corrupted NativeV3 report: bad string reference.");
+      }
+      return _content.substr(_header->stringsOffset + ref.offset, ref.size);
+    }
+
+    std::string_view md5(const FileEntry& entry) const
+    {
+      const std::string_view md5(entry.md5.data(), entry.md5.size());
+      return md5.substr(0, md5.find('\0'));
+    }
+
+    /// Line array used in place (NativeV2 encoding).
+    std::span<const uint16_t> lines(const FileEntry& entry) const
+    {
+      if (entry.linesOffset % alignof(uint16_t) != 0 || entry.linesOffset + uint64_t(entry.nbLines) * sizeof(uint16_t) > _content.size())
+      {
+        throw std::runtime_error("Corrupted NativeV3 report: bad line array.");
+      }
+      return std::span<const uint16_t>(reinterpret_cast<const uint16_t*>(_content.data() + entry.linesOffset), entry.nbLines);
+    }
+
+    /// Encoded profile of the file (see FileCoverageV2::encodeSamples), empty without samples.
+    std::string_view samples(const FileEntry& entry) const
+    {
+      if (entry.samplesOffset + entry.samplesSize > _content.size())
+      {
+        throw std::runtime_error("Corrupted NativeV3 report: bad profile.");
+      }
+      return _content.substr(entry.samplesOffset, entry.samplesSize);
+    }
+
+    /// Find a file in O(log n). Return nullptr when unknown.
+    const FileEntry* find(std::string_view directory, std::string_view path) const
+    {
+      const auto dirs = directories();
+      auto dir = std::lower_bound(dirs.begin(), dirs.end(), directory, [&](const DirectoryEntry& entry, std::string_view value)
+      {
+        return string(entry.path) < value;
+      });
+      if (dir == dirs.end() || string(dir->path) != directory)
+      {
+        return nullptr;
+      }
+
+      const auto entries = files(*dir);
+      auto file = std::lower_bound(entries.begin(), entries.end(), path, [&](const FileEntry& entry, std::string_view value)
+      {
+        return string(entry.path) < value;
+      });
+      if (file == entries.end() || string(file->path) != path)
+      {
+        return nullptr;
+      }
+      return &*file;
+    }
+
+    /// Decode one file into an editable coverage.
+    FileCoverageV2 coverage(const FileEntry& entry) const
+    {
+      const auto data = lines(entry);
+      FileCoverageV2 result(0);
+      result._code.assign(data.begin(), data.end());
+      result._nbLinesFile = static_cast<size_t>(entry.nbLinesFile);
+      result._nbLinesCode = static_cast<size_t>(entry.nbLinesCode);
+      result._nbLinesCovered = static_cast<size_t>(entry.nbLinesCovered);
+      result.md5Code = md5(entry);
+      if (entry.samplesSize != 0)
+      {
+        result.decodeSamples(samples(entry));
+      }
+      return result;
+    }
+
+  private:
+    void open(std::string_view content, const std::string& name)
+    {
+      _content = content;
+      if (!IsNativeV3(content) || content.size() < sizeof(Header))
+      {
+        throw std::runtime_error("Not a NativeV3 report: " + name);
+      }
+      if (reinterpret_cast<uintptr_t>(content.data()) % alignof(Header) != 0)
+      {
+        throw std::runtime_error("NativeV3 report is not aligned in memory: " + name);
+      }
+
+      _header = reinterpret_cast<const Header*>(content.data());
+      if (_header->version != Version)
+      {
+        throw std::runtime_error("Unsupported NativeV3 version in " + name);
+      }
+
+      // Check tables are inside the file (entries are checked when used)
+      const uint64_t size = content.size();
+      if (_header->fileSize != size ||
+          _header->directoriesOffset + uint64_t(_header->nbDirectories) * sizeof(DirectoryEntry) > size ||
+          _header->filesOffset + uint64_t(_header->nbFiles) * sizeof(FileEntry) > size ||
+          _header->stringsOffset + _header->stringsSize > size ||
+          _header->directoriesOffset % alignof(DirectoryEntry) != 0 ||
+          _header->filesOffset % alignof(FileEntry) != 0)
+      {
+        throw std::runtime_error("Corrupted NativeV3 report: " + name);
+      }
+    }
+
+    std::unique_ptr<MappedFile> _mapping;
+    std::string_view _content;
+    const Header* _header = nullptr;
+  };
+}
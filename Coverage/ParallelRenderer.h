@@ -0,0 +1,122 @@
+#pragma once
+
+#include "ReportEmitter.h"
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Render independent report sections on all cores.
+///
+/// Each section (typically one source file) is rendered by a worker into its own fragment buffer;
+/// fragments are then written in index order, so output does not depend on thread scheduling.
+/// Sections are processed by windows of WindowSize items to keep memory bounded on big reports.
+class ParallelRenderer
+{
+public:
+  static constexpr size_t WindowSize = 1024;
+
+  static size_t DefaultWorkers()
+  {
+    const auto count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : count;
+  }
+
+  explicit ParallelRenderer(size_t nbWorkers = DefaultWorkers()) :
+    _nbWorkers(nbWorkers == 0 ? 1 : nbWorkers)
+  {}
+
+  size_t workers() const { return _nbWorkers; }
+
+  /// Call fn(worker, index) for every index of [0, count). worker is in [0, workers()) and allows per-thread state.
+  template<typename Function>
+  void forEach(size_t count, Function&& fn) const
+  {
+    const size_t nbThreads = std::min<size_t>(_nbWorkers, count);
+    if (nbThreads <= 1)
+    {
+      for (size_t i = 0; i < count; ++i)
+      {
+        fn(size_t(0), i);
+      }
+      return;
+    }
+
+    std::atomic<size_t> next = 0;
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    const auto work = [&](size_t worker)
+    {
+      try
+      {
+        for (size_t i = next++; i < count; i = next++)
+        {
+          fn(worker, i);
+        }
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error)
+        {
+          error = std::current_exception();
+        }
+        next = count; // Stop other workers
+      }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(nbThreads - 1);
+    for (size_t worker = 1; worker < nbThreads; ++worker)
+    {
+      threads.emplace_back(work, worker);
+    }
+    work(0);
+
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+
+    if (error)
+    {
+      std::rethrow_exception(error);
+    }
+  }
+
+  /// Render count sections with render(worker, index, fragment) and write them to out in index order.
+  template<typename Function>
+  void render(size_t count, ReportEmitter& out, Function&& render)
+  {
+    const size_t window = std::min<size_t>(count, WindowSize);
+    while (_fragments.size() < window)
+    {
+      _fragments.push_back(std::make_unique<ReportEmitter>());
+    }
+
+    for (size_t begin = 0; begin < count; begin += WindowSize)
+    {
+      const size_t size = std::min<size_t>(WindowSize, count - begin);
+
+      forEach(size, [&](size_t worker, size_t i)
+      {
+        auto& fragment = *_fragments[i];
+        fragment.clear();
+        render(worker, begin + i, fragment);
+      });
+
+      for (size_t i = 0; i < size; ++i)
+      {
+        out << _fragments[i]->view();
+      }
+    }
+  }
+
+private:
+  size_t _nbWorkers;
+  std::vector<std::unique_ptr<ReportEmitter>> _fragments;  ///< Reused between windows.
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#endif
+
+/// Sampling backend for Linux targets: the kernel samples the threads on a CPU clock through perf_event_open and
+/// writes the call stacks into per-thread ring buffers, read by poll() while the target runs (poll() also picks up
+/// the new threads). Nothing is interrupted, so rates of several kHz are affordable.
+/// The samples are raw PCs, innermost first, as the debugger sampling records them in SampleBuffer: the same
+/// symbolization and CallingContextTree aggregation apply.
+/// The record parsing does not depend on the Linux headers.
+class PerfEventSampler
+{
+public:
+  // perf ABI (linux/perf_event.h)
+  static constexpr uint32_t RecordLost = 2;
+  static constexpr uint32_t RecordSample = 9;
+  static constexpr uint64_t ContextMax = uint64_t(-4095);  ///< Callchain entries from here are context markers
+  static constexpr size_t HeaderSize = 8;                   ///< perf_event_header: type, misc, size
+
+  struct Stats
+  {
+    uint64_t samples = 0;
+    uint64_t lost = 0;      ///< Samples dropped by the kernel: the ring buffers were not read fast enough
+  };
+
+  /// Parse the records in [tail, head) of a ring buffer data area of \p size bytes (a power of 2), as written with
+  /// sample_type PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN.
+  /// Calls \p onSample(pid, tid, pcs, depth) for each sample. Returns the tail after the last complete record.
+  template <typename OnSample>
+  static uint64_t Parse(const uint8_t* data, size_t size, uint64_t tail, uint64_t head, Stats& stats, OnSample&& onSample)
+  {
+    std::vector<uint8_t> wrapped;
+    std::vector<uint64_t> pcs;
+    while (head - tail >= HeaderSize)
+    {
+      // Records are 8 bytes aligned: a header never wraps, a record may
+      const auto offset = size_t(tail & (size - 1));
+      uint32_t type;
+      uint16_t recordSize;
+      std::memcpy(&type, data + offset, sizeof(type));
+      std::memcpy(&recordSize, data + offset + 6, sizeof(recordSize));
+      if (recordSize < HeaderSize || head - tail < recordSize)
+      {
+        break;
+      }
+
+      const uint8_t* record = data + offset;
+      if (offset + recordSize > size)
+      {
+        wrapped.assign(data + offset, data + size);
+        wrapped.insert(wrapped.end(), data, data + (recordSize - (size - offset)));
+        record = wrapped.data();
+      }
+
+      if (type == RecordSample && recordSize >= HeaderSize + 24)
+      {
+        uint64_t ip, nr;
+        uint32_t pid, tid;
+        std::memcpy(&ip, record + HeaderSize, 8);
+        std::memcpy(&pid, record + HeaderSize + 8, 4);
+        std::memcpy(&tid, record + HeaderSize + 12, 4);
+        std::memcpy(&nr, record + HeaderSize + 16, 8);
+        nr = nr > (recordSize - HeaderSize - 24) / 8 ? (recordSize - HeaderSize - 24) / 8 : nr;
+
+        pcs.clear();
+        for (uint64_t i = 0; i < nr; ++i)
+        {
+          uint64_t pc;
+          std::memcpy(&pc, record + HeaderSize + 24 + i * 8, 8);
+          if (pc < ContextMax)
+          {
+            pcs.push_back(pc);
+          }
+        }
+        if (pcs.empty())
+        {
+          pcs.push_back(ip);
+        }
+
+        ++stats.samples;
+        onSample(pid, tid, pcs.data(), pcs.size());
+      }
+      else if (type == RecordLost && recordSize >= HeaderSize + 16)
+      {
+        uint64_t lost;
+        std::memcpy(&lost, record + HeaderSize + 8, 8);
+        stats.lost += lost;
+      }
+
+      tail += recordSize;
+    }
+    return tail;
+  }
+
+#ifdef __linux__
+  enum class Clock
+  {
+    Task,     ///< CPU time of the thread (software)
+    Cycles    ///< CPU cycles (hardware counter, may be missing in virtual machines)
+  };
+
+  /// \param[in] pages: ring buffer data pages per thread (a power of 2).
+  PerfEventSampler(unsigned hz, Clock clock = Clock::Task, size_t pages = 64) :
+    _hz(hz == 0 ? 1 : hz),
+    _clock(clock),
+    _pages(pages)
+  {}
+
+  // Avoid copy constructor
+  PerfEventSampler(const PerfEventSampler&) = delete;
+
+  ~PerfEventSampler()
+  {
+    for (auto& [tid, ring] : _rings)
+    {
+      close(ring);
+    }
+  }
+
+  /// Sample all the threads of \p pid. Returns false if no thread could be sampled (perf_event_paranoid, missing
+  /// counter...).
+  bool attach(pid_t pid)
+  {
+    _pid = pid;
+    updateThreads();
+    return !_rings.empty();
+  }
+
+  /// Read the samples written since the previous call. The target keeps running.
+  template <typename OnSample>
+  void poll(OnSample&& onSample)
+  {
+    for (auto& [tid, ring] : _rings)
+    {
+      auto* page = static_cast<perf_event_mmap_page*>(ring.base);
+      const uint64_t head = std::atomic_ref<__u64>(page->data_head).load(std::memory_order_acquire);
+      const uint64_t tail = page->data_tail;
+
+      const auto* data = static_cast<const uint8_t*>(ring.base) + PageSize();
+      const uint64_t parsed = Parse(data, _pages * PageSize(), tail, head, _stats, onSample);
+
+      // Give the space back to the kernel once the records are read
+      std::atomic_ref<__u64>(page->data_tail).store(parsed, std::memory_order_release);
+    }
+
+    // After the reads: the rings of the exited threads were drained
+    updateThreads();
+  }
+
+  const Stats& stats() const { return _stats; }
+  size_t threads() const { return _rings.size(); }
+
+private:
+  struct Ring
+  {
+    int fd;
+    void* base;     ///< Metadata page, then the data pages
+  };
+
+  static size_t PageSize()
+  {
+    return size_t(sysconf(_SC_PAGESIZE));
+  }
+
+  // Per-thread events: inherited events cannot be mapped without a CPU, so new threads are found in /proc
+  void updateThreads()
+  {
+    std::unordered_set<pid_t> alive;
+    std::error_code ec;
+    for (const auto& task : std::filesystem::directory_iterator("/proc/" + std::to_string(_pid) + "/task", ec))
+    {
+      const auto tid = pid_t(std::stoi(task.path().filename().string()));
+      alive.insert(tid);
+      if (_rings.find(tid) == _rings.end() && _failed.find(tid) == _failed.end())
+      {
+        open(tid);
+      }
+    }
+
+    for (auto it = _rings.begin(); it != _rings.end();)
+    {
+      if (alive.find(it->first) == alive.end())
+      {
+        close(it->second);
+        it = _rings.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+
+  void open(pid_t tid)
+  {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    if (_clock == Clock::Task)
+    {
+      attr.type = PERF_TYPE_SOFTWARE;
+      attr.config = PERF_COUNT_SW_TASK_CLOCK;
+    }
+    else
+    {
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    }
+    attr.freq = 1;
+    attr.sample_freq = _hz;
+    attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.disabled = 1;
+
+    const int fd = int(syscall(SYS_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    void* base = fd < 0 ? MAP_FAILED : mmap(nullptr, (_pages + 1) * PageSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+      if (fd >= 0)
+      {
+        ::close(fd);
+      }
+      _failed.insert(tid);
+      return;
+    }
+
+    _rings[tid] = Ring{ fd, base };
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+
+  void close(const Ring& ring)
+  {
+    munmap(ring.base, (_pages + 1) * PageSize());
+    ::close(ring.fd);
+  }
+
+  unsigned _hz;
+  Clock _clock;
+  size_t _pages;
+  pid_t _pid = 0;
+  std::unordered_map<pid_t, Ring> _rings;   ///< By thread id
+  std::unordered_set<pid_t> _failed;        ///< Threads without event: not retried
+  Stats _stats;
+#endif
+};
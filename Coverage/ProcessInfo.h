@@ -1,6 +1,10 @@
 #pragma once
 
 #include "BreakpointData.h"
+#include "StackUnwinder.h"
+#include "SymbolCache.h"
+#include "ThreadActivity.h"
+#include "WaitReason.h"
 
 #include <unordered_map>
 #include <Windows.h>
@@ -9,7 +13,12 @@ struct ProcessInfo
 {
   ProcessInfo(DWORD pid, HANDLE handle) :
     ProcessId(pid),
-    Handle(handle)
+    Handle(handle),
+    Unwinder([handle](uint64_t address, void* buffer, size_t size)
+    {
+      SIZE_T read = 0;
+      return ReadProcessMemory(handle, reinterpret_cast<LPCVOID>(address), buffer, size, &read) && read == size;
+    })
   {}
 
   DWORD ProcessId;
@@ -18,4 +27,8 @@ struct ProcessInfo
   std::unordered_map<PVOID, DWORD64> LoadedModules;
   std::unordered_map<DWORD, HANDLE> Threads;
   std::unordered_map<PVOID, BreakpointData> breakPoints;
+  SymbolCache Symbols;
+  ThreadActivity Activity;    ///< CPU time of the threads at the previous sample
+  StackUnwinder Unwinder;
+  std::unordered_map<uint64_t, WaitReason::Reason> WaitReasons;   ///< By PC of the top frame of the blocked threads
 };
\ No newline at end of file
@@ -0,0 +1,225 @@
+#pragma once
+
+#include "CallingContextTree.h"
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// Export of the sampled call stacks to the usual profile tools:
+/// - collapsed stacks ("main;foo;bar 12" per line) for flame graphs,
+/// - pprof profiles (profile.proto, uncompressed: pprof reads them as is).
+struct ProfileExport
+{
+  /// Minimal protobuf encoder: varints and length-delimited fields, enough for profile.proto.
+  class ProtobufWriter
+  {
+  public:
+    void varint(uint64_t value)
+    {
+      while (value >= 0x80)
+      {
+        _buffer.push_back(char(uint8_t(value) | 0x80));
+        value >>= 7;
+      }
+      _buffer.push_back(char(value));
+    }
+
+    void field(uint32_t number, uint64_t value)
+    {
+      varint(uint64_t(number) << 3);
+      varint(value);
+    }
+
+    void field(uint32_t number, std::string_view bytes)
+    {
+      varint((uint64_t(number) << 3) | 2);
+      varint(bytes.size());
+      _buffer.append(bytes);
+    }
+
+    void field(uint32_t number, const ProtobufWriter& message)
+    {
+      field(number, std::string_view(message._buffer));
+    }
+
+    /// Packed repeated varints.
+    void packed(uint32_t number, const std::vector<uint64_t>& values)
+    {
+      ProtobufWriter content;
+      for (auto value : values)
+      {
+        content.varint(value);
+      }
+      field(number, content);
+    }
+
+    const std::string& str() const { return _buffer; }
+
+  private:
+    std::string _buffer;
+  };
+
+  static void WriteCollapsed(const CallingContextTree& tree, std::ostream& os)
+  {
+    // Lines of the same function are merged: the stacks are made of function names
+    std::map<std::string, uint64_t> stacks;
+    std::vector<CallingContextTree::NodeId> path;
+    for (CallingContextTree::NodeId id = CallingContextTree::Root + 1; id < tree.size(); ++id)
+    {
+      const auto& node = tree.node(id);
+      if (node.exclusive == 0)
+      {
+        continue;
+      }
+
+      path.clear();
+      for (auto it = id; it != CallingContextTree::Root; it = tree.node(it).parent)
+      {
+        path.push_back(it);
+      }
+
+      std::string stack;
+      for (size_t i = path.size(); i > 0; --i)
+      {
+        if (i != path.size())
+        {
+          stack.push_back(';');
+        }
+        AppendFrameName(stack, tree.function(tree.frame(tree.node(path[i - 1]).frame).function));
+      }
+      stacks[stack] += node.exclusive;
+    }
+
+    for (const auto& [stack, count] : stacks)
+    {
+      os << stack << ' ' << count << '\n';
+    }
+  }
+
+  /// \param[in] periodNanos: time between two samples, 0 when sampling is not periodic.
+  /// \param[in] timeType: what the sample time is, "cpu" or "wait" for the stacks of blocked threads.
+  static void WritePprof(const CallingContextTree& tree, uint64_t periodNanos, std::ostream& os, std::string_view timeType = "cpu")
+  {
+    // profile.proto field numbers
+    enum : uint32_t
+    {
+      ProfileSampleType = 1, ProfileSample = 2, ProfileLocation = 4, ProfileFunction = 5, ProfileStringTable = 6,
+      ProfilePeriodType = 11, ProfilePeriod = 12,
+      ValueTypeType = 1, ValueTypeUnit = 2,
+      SampleLocationId = 1, SampleValue = 2,
+      LocationId = 1, LocationLine = 4,
+      LineFunctionId = 1, LineLine = 2,
+      FunctionId = 1, FunctionName = 2, FunctionSystemName = 3, FunctionFilename = 4
+    };
+
+    std::vector<std::string_view> strings = { "" };
+    std::unordered_map<std::string_view, uint64_t> stringIds = { { "", 0 } };
+    const auto intern = [&](std::string_view value)
+    {
+      auto [it, inserted] = stringIds.emplace(value, strings.size());
+      if (inserted)
+      {
+        strings.push_back(value);
+      }
+      return it->second;
+    };
+
+    ProtobufWriter profile;
+    const auto valueType = [&](std::string_view type, std::string_view unit)
+    {
+      ProtobufWriter message;
+      message.field(ValueTypeType, intern(type));
+      message.field(ValueTypeUnit, intern(unit));
+      return message;
+    };
+    profile.field(ProfileSampleType, valueType("samples", "count"));
+    if (periodNanos != 0)
+    {
+      profile.field(ProfileSampleType, valueType(timeType, "nanoseconds"));
+    }
+
+    // A sample per calling context, leaf first
+    std::vector<uint64_t> locations, values;
+    for (CallingContextTree::NodeId id = CallingContextTree::Root + 1; id < tree.size(); ++id)
+    {
+      const auto& node = tree.node(id);
+      if (node.exclusive == 0)
+      {
+        continue;
+      }
+
+      locations.clear();
+      for (auto it = id; it != CallingContextTree::Root; it = tree.node(it).parent)
+      {
+        locations.push_back(uint64_t(tree.node(it).frame) + 1);
+      }
+      values.assign(1, node.exclusive);
+      if (periodNanos != 0)
+      {
+        values.push_back(node.exclusive * periodNanos);
+      }
+
+      ProtobufWriter sample;
+      sample.packed(SampleLocationId, locations);
+      sample.packed(SampleValue, values);
+      profile.field(ProfileSample, sample);
+    }
+
+    // A location per frame; a function per (name, file)
+    std::map<std::pair<uint32_t, uint32_t>, uint64_t> functions;
+    for (CallingContextTree::FrameId id = 0; id < tree.frames(); ++id)
+    {
+      const auto& frame = tree.frame(id);
+      const auto function = functions.emplace(std::make_pair(frame.function, frame.file), functions.size() + 1).first->second;
+
+      ProtobufWriter line;
+      line.field(LineFunctionId, function);
+      line.field(LineLine, frame.line);
+
+      ProtobufWriter location;
+      location.field(LocationId, uint64_t(id) + 1);
+      location.field(LocationLine, line);
+      profile.field(ProfileLocation, location);
+    }
+
+    for (const auto& [key, id] : functions)
+    {
+      const auto name = intern(tree.function(key.first));
+      ProtobufWriter function;
+      function.field(FunctionId, id);
+      function.field(FunctionName, name);
+      function.field(FunctionSystemName, name);
+      function.field(FunctionFilename, intern(tree.file(key.second)));
+      profile.field(ProfileFunction, function);
+    }
+
+    if (periodNanos != 0)
+    {
+      profile.field(ProfilePeriodType, valueType(timeType, "nanoseconds"));
+      profile.field(ProfilePeriod, periodNanos);
+    }
+
+    // Last: the string table is complete
+    for (auto value : strings)
+    {
+      profile.field(ProfileStringTable, value);
+    }
+
+    os.write(profile.str().data(), std::streamsize(profile.str().size()));
+  }
+
+private:
+  // ';' separates the frames and the count follows the last space: keep the names on one line, without ';'
+  static void AppendFrameName(std::string& stack, const std::string& name)
+  {
+    for (char c : name)
+    {
+      stack.push_back(c == ';' ? ':' : (c == '\n' || c == '\r') ? ' ' : c);
+    }
+  }
+};
@@ -1,52 +1,27 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
-#include <unordered_map>
-#include <memory>
-
-#include <Windows.h>
 
 struct ProfileInfo
 {
   ProfileInfo() :
     Shallow(0),
-    Deep(0)
+    Deep(0),
+    ShallowSamples(0),
+    DeepSamples(0),
+    FunctionShallowSamples(0)
   {}
 
-  float Shallow;
-  float Deep;
-};
-
-struct ProfileFrame
-{
-  ProfileFrame(const std::string& filename, DWORD64 lineNumber, bool shallow) :
-    filename(filename)
+  /// Percentage of the reports: the runs and the merges compute Deep and Shallow with it from the raw counts.
+  static float Percent(uint64_t samples, uint64_t total)
   {
-    Update(lineNumber, shallow);
+    return float(samples) * 100.0f / float(total == 0 ? 1 : total);
   }
 
-  std::string filename;
-  std::unordered_map<DWORD64, ProfileInfo> lineHitCount;
-
-  void Update(DWORD64 lineNumber, bool shallow)
-  {
-    if (lineNumber < 0xf00000)
-    {
-      auto it = lineHitCount.find(lineNumber);
-      if (it == lineHitCount.end())
-      {
-        ProfileInfo pi;
-        pi.Deep++;
-        pi.Shallow += shallow ? 1 : 0;
-
-        lineHitCount[lineNumber] = pi;
-      }
-      else
-      {
-        it->second.Deep++;
-        it->second.Shallow += shallow ? 1 : 0;
-      }
-    }
-  }
+  float Shallow;
+  float Deep;
+  uint64_t ShallowSamples;    ///< Raw counts behind the percentages of a report, summed by merges
+  uint64_t DeepSamples;
+  uint64_t FunctionShallowSamples;  ///< ShallowSamples of the functions of the line: denominator of Shallow
 };
-
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "MergeRunnerV2.h"
+#include "NativeV3.h"
+#include "ReportEmitter.h"
+#include "RuntimeOptions.h"
+
+#include <array>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+/// Lossless conversion between NativeV2 and NativeV3 reports: line arrays, statistics, hashes and profiles.
+struct ReportConverter
+{
+  /// Convert opts.ConvertInput into opts.OutputFile using opts.ExportFormat. Input format is detected.
+  static void execute(const RuntimeOptions& opts)
+  {
+    const bool inputIsV3 = IsNativeV3File(opts.ConvertInput);
+
+    if (!inputIsV3 && opts.ExportFormat == RuntimeOptions::NativeV3)
+    {
+      std::ofstream ofs;
+      ReportEmitter::OpenUnbuffered(ofs, opts.OutputFile, std::ios::binary);
+      ReportEmitter out(ofs);
+      FromNativeV2(MergeRunnerV2::makeDictionary(opts.ConvertInput), out);
+    }
+    else if (inputIsV3 && opts.ExportFormat == RuntimeOptions::NativeV2)
+    {
+      NativeV3::Reader reader(opts.ConvertInput);
+      std::ofstream ofs;
+      ReportEmitter::OpenUnbuffered(ofs, opts.OutputFile);
+      ReportEmitter out(ofs);
+      ToNativeV2(reader, out, opts.CompactLines);
+    }
+    else
+    {
+      throw std::runtime_error("Conversion is only supported from nativeV2 to nativeV3 and from nativeV3 to nativeV2.");
+    }
+  }
+
+  static bool IsNativeV3File(const std::string& filename)
+  {
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.is_open())
+    {
+      throw std::runtime_error("Conversion failure: Impossible to open file: " + filename);
+    }
+
+    std::array<char, NativeV3::Magic.size()> magic{};
+    ifs.read(magic.data(), magic.size());
+    return NativeV3::IsNativeV3(std::string_view(magic.data(), static_cast<size_t>(ifs.gcount())));
+  }
+
+  static void FromNativeV2(const MergeRunnerV2::DictCoverage& dict, ReportEmitter& out)
+  {
+    NativeV3::Writer writer;
+    for (const auto& [directory, files] : dict)
+    {
+      for (const auto& [path, coverage] : files)
+      {
+        writer.add(directory, path, coverage);
+      }
+    }
+    writer.write(out);
+  }
+
+  static void ToNativeV2(const NativeV3::Reader& reader, ReportEmitter& out, bool compact = false)
+  {
+    // NativeV3 directories and files are sorted: this is the NativeV2 canonical order
+    FileCoverageV2::writeHeader(out, compact, true);
+
+    // Files outside any directory are written last: the NativeV2 reader expects them after directories.
+    const NativeV3::DirectoryEntry* rootFiles = nullptr;
+    for (const auto& dir : reader.directories())
+    {
+      const auto directory = reader.string(dir.path);
+      if (directory.empty())
+      {
+        rootFiles = &dir;
+        continue;
+      }
+
+      FileCoverageV2::openDirectory(out, std::string(directory));
+      for (const auto& entry : reader.files(dir))
+      {
+        reader.coverage(entry).write(reader.string(entry.path), out, compact);
+      }
+      FileCoverageV2::closeDirectory(out);
+    }
+
+    if (rootFiles != nullptr)
+    {
+      for (const auto& entry : reader.files(*rootFiles))
+      {
+        reader.coverage(entry).write(reader.string(entry.path), out, compact);
+      }
+    }
+
+    FileCoverageV2::writeFooter(out);
+  }
+};
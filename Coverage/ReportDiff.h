@@ -0,0 +1,391 @@
+#pragma once
+
+#include "DiffKernel.h"
+#include "FileCoverageV2.h"
+#include "MappedFile.h"
+#include "MergeRunnerV1.h"
+#include "NativeV2Parser.h"
+#include "NativeV3.h"
+#include "ParallelRenderer.h"
+#include "ReportEmitter.h"
+#include "RuntimeOptions.h"
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// Line by line comparison of two coverage reports (baseline and current), files matched by path.
+/// Line arrays are converted to "is code" / "is covered" bitsets and compared a word (64 lines) at a time:
+///   newly covered   = covered now, not covered in baseline
+///   newly uncovered = code not covered now, covered in baseline
+///   changed count   = covered in both with a different hit count
+/// Output: a summary, then for each file with a difference its lines (1-based, as ranges).
+struct ReportDiff
+{
+  /// Files of one report. Native reports are decoded when loaded, NativeV2 files when compared, NativeV3 line arrays are used in place.
+  class Report
+  {
+  public:
+    explicit Report(const std::string& filename)
+    {
+      _mapping = std::make_unique<MappedFile>(filename);
+      const auto content = _mapping->view();
+      const auto start = content.find_first_not_of(" \t\r\n");
+      const auto head = start == std::string_view::npos ? std::string_view() : content.substr(start);
+
+      if (NativeV3::IsNativeV3(content))
+      {
+        _v3 = std::make_unique<NativeV3::Reader>(content);
+        for (const auto& dir : _v3->directories())
+        {
+          const auto directory = _v3->string(dir.path);
+          for (const auto& entry : _v3->files(dir))
+          {
+            _keys.push_back(Key(directory, _v3->string(entry.path)));
+            _v3Files.push_back(&entry);
+          }
+        }
+      }
+      else if (head.starts_with("<"))
+      {
+        NativeV2Parser parser(content);
+        NativeV2Parser::FileElement file;
+        while (parser.next(file))
+        {
+          _keys.push_back(Key(file.directory, file.path));
+          _v2Files.push_back(file);
+        }
+      }
+      else
+      {
+        // Native: "RES:" states
+        for (const auto& [path, profile] : MergeRunnerV1::makeDictionary(filename))
+        {
+          _keys.push_back(path);
+          _v1Lines.push_back(FromStates(profile.res));
+        }
+      }
+    }
+
+    size_t size() const { return _keys.size(); }
+    const std::string& key(size_t index) const { return _keys[index]; }
+
+    /// Line array of file \p index (FileCoverageV2 encoding). \p buffer keeps decoded lines.
+    std::span<const uint16_t> lines(size_t index, FileCoverageV2& buffer) const
+    {
+      if (_v3)
+      {
+        return _v3->lines(*_v3Files[index]);
+      }
+      if (!_v2Files.empty())
+      {
+        _v2Files[index].decode(buffer);
+        return buffer._code;
+      }
+      return _v1Lines[index];
+    }
+
+    /// Path -> file index.
+    std::unordered_map<std::string_view, size_t> index() const
+    {
+      std::unordered_map<std::string_view, size_t> result;
+      result.reserve(_keys.size());
+      for (size_t i = 0; i < _keys.size(); ++i)
+      {
+        result.emplace(_keys[i], i);
+      }
+      return result;
+    }
+
+    /// Path of a file from its NativeV2/NativeV3 directory and relative path.
+    static std::string Key(std::string_view directory, std::string_view path)
+    {
+      std::string key(directory);
+      if (!key.empty() && key.back() != '\\' && key.back() != '/')
+      {
+        key += '\\';
+      }
+      key += path;
+      return key;
+    }
+
+    /// Native "RES:" states: 'c' covered, 'p' partially covered, 'u' not covered, other lines are not code.
+    static FileCoverageV2::LineArray FromStates(std::string_view states)
+    {
+      FileCoverageV2::LineArray lines(states.size(), 0);
+      for (size_t i = 0; i < states.size(); ++i)
+      {
+        switch (states[i])
+        {
+          case 'c': lines[i] = FileCoverageV2::maskIsCode | 1; break;
+          case 'p': lines[i] = FileCoverageV2::maskIsCode | FileCoverageV2::maskIsPartial | 1; break;
+          case 'u': lines[i] = FileCoverageV2::maskIsCode; break;
+        }
+      }
+      return lines;
+    }
+
+  private:
+    std::unique_ptr<MappedFile> _mapping;
+    std::unique_ptr<NativeV3::Reader> _v3;
+    std::vector<std::string> _keys;
+    std::vector<NativeV2Parser::FileElement> _v2Files;
+    std::vector<const NativeV3::FileEntry*> _v3Files;
+    std::vector<FileCoverageV2::LineArray> _v1Lines;
+  };
+
+  /// Comparison of one file.
+  struct FileDiff
+  {
+    size_t baselineCode = 0;
+    size_t baselineCovered = 0;
+    size_t code = 0;
+    size_t covered = 0;
+    std::vector<uint32_t> newlyCovered;     ///< Line indexes (0-based)
+    std::vector<uint32_t> newlyUncovered;
+    std::vector<uint32_t> changedCount;
+
+    bool changed() const
+    {
+      return !newlyCovered.empty() || !newlyUncovered.empty() || !changedCount.empty();
+    }
+  };
+
+  /// Bitsets of one worker, reused from file to file.
+  struct Workspace
+  {
+    std::vector<uint64_t> baselineCode;
+    std::vector<uint64_t> baselineCovered;
+    std::vector<uint64_t> code;
+    std::vector<uint64_t> covered;
+    std::vector<uint64_t> changed;
+    FileCoverageV2 baselineBuffer;
+    FileCoverageV2 buffer;
+  };
+
+  /// Compare \p current line array to \p baseline (empty for a new file). Line arrays may differ in size.
+  static FileDiff Compare(std::span<const uint16_t> baseline, std::span<const uint16_t> current, Workspace& workspace)
+  {
+    const size_t nbWords = DiffKernel::Words(std::max(baseline.size(), current.size()));
+    for (auto* bits : { &workspace.baselineCode, &workspace.baselineCovered, &workspace.code, &workspace.covered, &workspace.changed })
+    {
+      bits->assign(nbWords, 0);
+    }
+
+    DiffKernel::ToBits(baseline.data(), baseline.size(), workspace.baselineCode.data(), workspace.baselineCovered.data());
+    DiffKernel::ToBits(current.data(), current.size(), workspace.code.data(), workspace.covered.data());
+    DiffKernel::ChangedCounts(baseline.data(), current.data(), std::min(baseline.size(), current.size()), workspace.changed.data());
+
+    FileDiff diff;
+    for (size_t w = 0; w < nbWords; ++w)
+    {
+      const uint64_t baseCovered = workspace.baselineCovered[w];
+      const uint64_t covered = workspace.covered[w];
+      diff.baselineCode += std::popcount(workspace.baselineCode[w]);
+      diff.baselineCovered += std::popcount(baseCovered);
+      diff.code += std::popcount(workspace.code[w]);
+      diff.covered += std::popcount(covered);
+
+      // Baseline bitsets are reused for the results: each word is read before being rewritten
+      workspace.changed[w] &= covered & baseCovered;
+      workspace.baselineCode[w] = covered & ~baseCovered;
+      workspace.baselineCovered[w] = workspace.code[w] & ~covered & baseCovered;
+    }
+    const auto& newlyCovered = workspace.baselineCode;
+    const auto& newlyUncovered = workspace.baselineCovered;
+
+    const auto collect = [&](const std::vector<uint64_t>& bits, std::vector<uint32_t>& lines)
+    {
+      DiffKernel::ForEachBit(bits.data(), nbWords, [&](size_t line) { lines.push_back(static_cast<uint32_t>(line)); });
+    };
+    collect(newlyCovered, diff.newlyCovered);
+    collect(newlyUncovered, diff.newlyUncovered);
+    collect(workspace.changed, diff.changedCount);
+    return diff;
+  }
+
+  static constexpr size_t NoMatch = size_t(-1);
+
+  /// Comparison of two reports.
+  struct Result
+  {
+    std::vector<FileDiff> diffs;        ///< Per file of the current report
+    std::vector<size_t> matches;        ///< Baseline index of each current file, NoMatch for added files
+    std::vector<size_t> removed;        ///< Baseline files missing from the current report
+    std::vector<FileDiff> removedDiffs;
+  };
+
+  /// Compare all files of \p current to \p baseline on all cores.
+  static Result Run(const Report& baseline, const Report& current, const ParallelRenderer& renderer)
+  {
+    const auto baselineIndex = baseline.index();
+    std::vector<Workspace> workspaces(renderer.workers());
+
+    Result result;
+    result.diffs.resize(current.size());
+    result.matches.resize(current.size(), NoMatch);
+    renderer.forEach(current.size(), [&](size_t worker, size_t index)
+    {
+      auto& workspace = workspaces[worker];
+      std::span<const uint16_t> baselineLines;
+      const auto it = baselineIndex.find(current.key(index));
+      if (it != baselineIndex.end())
+      {
+        result.matches[index] = it->second;
+        baselineLines = baseline.lines(it->second, workspace.baselineBuffer);
+      }
+      result.diffs[index] = Compare(baselineLines, current.lines(index, workspace.buffer), workspace);
+    });
+
+    // Files removed since the baseline still count in its totals
+    std::vector<char> matched(baseline.size(), 0);
+    for (const auto match : result.matches)
+    {
+      if (match != NoMatch)
+      {
+        matched[match] = 1;
+      }
+    }
+    for (size_t i = 0; i < baseline.size(); ++i)
+    {
+      if (!matched[i])
+      {
+        result.removed.push_back(i);
+      }
+    }
+    result.removedDiffs.resize(result.removed.size());
+    renderer.forEach(result.removed.size(), [&](size_t worker, size_t index)
+    {
+      auto& workspace = workspaces[worker];
+      result.removedDiffs[index] = Compare(baseline.lines(result.removed[index], workspace.baselineBuffer), {}, workspace);
+    });
+    return result;
+  }
+
+  /// Compare opts.DiffInput to opts.DiffBaseline, write the result into opts.OutputFile (standard output when empty).
+  static void execute(const RuntimeOptions& opts)
+  {
+    const Report baseline = Load(opts.DiffBaseline);
+    const Report current = Load(opts.DiffInput);
+    const auto result = Run(baseline, current, ParallelRenderer());
+
+    std::ofstream ofs;
+    if (!opts.OutputFile.empty())
+    {
+      ReportEmitter::OpenUnbuffered(ofs, opts.OutputFile);
+      if (!ofs.is_open())
+      {
+        throw std::runtime_error("Diff failure: Impossible to write file: " + opts.OutputFile);
+      }
+    }
+    ReportEmitter out(opts.OutputFile.empty() ? std::cout : ofs);
+    write(opts.DiffBaseline, opts.DiffInput, baseline, current, result, out);
+  }
+
+  static void write(const std::string& baselineName, const std::string& currentName, const Report& baseline, const Report& current,
+                    const Result& result, ReportEmitter& out)
+  {
+    FileDiff total;
+    size_t nbAdded = 0;
+    size_t nbChanged = 0;
+    size_t nbNewlyCovered = 0;
+    size_t nbNewlyUncovered = 0;
+    size_t nbChangedCount = 0;
+    for (size_t i = 0; i < result.diffs.size(); ++i)
+    {
+      const auto& diff = result.diffs[i];
+      nbAdded += result.matches[i] == NoMatch ? 1 : 0;
+      nbChanged += diff.changed() ? 1 : 0;
+      nbNewlyCovered += diff.newlyCovered.size();
+      nbNewlyUncovered += diff.newlyUncovered.size();
+      nbChangedCount += diff.changedCount.size();
+      add(total, diff);
+    }
+    for (const auto& diff : result.removedDiffs)
+    {
+      add(total, diff);
+    }
+
+    out << "DIFF: " << baselineName << " -> " << currentName << '\n';
+    out << "FILES: " << current.size() << " current, " << nbChanged << " changed, " << nbAdded << " added, " << result.removed.size() << " removed\n";
+    out << "LINES: " << total.baselineCovered << '/' << total.baselineCode << " covered -> " << total.covered << '/' << total.code << " covered\n";
+    out << "NEWLY_COVERED: " << nbNewlyCovered << '\n';
+    out << "NEWLY_UNCOVERED: " << nbNewlyUncovered << '\n';
+    out << "CHANGED_COUNT: " << nbChangedCount << '\n';
+
+    for (size_t i = 0; i < result.diffs.size(); ++i)
+    {
+      const auto& diff = result.diffs[i];
+      if (!diff.changed())
+      {
+        continue;
+      }
+      out << (result.matches[i] == NoMatch ? "ADDED: " : "FILE: ") << current.key(i) << '\n';
+      writeLines(out, "NEWLY_COVERED: ", diff.newlyCovered);
+      writeLines(out, "NEWLY_UNCOVERED: ", diff.newlyUncovered);
+      writeLines(out, "CHANGED_COUNT: ", diff.changedCount);
+    }
+    for (const auto index : result.removed)
+    {
+      out << "REMOVED: " << baseline.key(index) << '\n';
+    }
+  }
+
+private:
+  static Report Load(const std::string& filename)
+  {
+    try
+    {
+      return Report(filename);
+    }
+    catch (const std::runtime_error& e)
+    {
+      const std::string msg = "Diff failure: " + std::string(e.what()) + " in file: " + filename;
+      throw std::exception(msg.c_str());
+    }
+  }
+
+  static void add(FileDiff& total, const FileDiff& diff)
+  {
+    total.baselineCode += diff.baselineCode;
+    total.baselineCovered += diff.baselineCovered;
+    total.code += diff.code;
+    total.covered += diff.covered;
+  }
+
+  /// Lines as 1-based ranges: "3-5,9"
+  static void writeLines(ReportEmitter& out, std::string_view label, const std::vector<uint32_t>& lines)
+  {
+    if (lines.empty())
+    {
+      return;
+    }
+
+    out << label;
+    for (size_t i = 0; i < lines.size();)
+    {
+      size_t last = i;
+      while (last + 1 < lines.size() && lines[last + 1] == lines[last] + 1)
+      {
+        ++last;
+      }
+      if (i != 0)
+      {
+        out << ',';
+      }
+      out << lines[i] + 1;
+      if (last != i)
+      {
+        out << '-' << lines[last] + 1;
+      }
+      i = last + 1;
+    }
+    out << '\n';
+  }
+};
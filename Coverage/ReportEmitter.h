@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <concepts>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Buffered writer used by every report format.
+///
+/// Text is accumulated in one large reusable buffer and handed to the underlying stream with a
+/// single write once the buffer is full (or when flushed). Numbers are formatted with std::to_chars,
+/// so no temporary string or locale lookup happens per element.
+///
+/// Without stream the emitter only grows in memory: this is used to render report fragments.
+class ReportEmitter
+{
+public:
+  static constexpr size_t DefaultCapacity = 1 << 20;  ///< 1 MB: one write call per MB of report.
+
+  /// Indentation fragments: Indent(n) returns n tabulations without building a string.
+  static constexpr std::string_view Tabs = "\t\t\t\t\t\t\t\t";
+
+  static constexpr std::string_view Indent(size_t level)
+  {
+    assert(level <= Tabs.size());
+    return Tabs.substr(0, level);
+  }
+
+  explicit ReportEmitter(std::ostream& stream, size_t capacity = DefaultCapacity) :
+    _stream(&stream)
+  {
+    _buffer.resize(capacity);
+  }
+
+  /// In-memory emitter: content is kept until clear().
+  explicit ReportEmitter(size_t capacity = 4096) :
+    _stream(nullptr)
+  {
+    _buffer.resize(capacity);
+  }
+
+  // Avoid copy constructor
+  ReportEmitter(const ReportEmitter&) = delete;
+
+  ~ReportEmitter()
+  {
+    flush();
+  }
+
+  /// Give the buffered data to the stream.
+  void flush()
+  {
+    if (_stream)
+    {
+      drain();
+      _stream->flush();
+    }
+  }
+
+  /// Content not yet given to the stream (the whole content for an in-memory emitter).
+  std::string_view view() const
+  {
+    return std::string_view(_buffer.data(), _size);
+  }
+
+  void clear()
+  {
+    _size = 0;
+  }
+
+  /// Return a pointer where at least \p count bytes can be written. Call commit() with the number of bytes really used.
+  char* reserve(size_t count)
+  {
+    if (_size + count > _buffer.size())
+    {
+      drain();
+      if (_size + count > _buffer.size())
+      {
+        _buffer.resize(std::max<size_t>(_size + count, _buffer.size() * 2));
+      }
+    }
+    return _buffer.data() + _size;
+  }
+
+  void commit(size_t count)
+  {
+    assert(_size + count <= _buffer.size());
+    _size += count;
+  }
+
+  ReportEmitter& operator<<(std::string_view text)
+  {
+    if (_stream && text.size() > _buffer.size())
+    {
+      // Huge block: no need to copy it into our buffer
+      drain();
+      _stream->write(text.data(), static_cast<std::streamsize>(text.size()));
+      return *this;
+    }
+
+    std::memcpy(reserve(text.size()), text.data(), text.size());
+    commit(text.size());
+    return *this;
+  }
+
+  ReportEmitter& operator<<(const char* text)
+  {
+    return *this << std::string_view(text);
+  }
+
+  ReportEmitter& operator<<(char c)
+  {
+    *reserve(1) = c;
+    commit(1);
+    return *this;
+  }
+
+  template<std::integral T>
+    requires (!std::same_as<T, char> && !std::same_as<T, bool>)
+  ReportEmitter& operator<<(T value)
+  {
+    constexpr size_t MaxDigits = 24;
+    char* first = reserve(MaxDigits);
+    const auto result = std::to_chars(first, first + MaxDigits, value);
+    assert(result.ec == std::errc());
+    commit(result.ptr - first);
+    return *this;
+  }
+
+  /// Floating point values follow the std::ostream default (%g with 6 significant digits).
+  ReportEmitter& operator<<(double value)
+  {
+    constexpr size_t MaxDigits = 32;
+    char* first = reserve(MaxDigits);
+    const auto result = std::to_chars(first, first + MaxDigits, value, std::chars_format::general, 6);
+    assert(result.ec == std::errc());
+    commit(result.ptr - first);
+    return *this;
+  }
+
+  /// Open \p ofs without stream buffering: our buffer is already big, so each flush becomes one write.
+  static void OpenUnbuffered(std::ofstream& ofs, const std::string& filename, std::ios::openmode mode = std::ios::out)
+  {
+    ofs.rdbuf()->pubsetbuf(nullptr, 0);
+    ofs.open(filename, mode | std::ios::out | std::ios::trunc);
+  }
+
+private:
+  void drain()
+  {
+    if (_stream && _size > 0)
+    {
+      _stream->write(_buffer.data(), static_cast<std::streamsize>(_size));
+      _size = 0;
+    }
+  }
+
+  std::ostream* _stream;
+  std::vector<char> _buffer;
+  size_t _size = 0;
+};
@@ -35,6 +35,7 @@ public:
   {
     Native,
     NativeV2,
+    NativeV3,
     Cobertura,
     Clover
   } ExportFormat = Native;
@@ -43,6 +44,21 @@ public:
   std::string OutputFile;
 
   std::string MergedOutput;
+  unsigned MergeLockTimeout = 300;  ///< Seconds to wait for a concurrent merge of MergedOutput before failing.
+  std::list<std::string> MergeInputs;   ///< Merge all these reports (files, wildcards or @list) into MergedOutput (no executable is run).
+  bool CompactLines = false;    ///< NativeV2: run-length/sparse encoded line arrays (report version 2.1).
+  std::string ConvertInput;     ///< Convert this report to ExportFormat into OutputFile (no executable is run).
+  std::string DiffBaseline;     ///< Compare DiffInput to this report (no executable is run).
+  std::string DiffInput;
+  std::string ServeChannel;     ///< Run the merge service on this pipe name, accumulating into MergedOutput (no executable is run).
+  unsigned CheckpointInterval = 0;  ///< Merge service: write MergedOutput every N seconds (0: only on request).
+  std::string SubmitChannel;    ///< Send reports to the merge service on this pipe name instead of merging them locally.
+  std::string ServiceCommand;   ///< Send this request (checkpoint/stop) to SubmitChannel (no executable is run).
+  unsigned SampleHz = 0;        ///< Profiling samples per second on a dedicated timer (0: sample when the target sends no debug event for 500ms).
+  std::string ProfileCollapsed;  ///< Write the sampled call stacks in collapsed format (flame graphs) to this file.
+  std::string ProfilePprof;     ///< Write the sampled call stacks as a pprof profile to this file.
+  std::string ProfileOffCpu;    ///< Write the call stacks of the threads blocked at each sample in collapsed format to this file (otherwise they are not walked).
+  std::string ProfileOffCpuPprof;  ///< Write the call stacks of the blocked threads as a pprof profile (per line and per call path) to this file.
   std::string WorkingDirectory;
   std::list<std::string> CodePaths;
   std::string Executable;
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Raw profiler samples waiting for symbolization: the program counters of one stack walk per record, innermost
+/// first, in a buffer allocated once. Recording a sample while the target is stopped is a copy, the symbolization
+/// is done by drain() once the target runs again.
+/// Records are [header: process id << 32 | tag << 16 | depth][pc]*depth. drain() always empties the buffer, so
+/// records are appended from the start again and never wrap.
+/// The buffer is not synchronized: push() and drain() must be called from the same thread.
+class SampleBuffer
+{
+public:
+  static constexpr size_t MaxDepth = 256;       ///< Deeper stacks are truncated to their innermost frames
+
+  explicit SampleBuffer(size_t capacity = size_t(1) << 20) :
+    _words(capacity < MaxDepth + 1 ? MaxDepth + 1 : capacity)
+  {}
+
+  // Avoid copy constructor
+  SampleBuffer(const SampleBuffer&) = delete;
+
+  /// \param[in] tag: what the sample is, given back by drain() (0: a stack running on the CPU).
+  /// Returns false when the buffer is too full for the sample: drain() and push again.
+  bool push(uint32_t process, const uint64_t* pcs, size_t depth, uint16_t tag = 0)
+  {
+    depth = depth > MaxDepth ? MaxDepth : depth;
+    if (_used + depth + 1 > _words.size())
+    {
+      return false;
+    }
+
+    _words[_used] = (uint64_t(process) << 32) | (uint64_t(tag) << 16) | depth;
+    for (size_t i = 0; i < depth; ++i)
+    {
+      _words[_used + 1 + i] = pcs[i];
+    }
+    _used += depth + 1;
+    ++_samples;
+    return true;
+  }
+
+  /// Call \p onSample(process, tag, pcs, depth) for each sample in recording order, and empty the buffer.
+  template <typename OnSample>
+  void drain(OnSample&& onSample)
+  {
+    for (size_t i = 0; i < _used;)
+    {
+      const auto header = _words[i];
+      const auto depth = size_t(header & 0xFFFF);
+      onSample(uint32_t(header >> 32), uint16_t(header >> 16), _words.data() + i + 1, depth);
+      i += depth + 1;
+    }
+    _used = 0;
+    _samples = 0;
+  }
+
+  bool empty() const { return _samples == 0; }
+  size_t samples() const { return _samples; }
+  size_t used() const { return _used; }           ///< In words
+  size_t capacity() const { return _words.size(); }
+
+private:
+  std::vector<uint64_t> _words;
+  size_t _used = 0;
+  size_t _samples = 0;
+};
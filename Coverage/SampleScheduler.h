@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <timeapi.h>
+#endif
+
+/// Fixed-rate profiling clock: a timer thread calls interrupt() every 1/hz second, whatever the debug event loop does.
+/// Ticks are scheduled on absolute deadlines so the rate does not drift. While an interrupt is not acknowledged
+/// (the target did not reach the sampling break yet), ticks are skipped instead of piling up interrupts.
+class SampleScheduler
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// \param[in] hz: samples per second (> 0).
+  /// \param[in] interrupt: called on the timer thread to stop the target for a sample. Returns false when nothing was interrupted.
+  SampleScheduler(unsigned hz, std::function<bool()> interrupt) :
+    _period(std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / (hz == 0 ? 1 : hz)),
+    _interrupt(std::move(interrupt))
+  {}
+
+  // Avoid copy constructor
+  SampleScheduler(const SampleScheduler&) = delete;
+
+  ~SampleScheduler()
+  {
+    stop();
+  }
+
+  void start()
+  {
+    _start = Clock::now();
+    _stopped = false;
+    _thread = std::thread([this]() { run(); });
+  }
+
+  void stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopped = true;
+    }
+    _wakeUp.notify_all();
+    if (_thread.joinable())
+    {
+      _thread.join();
+    }
+  }
+
+  /// The sampling break of the last interrupt was handled: next tick can interrupt again.
+  /// Returns the timestamp of the sample.
+  uint64_t acknowledge()
+  {
+    const auto timestamp = now();
+    _pending = false;
+    ++_samples;
+    return timestamp;
+  }
+
+  /// Nanoseconds since start().
+  uint64_t now() const
+  {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _start).count());
+  }
+
+  Clock::duration period() const { return _period; }
+  uint64_t interrupts() const { return _interrupts; }     ///< Successful interrupt() calls
+  uint64_t skipped() const { return _skipped; }           ///< Ticks lost while an interrupt was pending or the timer was late
+  uint64_t samples() const { return _samples; }           ///< Acknowledged samples
+
+private:
+  void run()
+  {
+#ifdef _WIN32
+    // Waits are rounded up to the timer resolution, 15.6ms by default: -sample-hz 1000 would tick at 64Hz
+    timeBeginPeriod(1);
+#endif
+
+    auto deadline = _start + _period;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_wakeUp.wait_until(lock, deadline, [this]() { return _stopped; }))
+    {
+      lock.unlock();
+      if (_pending.exchange(true))
+      {
+        ++_skipped;
+      }
+      else if (_interrupt())
+      {
+        ++_interrupts;
+      }
+      else
+      {
+        // No break will come to acknowledge this tick
+        _pending = false;
+      }
+      lock.lock();
+
+      // Late timer (system under load): restart from now instead of firing the missed ticks in a burst
+      deadline += _period;
+      const auto late = Clock::now() - deadline;
+      if (late > _period)
+      {
+        const auto missed = late / _period;
+        _skipped += static_cast<uint64_t>(missed);
+        deadline += _period * missed;
+      }
+    }
+
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+  }
+
+  const Clock::duration _period;
+  std::function<bool()> _interrupt;
+  Clock::time_point _start;
+  std::thread _thread;
+  std::mutex _mutex;
+  std::condition_variable _wakeUp;
+  bool _stopped = false;
+  std::atomic<bool> _pending = false;
+  std::atomic<uint64_t> _interrupts = 0;
+  std::atomic<uint64_t> _skipped = 0;
+  std::atomic<uint64_t> _samples = 0;
+};
@@ -0,0 +1,383 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+/// Stack walker of the profiler sampling, for the threads of a stopped target:
+/// - the stack is read once, as a window above the stack pointer, instead of a target memory read per frame value,
+/// - x64 frames are unwound with the .pdata / UNWIND_INFO of their PE module, parsed once per module and function,
+/// - frames without unwind data (x86, generated code) follow the frame pointer chain.
+/// Epilogs are not simulated: a sample stopped in an epilog may lose its caller frames.
+class StackUnwinder
+{
+public:
+  /// Read \p size bytes of target memory at \p address: false unless all bytes were read.
+  using ReadMemory = std::function<bool(uint64_t address, void* buffer, size_t size)>;
+
+  static constexpr size_t StackWindow = 64 * 1024;
+
+  /// Integer registers in x64 encoding order (rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi, r8-r15); x86 uses rsp and rbp.
+  struct Context
+  {
+    static constexpr int Sp = 4;
+    static constexpr int Fp = 5;
+
+    uint64_t ip = 0;
+    uint64_t regs[16] = {};
+  };
+
+  struct Stats
+  {
+    uint64_t unwindFrames = 0;    ///< Frames unwound with .pdata
+    uint64_t chainFrames = 0;     ///< Frames unwound with the frame pointer
+    uint64_t windowMisses = 0;    ///< Stack values read outside the window
+
+    Stats& operator+=(const Stats& other)
+    {
+      unwindFrames += other.unwindFrames;
+      chainFrames += other.chainFrames;
+      windowMisses += other.windowMisses;
+      return *this;
+    }
+  };
+
+  /// \param[in] is64: x64 target (8 bytes pointers, .pdata), otherwise x86.
+  StackUnwinder(ReadMemory read, bool is64 = sizeof(void*) == 8) :
+    _read(std::move(read)),
+    _pointerSize(is64 ? 8 : 4)
+  {}
+
+  /// A PE image is mapped at \p base. Its unwind data is read on the first frame in it.
+  void addModule(uint64_t base)
+  {
+    uint8_t dos[0x40];
+    uint32_t sizeOfImage;
+    uint32_t ntHeader;
+    if (!_read(base, dos, sizeof(dos)) || dos[0] != 'M' || dos[1] != 'Z')
+    {
+      return;
+    }
+    std::memcpy(&ntHeader, dos + 0x3C, 4);
+    // Optional header after the signature and the file header; SizeOfImage at the same offset in PE32 and PE32+
+    if (!_read(base + ntHeader + 24 + 56, &sizeOfImage, 4))
+    {
+      return;
+    }
+
+    auto& module = _modules[base];
+    module = Module();
+    module.end = base + sizeOfImage;
+    module.ntHeader = ntHeader;
+  }
+
+  void removeModule(uint64_t base)
+  {
+    _modules.erase(base);
+  }
+
+  /// Return addresses of the stack of \p context into \p pcs, innermost first, starting with the current ip.
+  size_t unwind(Context context, uint64_t* pcs, size_t maxDepth)
+  {
+    if (maxDepth == 0)
+    {
+      return 0;
+    }
+
+    readWindow(context.regs[Context::Sp]);
+
+    size_t depth = 0;
+    pcs[depth++] = context.ip;
+    while (depth < maxDepth)
+    {
+      const auto sp = context.regs[Context::Sp];
+      if (!step(context) || context.ip == 0 || context.regs[Context::Sp] <= sp)
+      {
+        break;
+      }
+      pcs[depth++] = context.ip;
+    }
+    return depth;
+  }
+
+  const Stats& stats() const { return _stats; }
+
+private:
+  // UNWIND_CODE operations
+  enum : uint8_t
+  {
+    PushNonvol = 0, AllocLarge = 1, AllocSmall = 2, SetFpreg = 3, SaveNonvol = 4, SaveNonvolFar = 5,
+    Epilog = 6, SpareCode = 7, SaveXmm128 = 8, SaveXmm128Far = 9, PushMachframe = 10
+  };
+  static constexpr uint8_t FlagChainInfo = 0x4;
+
+  struct Function
+  {
+    uint32_t begin;
+    uint32_t end;
+    uint32_t unwindInfo;
+  };
+
+  struct Module
+  {
+    uint64_t end = 0;
+    uint32_t ntHeader = 0;
+    bool parsed = false;
+    std::vector<Function> functions;                              ///< .pdata, sorted by begin
+    std::unordered_map<uint32_t, std::vector<uint8_t>> unwindInfos; ///< By RVA: header, codes, chained function
+  };
+
+  void readWindow(uint64_t sp)
+  {
+    // Shrink the window when the stack ends before its end (no page of the range must be unreadable)
+    _windowBase = sp;
+    for (size_t size = StackWindow; size >= 512; size /= 2)
+    {
+      _window.resize(size);
+      if (_read(sp, _window.data(), size))
+      {
+        return;
+      }
+    }
+    _window.clear();
+  }
+
+  bool readPointer(uint64_t address, uint64_t& value)
+  {
+    value = 0;
+    if (address >= _windowBase && address - _windowBase + _pointerSize <= _window.size())
+    {
+      std::memcpy(&value, _window.data() + (address - _windowBase), _pointerSize);
+      return true;
+    }
+    ++_stats.windowMisses;
+    return _read(address, &value, _pointerSize);
+  }
+
+  const Function* functionOf(uint64_t base, Module& module, uint32_t rva)
+  {
+    if (!module.parsed)
+    {
+      module.parsed = true;
+      parsePdata(base, module);
+    }
+
+    auto it = std::upper_bound(module.functions.begin(), module.functions.end(), rva,
+                               [](uint32_t value, const Function& function) { return value < function.begin; });
+    if (it == module.functions.begin() || rva >= (--it)->end)
+    {
+      return nullptr;
+    }
+    return &*it;
+  }
+
+  void parsePdata(uint64_t base, Module& module)
+  {
+    // PE32+ optional header: exception directory (index 3) of the data directories at offset 112
+    uint32_t directory[2];
+    if (!_read(base + module.ntHeader + 24 + 112 + 3 * 8, directory, sizeof(directory)) || directory[1] == 0)
+    {
+      return;
+    }
+
+    module.functions.resize(directory[1] / sizeof(Function));
+    if (!_read(base + directory[0], module.functions.data(), module.functions.size() * sizeof(Function)))
+    {
+      module.functions.clear();
+    }
+  }
+
+  const std::vector<uint8_t>* unwindInfoOf(uint64_t base, Module& module, uint32_t rva)
+  {
+    auto it = module.unwindInfos.find(rva);
+    if (it != module.unwindInfos.end())
+    {
+      return &it->second;
+    }
+
+    uint8_t header[4];
+    if (!_read(base + rva, header, sizeof(header)))
+    {
+      return nullptr;
+    }
+    const size_t codes = (header[2] + 1) & ~1;
+    std::vector<uint8_t> info(4 + codes * 2 + ((header[0] >> 3) & FlagChainInfo ? sizeof(Function) : 0));
+    if (!_read(base + rva, info.data(), info.size()))
+    {
+      return nullptr;
+    }
+    return &module.unwindInfos.emplace(rva, std::move(info)).first->second;
+  }
+
+  bool step(Context& context)
+  {
+    if (_pointerSize == 8)
+    {
+      auto it = _modules.upper_bound(context.ip);
+      if (it != _modules.begin() && context.ip < (--it)->second.end)
+      {
+        const auto rva = uint32_t(context.ip - it->first);
+        const auto function = functionOf(it->first, it->second, rva);
+        // Without entry in the .pdata of the module, a leaf function: no stack allocation, the return address is on top
+        if (function || !it->second.functions.empty())
+        {
+          const bool unwound = function ? unwindFunction(it->first, it->second, *function, rva, context) : popReturnAddress(context);
+          _stats.unwindFrames += unwound ? 1 : 0;
+          return unwound;
+        }
+      }
+    }
+
+    const bool unwound = followFramePointer(context);
+    _stats.chainFrames += unwound ? 1 : 0;
+    return unwound;
+  }
+
+  bool popReturnAddress(Context& context)
+  {
+    auto& sp = context.regs[Context::Sp];
+    if (!readPointer(sp, context.ip))
+    {
+      return false;
+    }
+    sp += _pointerSize;
+    return true;
+  }
+
+  bool followFramePointer(Context& context)
+  {
+    // [fp] = caller fp, [fp + pointer] = return address
+    const auto fp = context.regs[Context::Fp];
+    uint64_t callerFp, ip;
+    if (fp < context.regs[Context::Sp] || !readPointer(fp, callerFp) || !readPointer(fp + _pointerSize, ip))
+    {
+      return false;
+    }
+    context.ip = ip;
+    context.regs[Context::Sp] = fp + 2 * _pointerSize;
+    context.regs[Context::Fp] = callerFp;
+    return true;
+  }
+
+  bool unwindFunction(uint64_t base, Module& module, Function function, uint32_t rva, Context& context)
+  {
+    auto& sp = context.regs[Context::Sp];
+    bool primary = true;
+    for (int chain = 0; chain < 32; ++chain)
+    {
+      const auto* info = unwindInfoOf(base, module, function.unwindInfo);
+      if (!info)
+      {
+        return false;
+      }
+
+      const uint8_t flags = (*info)[0] >> 3;
+      const uint8_t version = (*info)[0] & 7;
+      const uint8_t prologSize = (*info)[1];
+      const uint8_t count = (*info)[2];
+      const uint8_t frameRegister = (*info)[3] & 0xF;
+      const uint64_t frameOffset = uint64_t((*info)[3] >> 4) * 16;
+
+      // In the prolog, only the operations done before the ip are undone
+      const uint32_t offset = rva - function.begin;
+      const bool inProlog = primary && offset < prologSize;
+
+      // Frame base of the SAVE_* offsets: the stack pointer after the prolog, or the frame register
+      uint64_t frame = sp;
+      for (size_t i = 0; i < count && frameRegister != 0; ++i)
+      {
+        if (((*info)[4 + i * 2 + 1] & 0xF) == SetFpreg && (!inProlog || (*info)[4 + i * 2] <= offset))
+        {
+          frame = context.regs[frameRegister] - frameOffset;
+        }
+      }
+
+      for (size_t i = 0; i < count;)
+      {
+        const uint8_t codeOffset = (*info)[4 + i * 2];
+        const uint8_t op = (*info)[4 + i * 2 + 1] & 0xF;
+        const uint8_t opInfo = (*info)[4 + i * 2 + 1] >> 4;
+        const auto slot = [&](size_t index)
+        {
+          uint16_t value;
+          std::memcpy(&value, info->data() + 4 + (i + index) * 2, 2);
+          return uint32_t(value);
+        };
+
+        size_t slots = 1;
+        switch (op)
+        {
+          case AllocLarge: slots = opInfo == 0 ? 2 : 3; break;
+          case SaveNonvol: case SaveXmm128: slots = 2; break;
+          case SaveNonvolFar: case SaveXmm128Far: slots = 3; break;
+          case Epilog: slots = version >= 2 ? 1 : 2; break;
+          case SpareCode: slots = 3; break;
+        }
+
+        if (!inProlog || codeOffset <= offset)
+        {
+          switch (op)
+          {
+            case PushNonvol:
+              if (!readPointer(sp, context.regs[opInfo]))
+              {
+                return false;
+              }
+              sp += 8;
+              break;
+            case AllocLarge:
+              sp += opInfo == 0 ? uint64_t(slot(1)) * 8 : (uint64_t(slot(1)) | (uint64_t(slot(2)) << 16));
+              break;
+            case AllocSmall:
+              sp += uint64_t(opInfo) * 8 + 8;
+              break;
+            case SetFpreg:
+              sp = frame;
+              break;
+            case SaveNonvol:
+              readPointer(frame + uint64_t(slot(1)) * 8, context.regs[opInfo]);
+              break;
+            case SaveNonvolFar:
+              readPointer(frame + (uint64_t(slot(1)) | (uint64_t(slot(2)) << 16)), context.regs[opInfo]);
+              break;
+            case PushMachframe:
+            {
+              // Interrupt / exception frame: ip and sp are restored from it, no return address to pop
+              uint64_t ip, callerSp;
+              if (!readPointer(sp + (opInfo ? 8 : 0), ip) || !readPointer(sp + (opInfo ? 32 : 24), callerSp))
+              {
+                return false;
+              }
+              context.ip = ip;
+              sp = callerSp;
+              return true;
+            }
+          }
+        }
+        i += slots;
+      }
+
+      if ((flags & FlagChainInfo) == 0)
+      {
+        break;
+      }
+
+      // Chained: the unwind codes of the parent function apply as well, all of them
+      std::memcpy(&function, info->data() + 4 + ((count + 1) & ~1) * 2, sizeof(Function));
+      primary = false;
+    }
+
+    return popReturnAddress(context);
+  }
+
+  ReadMemory _read;
+  size_t _pointerSize;
+  std::map<uint64_t, Module> _modules;      ///< By base address
+  uint64_t _windowBase = 0;
+  std::vector<uint8_t> _window;
+  Stats _stats;
+};
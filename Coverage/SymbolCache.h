@@ -0,0 +1,94 @@
+#pragma once
+
+#include "CallingContextTree.h"
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+
+/// Memo of the profiler symbolization: program counter -> interned frame (function, file, line) of the code under
+/// test, or NoFrame when the PC has no line or is outside the profiled paths.
+/// PCs are cached per module so the entries go away with the module. Modules without any profiled source line
+/// (system DLLs, binaries without symbols) are cached as a whole: their PCs are never resolved.
+class SymbolCache
+{
+public:
+  using FrameId = CallingContextTree::FrameId;
+
+  static constexpr FrameId NoFrame = ~FrameId(0);
+
+  struct Stats
+  {
+    uint64_t lookups = 0;
+    uint64_t hits = 0;        ///< Found in the PC cache
+    uint64_t skipped = 0;     ///< In a module without profiled code
+
+    Stats& operator+=(const Stats& other)
+    {
+      lookups += other.lookups;
+      hits += other.hits;
+      skipped += other.skipped;
+      return *this;
+    }
+  };
+
+  /// \param[in] profiled: the module has lines of the profiled sources.
+  void addModule(uint64_t base, uint64_t size, bool profiled)
+  {
+    auto& module = _modules[base];
+    module.end = base + size;
+    module.profiled = profiled;
+    module.frames.clear();
+  }
+
+  void removeModule(uint64_t base)
+  {
+    _modules.erase(base);
+    // PCs outside known modules may have belonged to it
+    _unknown.clear();
+  }
+
+  /// Frame of \p pc; on a cache miss, \p resolve(pc) gives it (NoFrame if not profiled).
+  template <typename Resolve>
+  FrameId lookup(uint64_t pc, Resolve&& resolve)
+  {
+    ++_stats.lookups;
+
+    auto* frames = &_unknown;
+    auto module = _modules.upper_bound(pc);
+    if (module != _modules.begin() && pc < (--module)->second.end)
+    {
+      if (!module->second.profiled)
+      {
+        ++_stats.skipped;
+        return NoFrame;
+      }
+      frames = &module->second.frames;
+    }
+
+    auto it = frames->find(pc);
+    if (it != frames->end())
+    {
+      ++_stats.hits;
+      return it->second;
+    }
+
+    const FrameId frame = resolve(pc);
+    frames->emplace(pc, frame);
+    return frame;
+  }
+
+  const Stats& stats() const { return _stats; }
+
+private:
+  struct Module
+  {
+    uint64_t end = 0;
+    bool profiled = false;
+    std::unordered_map<uint64_t, FrameId> frames;
+  };
+
+  std::map<uint64_t, Module> _modules;                ///< By base address
+  std::unordered_map<uint64_t, FrameId> _unknown;     ///< PCs outside the registered modules (generated code...)
+  Stats _stats;
+};
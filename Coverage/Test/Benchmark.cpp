@@ -0,0 +1,316 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "FastBase64.h"
+#include "FileCallbackInfo.h"
+#include "MergeKernel.h"
+#include "MergeRunnerV2.h"
+
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <random>
+#include <streambuf>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+// Benchmarks are ignored by default: run them explicitly (Release build) from the Test Explorer.
+namespace Benchmark
+{
+	/// Stream buffer which only counts the written bytes (we measure formatting, not the disk).
+	class CountingBuffer : public std::streambuf
+	{
+	public:
+		size_t count = 0;
+
+	protected:
+		int_type overflow(int_type c) override
+		{
+			++count;
+			return c;
+		}
+
+		std::streamsize xsputn(const char_type*, std::streamsize n) override
+		{
+			count += static_cast<size_t>(n);
+			return n;
+		}
+	};
+
+	class Chrono
+	{
+		std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+	public:
+		double elapsedMs() const
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+		}
+	};
+
+	inline void Report(const std::string& name, double ms, size_t bytes)
+	{
+		Logger::WriteMessage(std::format("{0}: {1:.1f} ms, {2} bytes ({3:.1f} MB/s)\n", name, ms, bytes, (bytes / (1024.0 * 1024.0)) / (ms / 1000.0)).c_str());
+	}
+
+	TEST_CLASS(BenchmarkReport)
+	{
+		static constexpr size_t NbFiles = 50000;
+		static constexpr size_t NbLinesPerFile = 400; // 20M lines
+
+		static FileCallbackInfo* fileCallbackInfo;
+
+	public:
+		TEST_CLASS_INITIALIZE(Setup)
+		{
+			auto& options = RuntimeOptions::Instance();
+			options.CodePaths.push_back("C:\\proj\\src\\");
+			options._verboseLevel = VerboseLevel::None;
+
+			fileCallbackInfo = new FileCallbackInfo("report.txt");
+			for (size_t f = 0; f < NbFiles; ++f)
+			{
+				const auto filename = std::format("C:\\proj\\src\\module{0}\\file{1}.cpp", f / 100, f);
+				auto info = std::make_unique<FileInfo>(filename);
+				info->numberLines = NbLinesPerFile;
+				info->relevant.assign(NbLinesPerFile, true);
+				info->lines.resize(NbLinesPerFile);
+				for (size_t i = 0; i < NbLinesPerFile; ++i)
+				{
+					// Mix of non-code, uncovered, partial and covered lines
+					auto& line = info->lines[i];
+					line.DebugCount = (i % 3 == 0) ? 0 : 2;
+					line.HitCount = (i % 5 == 0) ? 0 : static_cast<uint16_t>(i % 3);
+				}
+				fileCallbackInfo->lineData[filename] = std::move(info);
+			}
+		}
+
+		TEST_CLASS_CLEANUP(CleanUp)
+		{
+			delete fileCallbackInfo;
+			fileCallbackInfo = nullptr;
+
+			auto& options = RuntimeOptions::Instance();
+			options.CodePaths.clear();
+			options._verboseLevel = VerboseLevel::Trace;
+		}
+
+		void Run(const std::string& name, RuntimeOptions::ExportFormatType format)
+		{
+			FileCallbackInfo::MergedProfileInfoMap mergedProfileData;
+			CountingBuffer buffer;
+			std::ostream stream(&buffer);
+
+			Chrono chrono;
+			fileCallbackInfo->WriteReport(format, mergedProfileData, stream);
+			Report(name, chrono.elapsedMs(), buffer.count);
+		}
+
+		BEGIN_TEST_METHOD_ATTRIBUTE(WriteNative)
+			TEST_IGNORE()
+		END_TEST_METHOD_ATTRIBUTE()
+		TEST_METHOD(WriteNative)
+		{
+			Run("Native", RuntimeOptions::ExportFormatType::Native);
+		}
+
+		BEGIN_TEST_METHOD_ATTRIBUTE(WriteNativeV2)
+			TEST_IGNORE()
+		END_TEST_METHOD_ATTRIBUTE()
+		TEST_METHOD(WriteNativeV2)
+		{
+			Run("NativeV2", RuntimeOptions::ExportFormatType::NativeV2);
+		}
+
+		BEGIN_TEST_METHOD_ATTRIBUTE(WriteNativeV2Compact)
+			TEST_IGNORE()
+		END_TEST_METHOD_ATTRIBUTE()
+		TEST_METHOD(WriteNativeV2Compact)
+		{
+			RuntimeOptions::Instance().CompactLines = true;
+			Run("NativeV2 compact", RuntimeOptions::ExportFormatType::NativeV2);
+			RuntimeOptions::Instance().CompactLines = false;
+		}
+
+		BEGIN_TEST_METHOD_ATTRIBUTE(WriteCobertura)
+			TEST_IGNORE()
+		END_TEST_METHOD_ATTRIBUTE()
+		TEST_METHOD(WriteCobertura)
+		{
+			Run("Cobertura", RuntimeOptions::ExportFormatType::Cobertura);
+		}
+
+		BEGIN_TEST_METHOD_ATTRIBUTE(WriteClover)
+			TEST_IGNORE()
+		END_TEST_METHOD_ATTRIBUTE()
+		TEST_METHOD(WriteClover)
+		{
+			Run("Clover", RuntimeOptions::ExportFormatType::Clover);
+		}
+	};
+
+	FileCallbackInfo* BenchmarkReport::fileCallbackInfo = nullptr;
+
+	TEST_CLASS(BenchmarkBase64)
+	{
+		static constexpr size_t Size = 64 * 1024 * 1024;
+		static constexpr size_t Repeat = 10;
+
+		static std::string MakeData()
+		{
+			std::mt19937 random(42);
+			std::string data(Size, '\0');
+			for (auto& c : data)
+			{
+				c = static_cast<char>(random());
+			}
+			return data;
+		}
+
+	public:
+		BEGIN_TEST_METHOD_ATTRIBUTE(Encode)
+			TEST_IGNORE()
+		END_TEST_METHOD_ATTRIBUTE()
+		TEST_METHOD(Encode)
+		{
+			const auto data = MakeData();
+			std::string encoded(FastBase64::EncodedLength(Size), '\0');
+			{
+				Chrono chrono;
+				for (size_t i = 0; i < Repeat; ++i)
+				{
+					encoded = Base64::Encode(data);
+				}
+				Report("Base64::Encode", chrono.elapsedMs(), Size * Repeat);
+			}
+			for (const auto isa : { FastBase64::Isa::Scalar, FastBase64::Isa::SSSE3, FastBase64::Isa::AVX2 })
+			{
+				if (isa > FastBase64::Supported())
+					continue;
+				Chrono chrono;
+				for (size_t i = 0; i < Repeat; ++i)
+				{
+					FastBase64::Encode(reinterpret_cast<const uint8_t*>(data.data()), Size, encoded.data(), isa);
+				}
+				Report(std::format("FastBase64::Encode isa={0}", static_cast<int>(isa)), chrono.elapsedMs(), Size * Repeat);
+			}
+		}
+
+		BEGIN_TEST_METHOD_ATTRIBUTE(Decode)
+			TEST_IGNORE()
+		END_TEST_METHOD_ATTRIBUTE()
+		TEST_METHOD(Decode)
+		{
+			const auto encoded = Base64::Encode(MakeData());
+			std::string decoded;
+			{
+				Chrono chrono;
+				for (size_t i = 0; i < Repeat; ++i)
+				{
+					Base64::Decode(encoded, decoded);
+				}
+				Report("Base64::Decode", chrono.elapsedMs(), Size * Repeat);
+			}
+			for (const auto isa : { FastBase64::Isa::Scalar, FastBase64::Isa::SSSE3, FastBase64::Isa::AVX2 })
+			{
+				if (isa > FastBase64::Supported())
+					continue;
+				Chrono chrono;
+				for (size_t i = 0; i < Repeat; ++i)
+				{
+					FastBase64::Decode(encoded, reinterpret_cast<uint8_t*>(decoded.data()), isa);
+				}
+				Report(std::format("FastBase64::Decode isa={0}", static_cast<int>(isa)), chrono.elapsedMs(), Size * Repeat);
+			}
+		}
+	};
+
+	TEST_CLASS(BenchmarkMergeV2)
+	{
+		static constexpr size_t NbFiles = 100000;
+		static constexpr size_t NbLinesPerFile = 400;
+
+		static void WriteReport(const std::filesystem::path& path, uint16_t hits)
+		{
+			FileCoverageV2 coverage(NbLinesPerFile);
+			for (size_t i = 0; i < NbLinesPerFile; ++i)
+			{
+				coverage._code[i] = (i % 3 == 0) ? 0 : static_cast<uint16_t>(FileCoverageV2::maskIsCode | ((i * hits) % 7));
+			}
+			coverage.updateStats();
+			coverage.md5Code = "0123456789ABCDEFGHIJKLMNOPQRSTUV";
+
+			std::ofstream ofs;
+			ReportEmitter::OpenUnbuffered(ofs, path.string());
+			ReportEmitter out(ofs);
+			FileCoverageV2::writeHeader(out);
+			FileCoverageV2::openDirectory(out, "C:\\proj\\src\\");
+			for (size_t f = 0; f < NbFiles; ++f)
+			{
+				coverage.write(std::format("module{0}\\file{1}.cpp", f / 100, f), out);
+			}
+			FileCoverageV2::closeDirectory(out);
+			FileCoverageV2::writeFooter(out);
+		}
+
+	public:
+		BEGIN_TEST_METHOD_ATTRIBUTE(Merge100kFiles)
+			TEST_IGNORE()
+		END_TEST_METHOD_ATTRIBUTE()
+		TEST_METHOD(Merge100kFiles)
+		{
+			const auto dir = std::filesystem::temp_directory_path();
+			const auto output = dir / "benchmark_output.cov";
+			const auto merged = dir / "benchmark_merged.cov";
+			WriteReport(output, 1);
+			WriteReport(merged, 3);
+
+			auto options = RuntimeOptions::Instance();
+			options.ExportFormat = RuntimeOptions::NativeV2;
+			options.OutputFile = output.string();
+			options.MergedOutput = merged.string();
+
+			Chrono chrono;
+			MergeRunnerV2 runner(options);
+			runner.execute();
+			Report("MergeRunnerV2 (100k files)", chrono.elapsedMs(), static_cast<size_t>(std::filesystem::file_size(merged)));
+
+			std::filesystem::remove(output);
+			std::filesystem::remove(merged);
+		}
+	};
+
+	TEST_CLASS(BenchmarkMergeKernel)
+	{
+		static constexpr size_t Size = 32 * 1024 * 1024;
+		static constexpr size_t Repeat = 10;
+
+	public:
+		BEGIN_TEST_METHOD_ATTRIBUTE(Merge)
+			TEST_IGNORE()
+		END_TEST_METHOD_ATTRIBUTE()
+		TEST_METHOD(Merge)
+		{
+			std::mt19937 random(42);
+			std::vector<uint16_t> a(Size), b(Size), out(Size);
+			for (size_t i = 0; i < Size; ++i)
+			{
+				a[i] = static_cast<uint16_t>(random());
+				b[i] = static_cast<uint16_t>(random());
+			}
+
+			for (const auto isa : { MergeKernel::Isa::Scalar, MergeKernel::Isa::SSE2, MergeKernel::Isa::AVX2 })
+			{
+				if (isa > MergeKernel::Supported())
+					continue;
+				size_t covered = 0;
+				Chrono chrono;
+				for (size_t i = 0; i < Repeat; ++i)
+				{
+					covered += MergeKernel::Merge(a.data(), b.data(), out.data(), Size, isa);
+				}
+				Report(std::format("MergeKernel::Merge isa={0} (covered {1})", static_cast<int>(isa), covered), chrono.elapsedMs(), Size * Repeat * sizeof(uint16_t));
+			}
+		}
+	};
+}
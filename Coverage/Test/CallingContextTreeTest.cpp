@@ -0,0 +1,133 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "CallingContextTree.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestCallingContextTree)
+	{
+	public:
+
+		TEST_METHOD(InternFrames)
+		{
+			CallingContextTree tree;
+			const auto main10 = tree.intern("main", "a.cpp", 10);
+			const auto foo3 = tree.intern("foo", "b.cpp", 3);
+			Assert::IsTrue(main10 != foo3);
+			Assert::AreEqual(main10, tree.intern("main", "a.cpp", 10));
+			Assert::IsTrue(main10 != tree.intern("main", "a.cpp", 11));
+
+			const auto& frame = tree.frame(foo3);
+			Assert::AreEqual(std::string("foo"), tree.function(frame.function));
+			Assert::AreEqual(std::string("b.cpp"), tree.file(frame.file));
+			Assert::AreEqual(uint32_t(3), frame.line);
+		}
+
+		TEST_METHOD(RecordPaths)
+		{
+			CallingContextTree tree;
+			const auto main10 = tree.intern("main", "a.cpp", 10);
+			const auto main12 = tree.intern("main", "a.cpp", 12);
+			const auto foo3 = tree.intern("foo", "b.cpp", 3);
+
+			const CallingContextTree::FrameId first[] = { main10, foo3 };
+			const CallingContextTree::FrameId second[] = { main12, foo3 };
+			tree.record(first, 2);
+			tree.record(first, 2);
+			tree.record(second, 2);
+			tree.record(first, 1);
+			tree.record(first, 0);
+
+			// Root, main:10, main:10 > foo:3, main:12, main:12 > foo:3: the call paths of foo are kept apart
+			Assert::AreEqual(size_t(5), tree.size());
+			Assert::AreEqual(uint64_t(4), tree.samples());
+
+			uint64_t fooInclusive = 0, fooExclusive = 0, main10Inclusive = 0, main10Exclusive = 0;
+			for (CallingContextTree::NodeId id = 1; id < tree.size(); ++id)
+			{
+				const auto& node = tree.node(id);
+				if (node.frame == foo3)
+				{
+					Assert::IsTrue(CallingContextTree::Root != node.parent);
+					fooInclusive += node.inclusive;
+					fooExclusive += node.exclusive;
+				}
+				else if (node.frame == main10)
+				{
+					Assert::AreEqual(CallingContextTree::Root, node.parent);
+					main10Inclusive = node.inclusive;
+					main10Exclusive = node.exclusive;
+				}
+			}
+			Assert::AreEqual(uint64_t(3), fooInclusive);
+			Assert::AreEqual(uint64_t(3), fooExclusive);
+			Assert::AreEqual(uint64_t(3), main10Inclusive);
+			Assert::AreEqual(uint64_t(1), main10Exclusive);
+		}
+
+		TEST_METHOD(ManyChildren)
+		{
+			// Grows the open-addressing table many times
+			CallingContextTree tree;
+			const auto root = tree.intern("main", "a.cpp", 1);
+			for (int repeat = 0; repeat < 2; ++repeat)
+			{
+				for (uint32_t line = 1; line <= 5000; ++line)
+				{
+					const CallingContextTree::FrameId stack[] = { root, tree.intern("f", "a.cpp", line) };
+					tree.record(stack, 2);
+				}
+			}
+
+			Assert::AreEqual(size_t(5002), tree.size());
+			Assert::AreEqual(uint64_t(10000), tree.samples());
+			for (CallingContextTree::NodeId id = 2; id < tree.size(); ++id)
+			{
+				Assert::AreEqual(uint64_t(2), tree.node(id).exclusive);
+			}
+		}
+
+		TEST_METHOD(DeriveLines)
+		{
+			CallingContextTree tree;
+			const auto main10 = tree.intern("main", "a.cpp", 10);
+			const auto foo3 = tree.intern("foo", "b.cpp", 3);
+			const auto foo4 = tree.intern("foo", "b.cpp", 4);
+
+			const CallingContextTree::FrameId first[] = { main10, foo3 };
+			const CallingContextTree::FrameId second[] = { main10, foo4 };
+			tree.record(first, 2);
+			tree.record(first, 2);
+			tree.record(first, 2);
+			tree.record(second, 2);
+
+			std::unordered_map<std::string, std::unique_ptr<std::vector<ProfileInfo>>> merged;
+			Assert::AreEqual(uint64_t(8), tree.lines(merged));
+			Assert::AreEqual(size_t(2), merged.size());
+
+			const auto& a = *merged["a.cpp"];
+			Assert::AreEqual(size_t(11), a.size());
+			Assert::AreEqual(uint64_t(4), a[10].DeepSamples);
+			Assert::AreEqual(uint64_t(0), a[10].ShallowSamples);
+			Assert::AreEqual(50.0f, a[10].Deep);
+			Assert::AreEqual(0.0f, a[10].Shallow);
+
+			// Shallow percentages are relative to the function
+			const auto& b = *merged["b.cpp"];
+			Assert::AreEqual(size_t(5), b.size());
+			Assert::AreEqual(uint64_t(3), b[3].DeepSamples);
+			Assert::AreEqual(uint64_t(3), b[3].ShallowSamples);
+			Assert::AreEqual(37.5f, b[3].Deep);
+			Assert::AreEqual(75.0f, b[3].Shallow);
+			Assert::AreEqual(25.0f, b[4].Shallow);
+		}
+	};
+}
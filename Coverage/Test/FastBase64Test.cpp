@@ -0,0 +1,73 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "FastBase64.h"
+
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestFastBase64)
+	{
+	public:
+
+		/// Every instruction set usable on this machine.
+		static std::vector<FastBase64::Isa> Isas()
+		{
+			std::vector<FastBase64::Isa> isas = { FastBase64::Isa::Scalar };
+			if (FastBase64::Supported() >= FastBase64::Isa::SSSE3)
+				isas.push_back(FastBase64::Isa::SSSE3);
+			if (FastBase64::Supported() >= FastBase64::Isa::AVX2)
+				isas.push_back(FastBase64::Isa::AVX2);
+			return isas;
+		}
+
+		TEST_METHOD(SameAsBase64)
+		{
+			std::mt19937 random(42);
+			// All tail sizes around the 12/24 bytes SIMD blocks
+			for (size_t size = 0; size < 200; ++size)
+			{
+				std::string data(size, '\0');
+				for (auto& c : data)
+				{
+					c = static_cast<char>(random());
+				}
+				const std::string reference = Base64::Encode(data);
+
+				for (const auto isa : Isas())
+				{
+					std::string encoded(FastBase64::EncodedLength(size), '\0');
+					FastBase64::Encode(reinterpret_cast<const uint8_t*>(data.data()), size, encoded.data(), isa);
+					Assert::AreEqual(reference, encoded);
+
+					std::string decoded(FastBase64::DecodedLength(reference), '\0');
+					Assert::AreEqual(size, decoded.size());
+					FastBase64::Decode(reference, reinterpret_cast<uint8_t*>(decoded.data()), isa);
+					Assert::AreEqual(data, decoded);
+				}
+			}
+		}
+
+		TEST_METHOD(RejectInvalid)
+		{
+			std::string encoded = Base64::Encode(std::string(96, 'x'));
+			encoded[60] = '*';
+
+			std::string decoded(FastBase64::DecodedLength(encoded), '\0');
+			for (const auto isa : Isas())
+			{
+				Assert::ExpectException<std::runtime_error>([&]()
+				{
+					FastBase64::Decode(encoded, reinterpret_cast<uint8_t*>(decoded.data()), isa);
+				});
+			}
+			Assert::ExpectException<std::runtime_error>([]() { FastBase64::DecodedLength("abc"); });
+		}
+	};
+}
@@ -1,8 +1,13 @@
 #include "CppUnitTest.h"
 #include <SDKDDKVer.h>
 
+#include "CallingContextTree.h"
 #include "FileCallbackInfo.h"
 #include "FileSystem.h"
+#include "MergeRunnerV1.h"
+
+#include <filesystem>
+#include <fstream>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -132,17 +137,17 @@ namespace TestFileCallbackInfo
 		TEST_METHOD(WriteReportNativeWithoutProfileData)
 		{
 			const std::string expectReport =
-				"FILE: C:\\proj\\src\\srcFile.cpp\n" \
-				"RES: cp_up\n" \
-				"PROF: \n" \
-				"FILE: C:\\proj\\src\\srcFile.h\n" \
-				"RES: cc\n" \
-				"PROF: \n" \
 				"FILE: C:\\proj\\lib\\libFile.cpp\n" \
 				"RES: uuu\n" \
 				"PROF: \n" \
 				"FILE: C:\\proj\\lib\\libFile.h\n" \
 				"RES: ppu\n" \
+				"PROF: \n" \
+				"FILE: C:\\proj\\src\\srcFile.cpp\n" \
+				"RES: cp_up\n" \
+				"PROF: \n" \
+				"FILE: C:\\proj\\src\\srcFile.h\n" \
+				"RES: cc\n" \
 				"PROF: \n";
 
 			FileCallbackInfo::MergedProfileInfoMap mergedProfileData;
@@ -156,17 +161,7 @@ namespace TestFileCallbackInfo
 		{
 			const std::string expectReport =
 				R"(<?xml version="1.0" encoding="utf-8"?>)""\n" \
-				R"(<CppCoverage version="2.0">)""\n" \
-				R"(	<directory path="C:\proj\src\">)""\n" \
-				R"(		<file path="srcFile.cpp" md5="a2bab6536c40355d0adbca65a76d94aa">)""\n" \
-				R"(			<stats nbLinesInFile="5" nbLinesOfCode="4" nbLinesCovered="3"/>)""\n" \
-				R"(			<coverage>BIACwAAAAIACwA==</coverage>)""\n" \
-				R"(		</file>)""\n" \
-				R"(		<file path="srcFile.h" md5="311f4a819681297456bb96840218f676">)""\n" \
-				R"(			<stats nbLinesInFile="2" nbLinesOfCode="2" nbLinesCovered="2"/>)""\n" \
-				R"(			<coverage>BoADgA==</coverage>)""\n" \
-				R"(		</file>)""\n" \
-				R"(	</directory>)""\n" \
+				R"(<CppCoverage version="2.0" layout="sorted">)""\n" \
 				R"(	<directory path="C:\proj\lib\">)""\n" \
 				R"(		<file path="libFile.cpp" md5="a4eabc0c3e65e7df3a3bb1ccc1adcd9f">)""\n" \
 				R"(			<stats nbLinesInFile="3" nbLinesOfCode="3" nbLinesCovered="0"/>)""\n" \
@@ -177,6 +172,16 @@ namespace TestFileCallbackInfo
 				R"(			<coverage>DMAHwACA</coverage>)""\n" \
 				R"(		</file>)""\n" \
 				R"(	</directory>)""\n" \
+				R"(	<directory path="C:\proj\src\">)""\n" \
+				R"(		<file path="srcFile.cpp" md5="a2bab6536c40355d0adbca65a76d94aa">)""\n" \
+				R"(			<stats nbLinesInFile="5" nbLinesOfCode="4" nbLinesCovered="3"/>)""\n" \
+				R"(			<coverage>BIACwAAAAIACwA==</coverage>)""\n" \
+				R"(		</file>)""\n" \
+				R"(		<file path="srcFile.h" md5="311f4a819681297456bb96840218f676">)""\n" \
+				R"(			<stats nbLinesInFile="2" nbLinesOfCode="2" nbLinesCovered="2"/>)""\n" \
+				R"(			<coverage>BoADgA==</coverage>)""\n" \
+				R"(		</file>)""\n" \
+				R"(	</directory>)""\n" \
 				R"(</CppCoverage>)""\n";
 
 			FileCallbackInfo::MergedProfileInfoMap mergedProfileData;  // it doesn't matter, can be empty
@@ -194,20 +199,6 @@ namespace TestFileCallbackInfo
 				R"(	<packages>)""\n" \
 				R"(		<package name="MyPackage.exe" line-rate="0.25">)""\n" \
 				R"(			<classes>)""\n" \
-				R"(				<class name="srcFile.cpp" filename="\proj\src\srcFile.cpp" line-rate="0.25">)""\n" \
-				R"(					<lines>)""\n" \
-				R"(						<line number="1" hits="1"/>)""\n" \
-				R"(						<line number="2" hits="0"/>)""\n" \
-				R"(						<line number="4" hits="0"/>)""\n" \
-				R"(						<line number="5" hits="0"/>)""\n" \
-				R"(					</lines>)""\n" \
-				R"(				</class>)""\n" \
-				R"(				<class name="srcFile.h" filename="\proj\src\srcFile.h" line-rate="1">)""\n" \
-				R"(					<lines>)""\n" \
-				R"(						<line number="1" hits="1"/>)""\n" \
-				R"(						<line number="2" hits="1"/>)""\n" \
-				R"(					</lines>)""\n" \
-				R"(				</class>)""\n" \
 				R"(				<class name="libFile.cpp" filename="\proj\lib\libFile.cpp" line-rate="0">)""\n" \
 				R"(					<lines>)""\n" \
 				R"(						<line number="1" hits="0"/>)""\n" \
@@ -222,6 +213,20 @@ namespace TestFileCallbackInfo
 				R"(						<line number="3" hits="0"/>)""\n" \
 				R"(					</lines>)""\n" \
 				R"(				</class>)""\n" \
+				R"(				<class name="srcFile.cpp" filename="\proj\src\srcFile.cpp" line-rate="0.25">)""\n" \
+				R"(					<lines>)""\n" \
+				R"(						<line number="1" hits="1"/>)""\n" \
+				R"(						<line number="2" hits="0"/>)""\n" \
+				R"(						<line number="4" hits="0"/>)""\n" \
+				R"(						<line number="5" hits="0"/>)""\n" \
+				R"(					</lines>)""\n" \
+				R"(				</class>)""\n" \
+				R"(				<class name="srcFile.h" filename="\proj\src\srcFile.h" line-rate="1">)""\n" \
+				R"(					<lines>)""\n" \
+				R"(						<line number="1" hits="1"/>)""\n" \
+				R"(						<line number="2" hits="1"/>)""\n" \
+				R"(					</lines>)""\n" \
+				R"(				</class>)""\n" \
 				R"(			</classes>)""\n" \
 				R"(		</package>)""\n" \
 				R"(	</packages>)""\n" \
@@ -236,5 +241,57 @@ namespace TestFileCallbackInfo
 			fileCallbackInfo->WriteReport(RuntimeOptions::ExportFormatType::Cobertura, mergedProfileData, ss);
 			Assert::AreEqual(expectReport, ss.str());
 		}
+
+		TEST_METHOD(MergedProfileMatchesRun)
+		{
+			// Two runs, and one run with the samples of both: merging the reports of the two runs gives the report of the third
+			const std::string file = "C:\\proj\\src\\srcFile.cpp";
+			const auto sample = [&](CallingContextTree& tree, std::initializer_list<std::pair<const char*, uint32_t>> stack, uint64_t count)
+			{
+				std::vector<CallingContextTree::FrameId> frames;
+				for (const auto& [function, line] : stack)
+					frames.push_back(tree.intern(function, file, line));
+				for (uint64_t i = 0; i < count; ++i)
+					tree.record(frames.data(), frames.size());
+			};
+			const auto run = [&](CallingContextTree& tree, uint64_t a, uint64_t b, uint64_t c)
+			{
+				sample(tree, { { "main", 0 }, { "f", 1 } }, a);
+				sample(tree, { { "main", 0 }, { "f", 1 }, { "g", 3 } }, b);
+				// A lambda on the line of its function
+				sample(tree, { { "main", 0 }, { "h", 4 }, { "h::lambda", 4 } }, c);
+				sample(tree, { { "main", 0 }, { "h", 4 } }, 1);
+			};
+			CallingContextTree first, second, both;
+			run(first, 3, 7, 2);
+			run(second, 1, 2, 9);
+			run(both, 3, 7, 2);
+			run(both, 1, 2, 9);
+
+			const auto write = [&](const CallingContextTree& tree)
+			{
+				FileCallbackInfo::MergedProfileInfoMap profile;
+				const auto total = tree.lines(profile);
+				std::stringstream ss;
+				fileCallbackInfo->WriteReport(RuntimeOptions::ExportFormatType::Native, profile, ss, total);
+				return ss.str();
+			};
+			const auto expected = write(both);
+			Assert::IsTrue(expected.find("FUNC: ") != std::string::npos);
+
+			const auto firstPath = std::filesystem::temp_directory_path() / "fileCallbackInfo_first.cov";
+			const auto secondPath = std::filesystem::temp_directory_path() / "fileCallbackInfo_second.cov";
+			std::ofstream(firstPath, std::ios::binary) << write(first);
+			std::ofstream(secondPath, std::ios::binary) << write(second);
+
+			std::stringstream merged;
+			{
+				ReportEmitter out(merged);
+				MergeRunnerV1::mergeSorted(firstPath.string(), secondPath.string(), out);
+			}
+			std::filesystem::remove(firstPath);
+			std::filesystem::remove(secondPath);
+			Assert::AreEqual(expected, merged.str());
+		}
 	};
 }
\ No newline at end of file
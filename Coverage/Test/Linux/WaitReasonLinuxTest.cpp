@@ -0,0 +1,80 @@
+#include "WaitReason.h"
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+// Classify live threads blocked on a condition variable, a sleep, a pipe read and a poll.
+namespace
+{
+	int failures = 0;
+
+	void Check(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			std::fprintf(stderr, "FAILED: %s\n", what);
+			++failures;
+		}
+	}
+
+	bool Is(uint32_t pid, pid_t tid, WaitReason::Reason expected)
+	{
+		WaitReason::Reason reason;
+		return WaitReason::TaskReason(pid, uint32_t(tid), reason) && reason == expected;
+	}
+}
+
+int main()
+{
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool done = false;
+	int pipeFds[2];
+	if (pipe(pipeFds) != 0)
+	{
+		std::perror("pipe");
+		return 1;
+	}
+
+	std::atomic<pid_t> waiting{ 0 }, sleeping{ 0 }, reading{ 0 }, polling{ 0 };
+	std::thread waiter([&]() { waiting = gettid(); std::unique_lock<std::mutex> lock(mutex); condition.wait(lock, [&]() { return done; }); });
+	std::thread sleeper([&]() { sleeping = gettid(); std::this_thread::sleep_for(std::chrono::milliseconds(500)); });
+	std::thread reader([&]() { reading = gettid(); char c; (void)read(pipeFds[0], &c, 1); });
+	std::thread poller([&]() { polling = gettid(); pollfd fd = { pipeFds[0], POLLIN, 0 }; poll(&fd, 1, 500); });
+
+	// Give the threads time to block
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	const auto pid = uint32_t(getpid());
+	Check(Is(pid, waiting, WaitReason::Futex), "condition variable is a futex wait");
+	Check(Is(pid, sleeping, WaitReason::Sleep), "sleep_for is a sleep");
+	Check(Is(pid, reading, WaitReason::Read), "pipe read is a read");
+	Check(Is(pid, polling, WaitReason::Poll), "poll is a poll");
+
+	// Running, and gone
+	WaitReason::Reason reason;
+	Check(!WaitReason::TaskReason(pid, uint32_t(gettid()), reason), "running thread is not blocked");
+	Check(!WaitReason::TaskReason(pid, 0, reason), "unknown thread is not blocked");
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		done = true;
+	}
+	condition.notify_all();
+	(void)write(pipeFds[1], "x", 1);
+	waiter.join();
+	sleeper.join();
+	reader.join();
+	poller.join();
+	close(pipeFds[0]);
+	close(pipeFds[1]);
+
+	return failures == 0 ? 0 : 1;
+}
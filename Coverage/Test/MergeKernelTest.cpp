@@ -0,0 +1,111 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "FileCoverageV2.h"
+#include "MergeKernel.h"
+#include "TestHelpers.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestMergeKernel)
+	{
+	public:
+
+		/// Line by line merge, as FileCoverageV2::merge + updateStats used to do.
+		static size_t Reference(const std::vector<uint16_t>& a, const std::vector<uint16_t>& b, std::vector<uint16_t>& out)
+		{
+			size_t covered = 0;
+			out.resize(a.size());
+			for (size_t i = 0; i < a.size(); ++i)
+			{
+				const size_t count = (size_t) (a[i] & FileCoverageV2::maskCount) + (size_t) (b[i] & FileCoverageV2::maskCount);
+				const bool isCode = (a[i] & FileCoverageV2::maskIsCode) == FileCoverageV2::maskIsCode;
+				const bool isPartial = (a[i] & FileCoverageV2::maskIsPartial) == FileCoverageV2::maskIsPartial && (b[i] & FileCoverageV2::maskIsPartial) == FileCoverageV2::maskIsPartial;
+
+				out[i] = (uint16_t) std::min<size_t>(count, FileCoverageV2::maskCount);
+				out[i] |= isCode ? FileCoverageV2::maskIsCode : 0;
+				out[i] |= isPartial ? FileCoverageV2::maskIsPartial : 0;
+				if (isCode && (out[i] & FileCoverageV2::maskCount) > 0)
+					++covered;
+			}
+			return covered;
+		}
+
+		TEST_METHOD(SameAsReference)
+		{
+			std::mt19937 random(7);
+			// All tail sizes around 8/16 lines blocks, counts near saturation
+			for (size_t size = 0; size < 100; ++size)
+			{
+				std::vector<uint16_t> a(size), b(size);
+				for (size_t i = 0; i < size; ++i)
+				{
+					a[i] = static_cast<uint16_t>(random());
+					b[i] = static_cast<uint16_t>(random());
+					if (i % 3 == 0)
+						a[i] &= ~FileCoverageV2::maskCount;
+					if (i % 5 == 0)
+						b[i] |= 0x3F00;
+				}
+
+				std::vector<uint16_t> expected;
+				const size_t expectedCovered = Reference(a, b, expected);
+
+				for (const auto isa : Isas())
+				{
+					std::vector<uint16_t> out(size);
+					Assert::AreEqual(expectedCovered, MergeKernel::Merge(a.data(), b.data(), out.data(), size, isa));
+					Assert::IsTrue(expected == out);
+
+					// In place
+					auto inPlace = a;
+					Assert::AreEqual(expectedCovered, MergeKernel::Merge(inPlace.data(), b.data(), inPlace.data(), size, isa));
+					Assert::IsTrue(expected == inPlace);
+				}
+			}
+		}
+
+		TEST_METHOD(MinBytes)
+		{
+			const std::string states = "_cipu";
+			std::mt19937 random(11);
+			for (size_t size = 0; size < 100; ++size)
+			{
+				std::string a(size, ' '), b(size, ' '), expected(size, ' ');
+				for (size_t i = 0; i < size; ++i)
+				{
+					a[i] = states[random() % states.size()];
+					b[i] = states[random() % states.size()];
+					expected[i] = std::min(a[i], b[i]);
+				}
+
+				for (const auto isa : Isas())
+				{
+					auto dst = a;
+					MergeKernel::MinBytes(reinterpret_cast<uint8_t*>(dst.data()), reinterpret_cast<const uint8_t*>(b.data()), size, isa);
+					Assert::AreEqual(expected, dst);
+				}
+			}
+		}
+
+		TEST_METHOD(MergeSpan)
+		{
+			const auto c = FileCoverageV2::maskIsCode;
+			FileCoverageV2 coverage(3);
+			coverage._code = { 0, c, c | 2 };
+			const uint16_t mapped[] = { 5, c | 1, c | FileCoverageV2::maskCount };
+
+			Assert::IsTrue(coverage.merge(std::span<const uint16_t>(mapped)));
+			const FileCoverageV2::LineArray expected = { 5, c | 1, c | FileCoverageV2::maskCount };
+			Assert::IsTrue(expected == coverage._code);
+			Assert::AreEqual(size_t(2), coverage._nbLinesCovered);
+			Assert::IsFalse(coverage.merge(std::span<const uint16_t>(mapped, 2)));
+		}
+	};
+}
@@ -0,0 +1,190 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "MergeRunnerXml.h"
+#include "TestHelpers.h"
+
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestMergeRunnerXml)
+	{
+	public:
+
+		static std::string Cobertura(const std::string& lineRate, const std::string& classes)
+		{
+			return "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+				"<coverage line-rate=\"" + lineRate + "\" version=\"\">\n"
+				"\t<packages>\n"
+				"\t\t<package name=\"Program.exe\" line-rate=\"" + lineRate + "\">\n"
+				"\t\t\t<classes>\n" + classes +
+				"\t\t\t</classes>\n"
+				"\t\t</package>\n"
+				"\t</packages>\n"
+				"\t<sources>\n"
+				"\t\t<source>C:</source>\n"
+				"\t</sources>\n"
+				"</coverage>\n";
+		}
+
+		static std::string Write(const MergeRunnerXml::DictCoverage& dict, RuntimeOptions::ExportFormatType format)
+		{
+			std::ostringstream ss;
+			{
+				ReportEmitter out(ss);
+				MergeRunnerXml::write(dict, format, "Program.exe", out);
+			}
+			return ss.str();
+		}
+
+		TEST_METHOD(ReadCobertura)
+		{
+			const std::string content = Cobertura("0.5",
+				"\t\t\t\t<class name=\"a.cpp\" filename=\"\\proj\\a.cpp\" line-rate=\"0.5\">\n"
+				"\t\t\t\t\t<lines>\n"
+				"\t\t\t\t\t\t<line number=\"3\" hits=\"1\"/>\n"
+				"\t\t\t\t\t\t<line number=\"1\" hits=\"0\"/>\n"
+				"\t\t\t\t\t\t<line number=\"3\" hits=\"2\"/>\n"
+				"\t\t\t\t\t</lines>\n"
+				"\t\t\t\t</class>\n");
+
+			MergeRunnerXml::Reader reader(content, MergeRunnerXml::SchemaOf(RuntimeOptions::Cobertura));
+			std::string key;
+			MergeRunnerXml::FileLines file;
+			Assert::IsTrue(reader.next(key, file));
+			Assert::AreEqual(std::string("\\proj\\a.cpp"), key);
+			Assert::AreEqual(std::string("a.cpp"), file.name);
+
+			// Sorted by number, duplicates summed
+			Assert::AreEqual(size_t(2), file.lines.size());
+			Assert::AreEqual(size_t(1), file.lines[0].number);
+			Assert::AreEqual(uint64_t(0), file.lines[0].hits);
+			Assert::AreEqual(size_t(3), file.lines[1].number);
+			Assert::AreEqual(uint64_t(3), file.lines[1].hits);
+			Assert::AreEqual(size_t(1), file.covered);
+
+			Assert::IsFalse(reader.next(key, file));
+			Assert::AreEqual(size_t(1), reader.sources().size());
+			Assert::AreEqual(std::string("C:"), *reader.sources().begin());
+		}
+
+		TEST_METHOD(RejectCorrupted)
+		{
+			const auto schema = MergeRunnerXml::SchemaOf(RuntimeOptions::Clover);
+			std::string key;
+			MergeRunnerXml::FileLines file;
+
+			MergeRunnerXml::Reader unterminated("<clover><file name=\"C:\\a.cpp\">\n<line num=\"1\" count=\"1\" type=\"stmt\"/>\n", schema);
+			Assert::ExpectException<std::runtime_error>([&]() { unterminated.next(key, file); });
+
+			MergeRunnerXml::Reader badNumber("<clover><file name=\"C:\\a.cpp\">\n<line num=\"x\" count=\"1\" type=\"stmt\"/>\n</file>\n", schema);
+			Assert::ExpectException<std::runtime_error>([&]() { badNumber.next(key, file); });
+		}
+
+		TEST_METHOD(MergeCobertura)
+		{
+			const auto outputPath = WriteFile("xml_output.xml", Cobertura("0.5",
+				"\t\t\t\t<class name=\"a.cpp\" filename=\"\\proj\\a.cpp\" line-rate=\"0.5\">\n"
+				"\t\t\t\t\t<lines>\n"
+				"\t\t\t\t\t\t<line number=\"1\" hits=\"1\"/>\n"
+				"\t\t\t\t\t\t<line number=\"2\" hits=\"0\"/>\n"
+				"\t\t\t\t\t</lines>\n"
+				"\t\t\t\t</class>\n"
+				"\t\t\t\t<class name=\"c.cpp\" filename=\"\\proj\\c.cpp\" line-rate=\"0\">\n"
+				"\t\t\t\t\t<lines>\n"
+				"\t\t\t\t\t\t<line number=\"4\" hits=\"0\"/>\n"
+				"\t\t\t\t\t</lines>\n"
+				"\t\t\t\t</class>\n"));
+			const auto mergedPath = WriteFile("xml_merged.xml", Cobertura("0.5",
+				"\t\t\t\t<class name=\"a.cpp\" filename=\"\\proj\\a.cpp\" line-rate=\"0.5\">\n"
+				"\t\t\t\t\t<lines>\n"
+				"\t\t\t\t\t\t<line number=\"1\" hits=\"1\"/>\n"
+				"\t\t\t\t\t\t<line number=\"3\" hits=\"1\"/>\n"
+				"\t\t\t\t\t</lines>\n"
+				"\t\t\t\t</class>\n"
+				"\t\t\t\t<class name=\"b.cpp\" filename=\"\\proj\\b.cpp\" line-rate=\"1\">\n"
+				"\t\t\t\t\t<lines>\n"
+				"\t\t\t\t\t\t<line number=\"7\" hits=\"1\"/>\n"
+				"\t\t\t\t\t</lines>\n"
+				"\t\t\t\t</class>\n"));
+
+			auto options = RuntimeOptions::Instance();
+			options.ExportFormat = RuntimeOptions::Cobertura;
+			options.OutputFile = outputPath.string();
+			options.MergedOutput = mergedPath.string();
+			options.PackageName = "Program.exe";
+			MergeRunner::createMergeRunner(options)->execute();
+
+			// 3 covered lines of 5: rates are recomputed, hits are summed
+			const std::string expected = Cobertura("0.6",
+				"\t\t\t\t<class name=\"a.cpp\" filename=\"\\proj\\a.cpp\" line-rate=\"0.666667\">\n"
+				"\t\t\t\t\t<lines>\n"
+				"\t\t\t\t\t\t<line number=\"1\" hits=\"2\"/>\n"
+				"\t\t\t\t\t\t<line number=\"2\" hits=\"0\"/>\n"
+				"\t\t\t\t\t\t<line number=\"3\" hits=\"1\"/>\n"
+				"\t\t\t\t\t</lines>\n"
+				"\t\t\t\t</class>\n"
+				"\t\t\t\t<class name=\"b.cpp\" filename=\"\\proj\\b.cpp\" line-rate=\"1\">\n"
+				"\t\t\t\t\t<lines>\n"
+				"\t\t\t\t\t\t<line number=\"7\" hits=\"1\"/>\n"
+				"\t\t\t\t\t</lines>\n"
+				"\t\t\t\t</class>\n"
+				"\t\t\t\t<class name=\"c.cpp\" filename=\"\\proj\\c.cpp\" line-rate=\"0\">\n"
+				"\t\t\t\t\t<lines>\n"
+				"\t\t\t\t\t\t<line number=\"4\" hits=\"0\"/>\n"
+				"\t\t\t\t\t</lines>\n"
+				"\t\t\t\t</class>\n");
+			Assert::AreEqual(expected, ReadFile(mergedPath));
+
+			std::filesystem::remove(outputPath);
+			std::filesystem::remove(mergedPath);
+			std::filesystem::remove(mergedPath.string() + ".lock");
+		}
+
+		TEST_METHOD(MergeClover)
+		{
+			const auto schema = MergeRunnerXml::SchemaOf(RuntimeOptions::Clover);
+			const auto read = [&](const std::string& content)
+			{
+				MergeRunnerXml::DictCoverage dict;
+				MergeRunnerXml::Reader reader(content, schema);
+				std::string key;
+				MergeRunnerXml::FileLines file;
+				while (reader.next(key, file))
+				{
+					dict.emplace(key, file);
+				}
+				return dict;
+			};
+
+			const auto dictOutput = read(
+				"<clover generated=\"1\"  clover=\"3.1.5\">\n<project timestamp=\"1\">\n"
+				"<metrics classes=\"0\" files=\"2\" packages=\"1\"  loc=\"2\" ncloc = \"1\" complexity=\"0\" />\n"
+				"<package name=\"Program.exe\">\n"
+				"<file name=\"C:\\a.cpp\">\n<line num=\"0\" count=\"0\" type=\"stmt\"/>\n<line num=\"4\" count=\"1\" type=\"stmt\"/>\n</file>\n"
+				"</package>\n</project>\n</clover>\n");
+			auto dictMerge = read(
+				"<clover generated=\"1\"  clover=\"3.1.5\">\n<project timestamp=\"1\">\n"
+				"<package name=\"Program.exe\">\n"
+				"<file name=\"C:\\a.cpp\">\n<line num=\"0\" count=\"1\" type=\"stmt\"/>\n</file>\n"
+				"</package>\n</project>\n</clover>\n");
+
+			MergeRunnerXml::merge(dictOutput, dictMerge);
+			const std::string written = Write(dictMerge, RuntimeOptions::Clover);
+
+			Assert::IsTrue(written.find("<metrics classes=\"0\" files=\"2\" packages=\"1\"  loc=\"2\" ncloc = \"2\" complexity=\"0\" />\n") != std::string::npos);
+			Assert::IsTrue(written.find("<file name=\"C:\\a.cpp\">\n<line num=\"0\" count=\"1\" type=\"stmt\"/>\n<line num=\"4\" count=\"1\" type=\"stmt\"/>\n</file>\n") != std::string::npos);
+
+			// Written report reads back the same
+			const auto dictRead = read(written);
+			Assert::AreEqual(size_t(1), dictRead.size());
+			Assert::AreEqual(size_t(2), dictRead.begin()->second.covered);
+		}
+	};
+}
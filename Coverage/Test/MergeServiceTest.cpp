@@ -0,0 +1,99 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "MergeService.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestMergeService)
+	{
+	public:
+
+		static RuntimeOptions Options(const std::filesystem::path& merged)
+		{
+			auto options = RuntimeOptions::Instance();
+			options.ExportFormat = RuntimeOptions::ExportFormatType::NativeV2;
+			options.MergedOutput = merged.string();
+			options.ServeChannel = "TestMergeService";
+			return options;
+		}
+
+		TEST_METHOD(MergeLinesAndReports)
+		{
+			const auto c = FileCoverageV2::maskIsCode;
+			const auto dir = std::filesystem::temp_directory_path();
+			const auto merged = dir / "mergeService_merged.cov";
+			const auto report = dir / "mergeService_report.cov";
+			std::filesystem::remove(merged);
+
+			// Report of a shard
+			{
+				MergeRunnerV2::DictCoverage dict;
+				FileCoverageV2 coverage(3);
+				coverage._code = { 0, uint16_t(c | 1), c };
+				coverage._nbLinesCode = 2;
+				coverage.updateStats();
+				dict["src"]["a.cpp"] = coverage;
+
+				std::ofstream ofs(report);
+				ReportEmitter out(ofs);
+				MergeRunnerV2::write(dict, out, false);
+			}
+
+			MergeService service(Options(merged));
+			Assert::AreEqual(std::string("OK 1"), service.handle("MERGE " + report.string()));
+
+			const uint16_t lines[] = { 0, c, uint16_t(c | 2) };
+			Assert::AreEqual(std::string("OK 1"), service.handle(MergeService::LinesRequest("src", "a.cpp", lines)));
+			Assert::AreEqual(std::string("OK 1"), service.handle(MergeService::LinesRequest("", "b.cpp", lines)));
+
+			const auto& a = service.dictionary().at("src").at("a.cpp");
+			const FileCoverageV2::LineArray expected = { 0, uint16_t(c | 1), uint16_t(c | 2) };
+			Assert::IsTrue(expected == a._code);
+			Assert::AreEqual(size_t(2), a._nbLinesCovered);
+			const auto& b = service.dictionary().at("").at("b.cpp");
+			Assert::AreEqual(size_t(2), b._nbLinesCode);
+			Assert::AreEqual(size_t(1), b._nbLinesCovered);
+
+			// Errors are answered, the service keeps running
+			Assert::IsTrue(service.handle(MergeService::LinesRequest("src", "a.cpp", std::span<const uint16_t>(lines, 2))).starts_with("ERROR"));
+			Assert::IsTrue(service.handle("LINES 4\tsrc\ta.cpp\n").starts_with("ERROR"));
+			Assert::IsTrue(service.handle("MERGE " + (dir / "mergeService_missing.cov").string()).starts_with("ERROR"));
+			Assert::IsTrue(service.handle("UNKNOWN").starts_with("ERROR"));
+			Assert::IsFalse(service.stopped());
+
+			// Checkpoint
+			Assert::AreEqual(std::string("OK"), service.handle("STOP"));
+			Assert::IsTrue(service.stopped());
+			Assert::IsTrue(service.dictionary().empty());
+			auto written = MergeRunnerV2::makeDictionary(merged.string());
+			Assert::IsTrue(expected == written.at("src").at("a.cpp")._code);
+			Assert::IsTrue(lines[2] == written.at("").at("b.cpp")._code[2]);
+
+			// Another process merges into the report with -m while a new service runs: the checkpoint keeps its merge
+			MergeService restarted(Options(merged));
+			const uint16_t other[] = { 0, uint16_t(c | 3), c };
+			Assert::AreEqual(std::string("OK 1"), restarted.handle(MergeService::LinesRequest("src", "a.cpp", lines)));
+			{
+				written.at("src").at("a.cpp").merge(std::span<const uint16_t>(other, 3));
+				std::ofstream ofs(merged);
+				ReportEmitter out(ofs);
+				MergeRunnerV2::write(written, out, false);
+			}
+			Assert::AreEqual(std::string("OK"), restarted.handle("CHECKPOINT"));
+			const FileCoverageV2::LineArray both = { 0, uint16_t(c | 4), uint16_t(c | 4) };
+			Assert::IsTrue(both == MergeRunnerV2::makeDictionary(merged.string()).at("src").at("a.cpp")._code);
+
+			std::filesystem::remove(report);
+			std::filesystem::remove(merged);
+			std::filesystem::remove(merged.string() + ".lock");
+		}
+	};
+}
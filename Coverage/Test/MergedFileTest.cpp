@@ -0,0 +1,165 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "MergedFile.h"
+#include "MergeRunnerV2.h"
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestMergedFile)
+	{
+	public:
+
+		static RetryPolicy ShortRetry(std::chrono::milliseconds timeout)
+		{
+			RetryPolicy retry;
+			retry.initialDelay = std::chrono::milliseconds(1);
+			retry.maxDelay = std::chrono::milliseconds(4);
+			retry.timeout = timeout;
+			return retry;
+		}
+
+		TEST_METHOD(RetryWithBackoff)
+		{
+			int attempts = 0;
+			Assert::IsTrue(ShortRetry(std::chrono::seconds(10)).run([&]() { return ++attempts == 5; }));
+			Assert::AreEqual(5, attempts);
+
+			attempts = 0;
+			Assert::IsFalse(ShortRetry(std::chrono::milliseconds(20)).run([&]() { ++attempts; return false; }));
+			Assert::IsTrue(attempts > 1);
+		}
+
+		TEST_METHOD(LockIsExclusive)
+		{
+			const auto report = (std::filesystem::temp_directory_path() / "mergedFile_lock.cov").string();
+			{
+				MergeLock lock(report);
+				bool thrown = false;
+				try
+				{
+					MergeLock other(report, ShortRetry(std::chrono::milliseconds(20)));
+				}
+				catch (const std::runtime_error&)
+				{
+					thrown = true;
+				}
+				Assert::IsTrue(thrown);
+			}
+			// Released
+			MergeLock lock(report, ShortRetry(std::chrono::milliseconds(20)));
+		}
+
+		TEST_METHOD(WriteReplaces)
+		{
+			const auto target = (std::filesystem::temp_directory_path() / "mergedFile_write.cov").string();
+			MergedFile::Write(target, [](ReportEmitter& out) { out << "first"; });
+			MergedFile::Write(target, [](ReportEmitter& out) { out << "second"; });
+
+			std::ifstream ifs(target);
+			std::string content;
+			std::getline(ifs, content);
+			ifs.close();
+			Assert::AreEqual(std::string("second"), content);
+			Assert::IsFalse(std::filesystem::exists(MergedFile::TempName(target)));
+
+			// Failed write keeps the previous report
+			try
+			{
+				MergedFile::Write(target, [](ReportEmitter& out) { out << "partial"; throw std::runtime_error("failure"); });
+			}
+			catch (const std::runtime_error&)
+			{
+			}
+			std::ifstream again(target);
+			std::getline(again, content);
+			Assert::AreEqual(std::string("second"), content);
+			Assert::IsFalse(std::filesystem::exists(MergedFile::TempName(target)));
+			again.close();
+			std::filesystem::remove(target);
+		}
+
+		TEST_METHOD(FailedCommitRemovesTemp)
+		{
+			// A directory cannot be replaced by a file
+			const auto target = (std::filesystem::temp_directory_path() / "mergedFile_commit.cov").string();
+			std::filesystem::create_directories(target);
+			const auto tmpOutput = MergedFile::TempName(target);
+			MergedFile::WriteTemp(tmpOutput, [](ReportEmitter& out) { out << "merged"; });
+
+			Assert::ExpectException<std::runtime_error>([&]() { MergedFile::Commit(tmpOutput, target, ShortRetry(std::chrono::milliseconds(20))); });
+			Assert::IsFalse(std::filesystem::exists(tmpOutput));
+			Assert::IsTrue(std::filesystem::is_directory(target));
+			std::filesystem::remove(target);
+		}
+
+		TEST_METHOD(ConcurrentMerges)
+		{
+			const auto c = FileCoverageV2::maskIsCode;
+			const auto dir = std::filesystem::temp_directory_path();
+			const auto merged = (dir / "mergedFile_merged.cov").string();
+			std::filesystem::remove(merged);
+
+			const size_t nbShards = 8;
+			std::vector<std::string> shards;
+			for (size_t i = 0; i < nbShards; ++i)
+			{
+				MergeRunnerV2::DictCoverage dict;
+				FileCoverageV2 coverage(2);
+				coverage._code = { uint16_t(c | 1), c };
+				coverage._nbLinesCode = 2;
+				coverage.updateStats();
+				dict["src"]["a.cpp"] = coverage;
+
+				shards.push_back((dir / ("mergedFile_shard" + std::to_string(i) + ".cov")).string());
+				MergedFile::Write(shards.back(), [&](ReportEmitter& out) { MergeRunnerV2::write(dict, out, false); });
+			}
+
+			// Without lock, shards read the same merged file and only the last write is kept
+			std::atomic<size_t> failures = 0;
+			std::vector<std::thread> threads;
+			for (const auto& shard : shards)
+			{
+				threads.emplace_back([&, shard]()
+				{
+					auto options = RuntimeOptions::Instance();
+					options.ExportFormat = RuntimeOptions::ExportFormatType::NativeV2;
+					options.OutputFile = shard;
+					options.MergedOutput = merged;
+					try
+					{
+						MergeRunnerV2(options).execute();
+					}
+					catch (const std::exception&)
+					{
+						++failures;
+					}
+				});
+			}
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+
+			Assert::AreEqual(size_t(0), failures.load());
+			const auto dict = MergeRunnerV2::makeDictionary(merged);
+			Assert::AreEqual(size_t(nbShards), size_t(dict.at("src").at("a.cpp")._code[0] & FileCoverageV2::maskCount));
+
+			for (const auto& shard : shards)
+			{
+				std::filesystem::remove(shard);
+			}
+			std::filesystem::remove(merged);
+			std::filesystem::remove(merged + ".lock");
+		}
+	};
+}
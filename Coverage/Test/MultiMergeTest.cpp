@@ -0,0 +1,108 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "MultiMergeRunner.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestMultiMerge)
+	{
+	public:
+
+		TEST_METHOD(MatchWildcard)
+		{
+			Assert::IsTrue(MultiMergeRunner::MatchWildcard("*.cov", "shard12.cov"));
+			Assert::IsTrue(MultiMergeRunner::MatchWildcard("shard?.COV", "Shard1.cov"));
+			Assert::IsTrue(MultiMergeRunner::MatchWildcard("s*d*.cov", "shard1.cov"));
+			Assert::IsTrue(MultiMergeRunner::MatchWildcard("*", ""));
+			Assert::IsFalse(MultiMergeRunner::MatchWildcard("shard?.cov", "shard12.cov"));
+			Assert::IsFalse(MultiMergeRunner::MatchWildcard("*.cov", "shard.cov.bak"));
+			Assert::IsFalse(MultiMergeRunner::MatchWildcard("a*b", "ac"));
+		}
+
+		TEST_METHOD(ExcludeOutput)
+		{
+			const auto directory = std::filesystem::temp_directory_path() / "multiMerge_exclude";
+			std::filesystem::create_directories(directory);
+			for (const auto name : { "shard1.cov", "shard2.cov", "merged.cov", "merged.cov.lock", "merged.cov.42.tmp", "merged.cov.bak" })
+			{
+				std::ofstream(directory / name) << "FILE: a.cpp\nRES: c\nPROF: \n";
+			}
+
+			// The output is matched whatever the spelling of its path
+			const auto output = (directory / "." / "merged.cov").string();
+			const auto inputs = MultiMergeRunner::ExcludeOutput(MultiMergeRunner::ExpandInputs({ (directory / "*").string() }), output);
+			std::filesystem::remove_all(directory);
+
+			Assert::AreEqual(size_t(3), inputs.size());
+			Assert::AreEqual(std::string("merged.cov.bak"), std::filesystem::path(inputs[0]).filename().string());
+			Assert::AreEqual(std::string("shard1.cov"), std::filesystem::path(inputs[1]).filename().string());
+			Assert::AreEqual(std::string("shard2.cov"), std::filesystem::path(inputs[2]).filename().string());
+		}
+
+		TEST_METHOD(MergeAllNativeV2)
+		{
+			const auto c = FileCoverageV2::maskIsCode;
+			const size_t nbInputs = 37;
+
+			// Input i covers line (i % 4) of files i % 5 and "common.cpp"
+			const auto load = [&](size_t index)
+			{
+				MergeRunnerV2::DictCoverage dict;
+				for (const auto& name : { std::string("common.cpp"), "file" + std::to_string(index % 5) + ".cpp" })
+				{
+					FileCoverageV2 coverage(4);
+					coverage._code = { c, c, c, c };
+					coverage._code[index % 4] |= 1;
+					coverage._nbLinesCode = 4;
+					coverage.updateStats();
+					dict["dir"][name] = coverage;
+				}
+				return dict;
+			};
+
+			MergeRunnerV2::DictCoverage reference;
+			for (size_t i = 0; i < nbInputs; ++i)
+			{
+				MergeRunnerV2::merge(load(i), reference);
+			}
+
+			ParallelRenderer renderer(4);
+			auto result = MultiMergeRunner::MergeAll<MergeRunnerV2>(renderer, nbInputs, load);
+
+			Assert::AreEqual(size_t(1), result.size());
+			Assert::AreEqual(size_t(6), result["dir"].size());
+			for (const auto& [name, coverage] : reference["dir"])
+			{
+				Assert::IsTrue(coverage._code == result["dir"][name]._code);
+				Assert::AreEqual(coverage._nbLinesCovered, result["dir"][name]._nbLinesCovered);
+			}
+			const FileCoverageV2::LineArray common = { uint16_t(c | 10), uint16_t(c | 9), uint16_t(c | 9), uint16_t(c | 9) };
+			Assert::IsTrue(common == result["dir"]["common.cpp"]._code);
+		}
+
+		TEST_METHOD(MergeAllNative)
+		{
+			const auto load = [](size_t index)
+			{
+				MergeRunnerV1::DictCoverage dict;
+				std::string res = "uuuu";
+				res[index % 4] = 'c';
+				dict["common.cpp"].res = res;
+				dict["file" + std::to_string(index) + ".cpp"].res = "_u";
+				return dict;
+			};
+
+			ParallelRenderer renderer(3);
+			auto result = MultiMergeRunner::MergeAll<MergeRunnerV1>(renderer, 10, load);
+			Assert::AreEqual(size_t(11), result.size());
+			Assert::AreEqual(std::string("cccc"), result["common.cpp"].res);
+		}
+	};
+}
@@ -0,0 +1,126 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "PerfEventSampler.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestPerfEventSampler)
+	{
+	public:
+
+		// Ring buffer writer, as the kernel does it
+		struct Ring
+		{
+			explicit Ring(size_t size) : data(size) {}
+
+			void write(const void* bytes, size_t size)
+			{
+				for (size_t i = 0; i < size; ++i)
+					data[(head + i) % data.size()] = static_cast<const uint8_t*>(bytes)[i];
+				head += size;
+			}
+
+			void sample(uint64_t ip, uint32_t pid, uint32_t tid, const std::vector<uint64_t>& callchain)
+			{
+				const uint32_t type = PerfEventSampler::RecordSample;
+				const uint16_t misc = 0, size = uint16_t(8 + 24 + callchain.size() * 8);
+				const uint64_t nr = callchain.size();
+				write(&type, 4); write(&misc, 2); write(&size, 2);
+				write(&ip, 8); write(&pid, 4); write(&tid, 4); write(&nr, 8);
+				write(callchain.data(), callchain.size() * 8);
+			}
+
+			void lost(uint64_t count)
+			{
+				const uint32_t type = PerfEventSampler::RecordLost;
+				const uint16_t misc = 0, size = 24;
+				const uint64_t id = 0;
+				write(&type, 4); write(&misc, 2); write(&size, 2);
+				write(&id, 8); write(&count, 8);
+			}
+
+			std::vector<uint8_t> data;
+			uint64_t head = 0;
+		};
+
+		struct Sample
+		{
+			uint32_t pid, tid;
+			std::vector<uint64_t> pcs;
+		};
+
+		static uint64_t Parse(const Ring& ring, uint64_t tail, PerfEventSampler::Stats& stats, std::vector<Sample>& samples)
+		{
+			return PerfEventSampler::Parse(ring.data.data(), ring.data.size(), tail, ring.head, stats,
+				[&](uint32_t pid, uint32_t tid, const uint64_t* pcs, size_t depth)
+				{
+					samples.push_back(Sample{ pid, tid, std::vector<uint64_t>(pcs, pcs + depth) });
+				});
+		}
+
+		TEST_METHOD(ParseRecords)
+		{
+			const uint64_t user = uint64_t(-512);   // PERF_CONTEXT_USER
+			Ring ring(128);
+			ring.sample(0x10, 1, 2, { user, 0x10, 0x20, 0x30 });
+			ring.lost(5);
+			ring.sample(0x40, 1, 3, {});
+
+			PerfEventSampler::Stats stats;
+			std::vector<Sample> samples;
+			Assert::AreEqual(ring.head, Parse(ring, 0, stats, samples));
+
+			Assert::AreEqual(size_t(2), samples.size());
+			// Context markers are dropped
+			Assert::IsTrue(std::vector<uint64_t>{ 0x10, 0x20, 0x30 } == samples[0].pcs);
+			Assert::AreEqual(uint32_t(2), samples[0].tid);
+			// No callchain: the IP
+			Assert::IsTrue(std::vector<uint64_t>{ 0x40 } == samples[1].pcs);
+			Assert::AreEqual(uint64_t(2), stats.samples);
+			Assert::AreEqual(uint64_t(5), stats.lost);
+		}
+
+		TEST_METHOD(ParseWrappedRecords)
+		{
+			Ring ring(64);
+			PerfEventSampler::Stats stats;
+			std::vector<Sample> samples;
+
+			// 48 bytes records in a 64 bytes ring: every other record wraps
+			uint64_t tail = 0;
+			for (uint64_t i = 0; i < 10; ++i)
+			{
+				ring.sample(i, 7, 8, { i, i + 1 });
+				tail = Parse(ring, tail, stats, samples);
+				Assert::AreEqual(ring.head, tail);
+			}
+
+			Assert::AreEqual(size_t(10), samples.size());
+			for (uint64_t i = 0; i < 10; ++i)
+			{
+				Assert::IsTrue(std::vector<uint64_t>{ i, i + 1 } == samples[i].pcs);
+			}
+		}
+
+		TEST_METHOD(ParseIncompleteRecord)
+		{
+			Ring ring(128);
+			ring.sample(0x10, 1, 2, { 0x10 });
+			const auto complete = ring.head;
+			ring.sample(0x20, 1, 2, { 0x20 });
+			ring.head -= 8;
+
+			PerfEventSampler::Stats stats;
+			std::vector<Sample> samples;
+			Assert::AreEqual(complete, Parse(ring, 0, stats, samples));
+			Assert::AreEqual(size_t(1), samples.size());
+		}
+	};
+}
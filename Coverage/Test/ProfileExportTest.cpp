@@ -0,0 +1,115 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "ProfileExport.h"
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestProfileExport)
+	{
+	public:
+
+		static void Record(CallingContextTree& tree)
+		{
+			const auto main10 = tree.intern("main", "a.cpp", 10);
+			const auto foo3 = tree.intern("foo", "b.cpp", 3);
+			const auto foo4 = tree.intern("foo", "b.cpp", 4);
+			const auto bar = tree.intern("bar<int; x>", "b.cpp", 8);
+
+			const CallingContextTree::FrameId first[] = { main10, foo3 };
+			const CallingContextTree::FrameId second[] = { main10, foo4 };
+			const CallingContextTree::FrameId third[] = { main10, foo3, bar };
+			tree.record(first, 2);
+			tree.record(first, 2);
+			tree.record(second, 2);
+			tree.record(third, 3);
+			tree.record(first, 1);
+		}
+
+		// Top-level fields of a protobuf message: (field number, wire type) in order, with the lengths skipped
+		static std::vector<std::pair<uint32_t, uint32_t>> Fields(const std::string& message)
+		{
+			std::vector<std::pair<uint32_t, uint32_t>> fields;
+			size_t pos = 0;
+			const auto varint = [&]()
+			{
+				uint64_t value = 0;
+				for (int shift = 0;; shift += 7)
+				{
+					const auto byte = uint8_t(message.at(pos++));
+					value |= uint64_t(byte & 0x7F) << shift;
+					if ((byte & 0x80) == 0)
+						return value;
+				}
+			};
+
+			while (pos < message.size())
+			{
+				const auto key = varint();
+				fields.emplace_back(uint32_t(key >> 3), uint32_t(key & 7));
+				const auto value = varint();
+				if ((key & 7) == 2)
+					pos += size_t(value);
+			}
+			Assert::AreEqual(message.size(), pos);
+			return fields;
+		}
+
+		TEST_METHOD(Varints)
+		{
+			ProfileExport::ProtobufWriter writer;
+			writer.varint(1);
+			writer.varint(300);
+			writer.field(2, std::string_view("ab"));
+			Assert::AreEqual(std::string("\x01\xAC\x02\x12\x02" "ab", 7), writer.str());
+		}
+
+		TEST_METHOD(Collapsed)
+		{
+			CallingContextTree tree;
+			Record(tree);
+
+			std::ostringstream ss;
+			ProfileExport::WriteCollapsed(tree, ss);
+
+			// Lines of a function are merged, ';' in names replaced
+			const std::string expected =
+				"main 1\n"
+				"main;foo 3\n"
+				"main;foo;bar<int: x> 1\n";
+			Assert::AreEqual(expected, ss.str());
+		}
+
+		TEST_METHOD(Pprof)
+		{
+			CallingContextTree tree;
+			Record(tree);
+
+			std::ostringstream ss;
+			ProfileExport::WritePprof(tree, 1000000, ss);
+
+			size_t sampleTypes = 0, samples = 0, locations = 0, functions = 0, strings = 0;
+			for (const auto& [number, wireType] : Fields(ss.str()))
+			{
+				sampleTypes += number == 1;
+				samples += number == 2;
+				locations += number == 4;
+				functions += number == 5;
+				strings += number == 6;
+			}
+			Assert::AreEqual(size_t(2), sampleTypes);
+			Assert::AreEqual(size_t(4), samples);       // Nodes with exclusive samples
+			Assert::AreEqual(size_t(4), locations);     // Frames
+			Assert::AreEqual(size_t(3), functions);
+			// "", samples, count, cpu, nanoseconds, 3 names, 2 files
+			Assert::AreEqual(size_t(10), strings);
+		}
+	};
+}
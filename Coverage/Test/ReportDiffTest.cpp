@@ -0,0 +1,145 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "DiffKernel.h"
+#include "ReportDiff.h"
+#include "TestHelpers.h"
+
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestReportDiff)
+	{
+	public:
+
+		static std::string NativeV2(const std::vector<std::pair<std::string, FileCoverageV2>>& files)
+		{
+			std::ostringstream ss;
+			{
+				ReportEmitter out(ss);
+				FileCoverageV2::writeHeader(out, false, true);
+				for (const auto& [path, coverage] : files)
+				{
+					coverage.write(path, out, false);
+				}
+				FileCoverageV2::writeFooter(out);
+			}
+			return ss.str();
+		}
+
+		static FileCoverageV2 MakeCoverage(const std::vector<uint16_t>& lines)
+		{
+			FileCoverageV2 coverage(lines.size());
+			coverage._code = lines;
+			coverage.updateStats();
+			coverage.md5Code = "0123456789ABCDEFGHIJKLMNOPQRSTUV";
+			return coverage;
+		}
+
+		TEST_METHOD(BitsSameAsScalar)
+		{
+			std::mt19937 random(11);
+			// All tail sizes around 16/32 lines blocks and word boundaries
+			for (size_t size = 0; size < 200; ++size)
+			{
+				std::vector<uint16_t> a(size), b(size);
+				for (size_t i = 0; i < size; ++i)
+				{
+					a[i] = static_cast<uint16_t>(random());
+					b[i] = i % 4 == 0 ? a[i] : static_cast<uint16_t>(random());
+					if (i % 3 == 0)
+						a[i] &= ~FileCoverageV2::maskCount;
+				}
+
+				const size_t nbWords = DiffKernel::Words(size);
+				std::vector<uint64_t> code(nbWords), covered(nbWords), changed(nbWords);
+				DiffKernel::ToBits(a.data(), size, code.data(), covered.data(), MergeKernel::Isa::Scalar);
+				DiffKernel::ChangedCounts(a.data(), b.data(), size, changed.data(), MergeKernel::Isa::Scalar);
+
+				for (size_t i = 0; i < size; ++i)
+				{
+					const bool isCode = (a[i] & FileCoverageV2::maskIsCode) != 0;
+					const bool bit = ((code[i / 64] >> (i % 64)) & 1) != 0;
+					Assert::AreEqual(isCode, bit);
+					Assert::AreEqual(isCode && (a[i] & FileCoverageV2::maskCount) != 0, ((covered[i / 64] >> (i % 64)) & 1) != 0);
+					Assert::AreEqual((a[i] & FileCoverageV2::maskCount) != (b[i] & FileCoverageV2::maskCount), ((changed[i / 64] >> (i % 64)) & 1) != 0);
+				}
+
+				for (const auto isa : Isas())
+				{
+					std::vector<uint64_t> simdCode(nbWords), simdCovered(nbWords), simdChanged(nbWords);
+					DiffKernel::ToBits(a.data(), size, simdCode.data(), simdCovered.data(), isa);
+					DiffKernel::ChangedCounts(a.data(), b.data(), size, simdChanged.data(), isa);
+					Assert::IsTrue(code == simdCode);
+					Assert::IsTrue(covered == simdCovered);
+					Assert::IsTrue(changed == simdChanged);
+				}
+			}
+		}
+
+		TEST_METHOD(CompareLines)
+		{
+			const uint16_t c = FileCoverageV2::maskIsCode;
+			const std::vector<uint16_t> baseline = { 0, c, uint16_t(c | 1), uint16_t(c | 2), uint16_t(c | 3), c };
+			const std::vector<uint16_t> current = { 0, uint16_t(c | 1), uint16_t(c | 1), c, uint16_t(c | 5), c, uint16_t(c | 1) };
+
+			ReportDiff::Workspace workspace;
+			const auto diff = ReportDiff::Compare(baseline, current, workspace);
+			Assert::AreEqual(size_t(5), diff.baselineCode);
+			Assert::AreEqual(size_t(3), diff.baselineCovered);
+			Assert::AreEqual(size_t(6), diff.code);
+			Assert::AreEqual(size_t(4), diff.covered);
+			Assert::IsTrue(std::vector<uint32_t>{ 1, 6 } == diff.newlyCovered);
+			Assert::IsTrue(std::vector<uint32_t>{ 3 } == diff.newlyUncovered);
+			Assert::IsTrue(std::vector<uint32_t>{ 4 } == diff.changedCount);
+		}
+
+		TEST_METHOD(DiffReports)
+		{
+			const uint16_t c = FileCoverageV2::maskIsCode;
+			const auto baselinePath = WriteFile("diff_baseline.cov", NativeV2({
+				{ "a.cpp", MakeCoverage({ 0, c, c, c, uint16_t(c | 1) }) },
+				{ "b.cpp", MakeCoverage({ c, uint16_t(c | 1) }) },
+				{ "old.cpp", MakeCoverage({ uint16_t(c | 1) }) } }));
+			// Native report of the same files
+			const auto currentPath = WriteFile("diff_current.cov",
+				"FILE: a.cpp\nRES: _ccc_\nPROF: \n"
+				"FILE: b.cpp\nRES: uc\nPROF: \n"
+				"FILE: new.cpp\nRES: u_p\nPROF: \n");
+
+			const ReportDiff::Report baseline(baselinePath.string());
+			const ReportDiff::Report current(currentPath.string());
+			const auto result = ReportDiff::Run(baseline, current, ParallelRenderer(2));
+
+			std::ostringstream ss;
+			{
+				ReportEmitter out(ss);
+				ReportDiff::write("base", "current", baseline, current, result, out);
+			}
+
+			const std::string expected =
+				"DIFF: base -> current\n"
+				"FILES: 3 current, 2 changed, 1 added, 1 removed\n"
+				"LINES: 3/7 covered -> 5/7 covered\n"
+				"NEWLY_COVERED: 4\n"
+				"NEWLY_UNCOVERED: 0\n"
+				"CHANGED_COUNT: 0\n"
+				"FILE: a.cpp\n"
+				"NEWLY_COVERED: 2-4\n"
+				"ADDED: new.cpp\n"
+				"NEWLY_COVERED: 3\n"
+				"REMOVED: old.cpp\n";
+			Assert::AreEqual(expected, ss.str());
+
+			std::filesystem::remove(baselinePath);
+			std::filesystem::remove(currentPath);
+		}
+	};
+}
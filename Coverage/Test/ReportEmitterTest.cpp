@@ -0,0 +1,109 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "ParallelRenderer.h"
+#include "ReportEmitter.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestReport
+{
+	TEST_CLASS(TestReportEmitter)
+	{
+	public:
+
+		TEST_METHOD(FormatLikeStream)
+		{
+			std::ostringstream reference;
+			reference << "value=" << 0 << ' ' << size_t(123456789012) << ' ' << -42 << ' ' << 0.25 << ' ' << 1.0 << ' ' << (1.0 / 3.0) << ' ' << 1234567.0 << '\n';
+
+			std::ostringstream ss;
+			{
+				ReportEmitter out(ss);
+				out << "value=" << 0 << ' ' << size_t(123456789012) << ' ' << -42 << ' ' << 0.25 << ' ' << 1.0 << ' ' << (1.0 / 3.0) << ' ' << 1234567.0 << '\n';
+			}
+			Assert::AreEqual(reference.str(), ss.str());
+		}
+
+		TEST_METHOD(Indent)
+		{
+			std::ostringstream ss;
+			{
+				ReportEmitter out(ss);
+				out << ReportEmitter::Indent(0) << "a" << ReportEmitter::Indent(3) << "b";
+			}
+			Assert::AreEqual(std::string("a\t\t\tb"), ss.str());
+		}
+
+		TEST_METHOD(SmallBufferKeepsOrder)
+		{
+			std::string reference;
+			std::ostringstream ss;
+			{
+				// Tiny capacity: force many drains and a block bigger than the buffer
+				ReportEmitter out(ss, 8);
+				for (int i = 0; i < 100; ++i)
+				{
+					out << "line " << i << '\n';
+					reference += "line " + std::to_string(i) + '\n';
+				}
+				const std::string big(100, 'x');
+				out << big;
+				reference += big;
+
+				char* ptr = out.reserve(20);
+				std::fill(ptr, ptr + 20, 'y');
+				out.commit(20);
+				reference += std::string(20, 'y');
+			}
+			Assert::AreEqual(reference, ss.str());
+		}
+	};
+
+	TEST_CLASS(TestParallelRenderer)
+	{
+	public:
+
+		TEST_METHOD(RenderKeepsIndexOrder)
+		{
+			// More items than a window and several workers
+			const size_t count = ParallelRenderer::WindowSize * 3 + 17;
+
+			std::string reference;
+			for (size_t i = 0; i < count; ++i)
+			{
+				reference += std::to_string(i) + ';';
+			}
+
+			std::ostringstream ss;
+			{
+				ReportEmitter out(ss);
+				ParallelRenderer renderer(8);
+				renderer.render(count, out, [](size_t, size_t index, ReportEmitter& fragment)
+				{
+					fragment << index << ';';
+				});
+			}
+			Assert::AreEqual(reference, ss.str());
+		}
+
+		TEST_METHOD(ForEachRethrow)
+		{
+			ParallelRenderer renderer(4);
+			Assert::ExpectException<std::runtime_error>([&]()
+			{
+				renderer.forEach(100, [](size_t, size_t index)
+				{
+					if (index == 42)
+					{
+						throw std::runtime_error("failure");
+					}
+				});
+			});
+		}
+	};
+}
\ No newline at end of file
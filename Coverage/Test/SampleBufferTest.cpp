@@ -0,0 +1,94 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "SampleBuffer.h"
+
+#include <cstdint>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestSampleBuffer)
+	{
+	public:
+
+		static std::vector<std::vector<uint64_t>> Drain(SampleBuffer& buffer, std::vector<uint32_t>& processes, std::vector<uint16_t>* tags = nullptr)
+		{
+			std::vector<std::vector<uint64_t>> samples;
+			buffer.drain([&](uint32_t process, uint16_t tag, const uint64_t* pcs, size_t depth)
+			{
+				processes.push_back(process);
+				if (tags)
+					tags->push_back(tag);
+				samples.emplace_back(pcs, pcs + depth);
+			});
+			return samples;
+		}
+
+		TEST_METHOD(PushDrain)
+		{
+			SampleBuffer buffer(1024);
+			const uint64_t first[] = { 1, 2, 3 };
+			const uint64_t second[] = { 4 };
+			Assert::IsTrue(buffer.empty());
+			Assert::IsTrue(buffer.push(10, first, 3));
+			Assert::IsTrue(buffer.push(0xFFFFFFFF, second, 1, 3));
+			Assert::AreEqual(size_t(2), buffer.samples());
+			Assert::AreEqual(size_t(6), buffer.used());
+
+			std::vector<uint32_t> processes;
+			std::vector<uint16_t> tags;
+			const auto samples = Drain(buffer, processes, &tags);
+			Assert::IsTrue(std::vector<uint32_t>{ 10, 0xFFFFFFFF } == processes);
+			Assert::IsTrue(std::vector<uint16_t>{ 0, 3 } == tags);
+			Assert::IsTrue(std::vector<uint64_t>{ 1, 2, 3 } == samples[0]);
+			Assert::IsTrue(std::vector<uint64_t>{ 4 } == samples[1]);
+			Assert::IsTrue(buffer.empty());
+			Assert::AreEqual(size_t(0), buffer.used());
+		}
+
+		TEST_METHOD(TruncateDeepStacks)
+		{
+			SampleBuffer buffer(4096);
+			std::vector<uint64_t> stack(SampleBuffer::MaxDepth + 10, 7);
+			Assert::IsTrue(buffer.push(1, stack.data(), stack.size()));
+
+			std::vector<uint32_t> processes;
+			Assert::AreEqual(SampleBuffer::MaxDepth, Drain(buffer, processes)[0].size());
+		}
+
+		TEST_METHOD(Full)
+		{
+			// Capacity is raised to hold the deepest sample
+			SampleBuffer buffer(1);
+			Assert::AreEqual(SampleBuffer::MaxDepth + 1, buffer.capacity());
+
+			std::vector<uint64_t> stack(100);
+			uint64_t next = 0;
+			const auto push = [&]()
+			{
+				for (auto& pc : stack)
+					pc = next++;
+				return buffer.push(1, stack.data(), stack.size());
+			};
+
+			Assert::IsTrue(push());
+			Assert::IsTrue(push());
+			Assert::IsFalse(push());
+
+			std::vector<uint32_t> processes;
+			auto samples = Drain(buffer, processes);
+			Assert::AreEqual(size_t(2), samples.size());
+			Assert::AreEqual(uint64_t(0), samples[0][0]);
+			Assert::AreEqual(uint64_t(199), samples[1][99]);
+
+			// Room again once drained
+			Assert::IsTrue(push());
+			samples = Drain(buffer, processes);
+			Assert::AreEqual(size_t(1), samples.size());
+			Assert::AreEqual(uint64_t(300), samples[0][0]);
+		}
+	};
+}
@@ -0,0 +1,80 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "SampleScheduler.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestSampleScheduler)
+	{
+	public:
+
+		TEST_METHOD(FixedRate)
+		{
+			std::mutex mutex;
+			std::vector<uint64_t> timestamps;
+			SampleScheduler* scheduler = nullptr;
+			SampleScheduler sampler(1000, [&]()
+			{
+				// The break is handled immediately
+				std::lock_guard<std::mutex> lock(mutex);
+				timestamps.push_back(scheduler->acknowledge());
+				return true;
+			});
+			scheduler = &sampler;
+
+			sampler.start();
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			sampler.stop();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			// Loose bounds: timers of loaded build machines are coarse
+			Assert::IsTrue(timestamps.size() >= 20);
+			Assert::IsTrue(timestamps.size() <= 210);
+			Assert::AreEqual(uint64_t(timestamps.size()), sampler.samples());
+			Assert::AreEqual(sampler.samples(), sampler.interrupts());
+			for (size_t i = 1; i < timestamps.size(); ++i)
+			{
+				Assert::IsTrue(timestamps[i - 1] < timestamps[i]);
+			}
+		}
+
+		TEST_METHOD(SkipPendingTicks)
+		{
+			uint64_t calls = 0;
+			SampleScheduler sampler(1000, [&]() { ++calls; return true; });
+
+			// Never acknowledged: a single interrupt, all other ticks are skipped
+			sampler.start();
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			sampler.stop();
+
+			Assert::AreEqual(uint64_t(1), calls);
+			Assert::AreEqual(uint64_t(1), sampler.interrupts());
+			Assert::IsTrue(sampler.skipped() > 0);
+			Assert::AreEqual(uint64_t(0), sampler.samples());
+		}
+
+		TEST_METHOD(NothingToInterrupt)
+		{
+			uint64_t calls = 0;
+			SampleScheduler sampler(1000, [&]() { ++calls; return false; });
+
+			// No process: each tick tries again
+			sampler.start();
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			sampler.stop();
+
+			Assert::IsTrue(calls > 1);
+			Assert::AreEqual(uint64_t(0), sampler.interrupts());
+		}
+	};
+}
@@ -0,0 +1,178 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "StackUnwinder.h"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestStackUnwinder)
+	{
+	public:
+
+		// Target memory made of regions
+		struct Memory
+		{
+			std::map<uint64_t, std::vector<uint8_t>> regions;
+			size_t reads = 0;
+
+			std::vector<uint8_t>& region(uint64_t base, size_t size)
+			{
+				auto& bytes = regions[base];
+				bytes.resize(size);
+				return bytes;
+			}
+
+			template <typename T>
+			void write(uint64_t address, T value)
+			{
+				for (auto& [base, bytes] : regions)
+				{
+					if (address >= base && address + sizeof(T) <= base + bytes.size())
+					{
+						std::memcpy(bytes.data() + (address - base), &value, sizeof(T));
+						return;
+					}
+				}
+				Assert::Fail();
+			}
+
+			StackUnwinder::ReadMemory reader()
+			{
+				return [this](uint64_t address, void* buffer, size_t size)
+				{
+					++reads;
+					for (auto& [base, bytes] : regions)
+					{
+						if (address >= base && address + size <= base + bytes.size())
+						{
+							std::memcpy(buffer, bytes.data() + (address - base), size);
+							return true;
+						}
+					}
+					return false;
+				};
+			}
+		};
+
+		static constexpr uint64_t ImageBase = 0x140000000;
+
+		// PE32+ image with two functions:
+		// 0x1000: push rbp / sub rsp, 0x20
+		// 0x2000: push rbp / mov rbp, rsp / sub rsp, 0x40
+		static void WriteImage(Memory& memory)
+		{
+			memory.region(ImageBase, 0x4000);
+			memory.write<uint8_t>(ImageBase, 'M');
+			memory.write<uint8_t>(ImageBase + 1, 'Z');
+			memory.write<uint32_t>(ImageBase + 0x3C, 0x80);
+			memory.write<uint32_t>(ImageBase + 0x80 + 24 + 56, 0x4000);         // SizeOfImage
+			memory.write<uint32_t>(ImageBase + 0x80 + 24 + 112 + 24, 0x3000);   // Exception directory
+			memory.write<uint32_t>(ImageBase + 0x80 + 24 + 112 + 28, 24);
+
+			const uint32_t pdata[] = { 0x1000, 0x1100, 0x3100, 0x2000, 0x2100, 0x3200 };
+			for (size_t i = 0; i < 6; ++i)
+				memory.write<uint32_t>(ImageBase + 0x3000 + i * 4, pdata[i]);
+
+			// Unwind codes in reverse order of the prolog: (offset, op | info << 4)
+			const uint8_t first[] = { 1, 5, 2, 0, 5, 2 | (3 << 4), 1, 0 | (5 << 4) };
+			const uint8_t second[] = { 1, 8, 3, 5, 8, 2 | (7 << 4), 4, 3, 1, 0 | (5 << 4) };
+			for (size_t i = 0; i < sizeof(first); ++i)
+				memory.write<uint8_t>(ImageBase + 0x3100 + i, first[i]);
+			for (size_t i = 0; i < sizeof(second); ++i)
+				memory.write<uint8_t>(ImageBase + 0x3200 + i, second[i]);
+		}
+
+		TEST_METHOD(UnwindPdata)
+		{
+			Memory memory;
+			WriteImage(memory);
+
+			// Stack: 0x999 called the first function, which called the second
+			const uint64_t e1 = 0x7F00, e2 = e1 - 0x30;
+			memory.region(0x7000, 0x2000);
+			memory.write<uint64_t>(e1, 0x999);
+			memory.write<uint64_t>(e1 - 8, 0);                      // rbp of 0x999: end of the chain
+			memory.write<uint64_t>(e2, ImageBase + 0x1050);
+			memory.write<uint64_t>(e2 - 8, 0x1234);                 // rbp of the first function
+
+			StackUnwinder unwinder(memory.reader());
+			unwinder.addModule(ImageBase);
+
+			StackUnwinder::Context context;
+			context.ip = ImageBase + 0x2050;
+			context.regs[StackUnwinder::Context::Sp] = e2 - 0x48;
+			context.regs[StackUnwinder::Context::Fp] = e2 - 8;
+
+			uint64_t pcs[16];
+			const size_t readsBefore = memory.reads;
+			Assert::AreEqual(size_t(3), unwinder.unwind(context, pcs, 16));
+			Assert::AreEqual(ImageBase + 0x2050, pcs[0]);
+			Assert::AreEqual(ImageBase + 0x1050, pcs[1]);
+			Assert::AreEqual(uint64_t(0x999), pcs[2]);
+			Assert::AreEqual(uint64_t(2), unwinder.stats().unwindFrames);
+
+			// Unwind data is cached: a second walk only reads the stack window
+			const size_t readsFirst = memory.reads - readsBefore;
+			Assert::AreEqual(size_t(3), unwinder.unwind(context, pcs, 16));
+			Assert::IsTrue(memory.reads - readsBefore - readsFirst < readsFirst);
+			Assert::AreEqual(uint64_t(0), unwinder.stats().windowMisses);
+		}
+
+		TEST_METHOD(UnwindInProlog)
+		{
+			Memory memory;
+			WriteImage(memory);
+
+			// Second function after its push rbp only
+			const uint64_t e2 = 0x7F00;
+			memory.region(0x7000, 0x1000);
+			memory.write<uint64_t>(e2, 0x999);
+			memory.write<uint64_t>(e2 - 8, 0);
+
+			StackUnwinder unwinder(memory.reader());
+			unwinder.addModule(ImageBase);
+
+			StackUnwinder::Context context;
+			context.ip = ImageBase + 0x2002;
+			context.regs[StackUnwinder::Context::Sp] = e2 - 8;
+			context.regs[StackUnwinder::Context::Fp] = 0x5555;
+
+			uint64_t pcs[16];
+			Assert::AreEqual(size_t(2), unwinder.unwind(context, pcs, 16));
+			Assert::AreEqual(uint64_t(0x999), pcs[1]);
+		}
+
+		TEST_METHOD(FramePointerChain)
+		{
+			// x86: 4 bytes frames [caller ebp, return address]
+			Memory memory;
+			memory.region(0x1000, 0x100);
+			memory.write<uint32_t>(0x1010, 0x1040);
+			memory.write<uint32_t>(0x1014, 0x401000);
+			memory.write<uint32_t>(0x1040, 0);
+			memory.write<uint32_t>(0x1044, 0x402000);
+
+			StackUnwinder unwinder(memory.reader(), false);
+			StackUnwinder::Context context;
+			context.ip = 0x403000;
+			context.regs[StackUnwinder::Context::Sp] = 0x1000;
+			context.regs[StackUnwinder::Context::Fp] = 0x1010;
+
+			uint64_t pcs[16];
+			Assert::AreEqual(size_t(3), unwinder.unwind(context, pcs, 16));
+			Assert::AreEqual(uint64_t(0x401000), pcs[1]);
+			Assert::AreEqual(uint64_t(0x402000), pcs[2]);
+			Assert::AreEqual(uint64_t(2), unwinder.stats().chainFrames);
+
+			// Depth limit
+			Assert::AreEqual(size_t(2), unwinder.unwind(context, pcs, 2));
+		}
+	};
+}
@@ -0,0 +1,73 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "SymbolCache.h"
+
+#include <cstdint>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestSymbolCache)
+	{
+	public:
+
+		TEST_METHOD(CachePcs)
+		{
+			SymbolCache cache;
+			cache.addModule(0x1000, 0x1000, true);
+
+			int resolved = 0;
+			const auto resolve = [&](uint64_t pc) { ++resolved; return pc == 0x1010 ? SymbolCache::FrameId(7) : SymbolCache::NoFrame; };
+
+			Assert::AreEqual(SymbolCache::FrameId(7), cache.lookup(0x1010, resolve));
+			Assert::AreEqual(SymbolCache::FrameId(7), cache.lookup(0x1010, resolve));
+			// Negative entries are cached too
+			Assert::AreEqual(SymbolCache::NoFrame, cache.lookup(0x1020, resolve));
+			Assert::AreEqual(SymbolCache::NoFrame, cache.lookup(0x1020, resolve));
+			// Outside known modules
+			Assert::AreEqual(SymbolCache::NoFrame, cache.lookup(0x5000, resolve));
+			Assert::AreEqual(SymbolCache::NoFrame, cache.lookup(0x5000, resolve));
+
+			Assert::AreEqual(3, resolved);
+			Assert::AreEqual(uint64_t(6), cache.stats().lookups);
+			Assert::AreEqual(uint64_t(3), cache.stats().hits);
+			Assert::AreEqual(uint64_t(0), cache.stats().skipped);
+		}
+
+		TEST_METHOD(SkipModulesWithoutCode)
+		{
+			SymbolCache cache;
+			cache.addModule(0x1000, 0x1000, true);
+			cache.addModule(0x2000, 0x1000, false);
+
+			int resolved = 0;
+			const auto resolve = [&](uint64_t) { ++resolved; return SymbolCache::FrameId(1); };
+
+			Assert::AreEqual(SymbolCache::NoFrame, cache.lookup(0x2000, resolve));
+			Assert::AreEqual(SymbolCache::NoFrame, cache.lookup(0x2fff, resolve));
+			Assert::AreEqual(SymbolCache::FrameId(1), cache.lookup(0x1fff, resolve));
+			Assert::AreEqual(SymbolCache::FrameId(1), cache.lookup(0x3000, resolve));
+			Assert::AreEqual(2, resolved);
+			Assert::AreEqual(uint64_t(2), cache.stats().skipped);
+		}
+
+		TEST_METHOD(UnloadModule)
+		{
+			SymbolCache cache;
+			cache.addModule(0x1000, 0x1000, true);
+
+			SymbolCache::FrameId next = 1;
+			const auto resolve = [&](uint64_t) { return next++; };
+
+			Assert::AreEqual(SymbolCache::FrameId(1), cache.lookup(0x1010, resolve));
+			cache.removeModule(0x1000);
+
+			// Another module at the same address: PCs are resolved again
+			cache.addModule(0x1000, 0x2000, true);
+			Assert::AreEqual(SymbolCache::FrameId(2), cache.lookup(0x1010, resolve));
+			Assert::AreEqual(SymbolCache::FrameId(2), cache.lookup(0x1010, resolve));
+		}
+	};
+}
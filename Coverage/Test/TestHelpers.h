@@ -0,0 +1,42 @@
+#pragma once
+
+#include "MergeKernel.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// Helpers shared by the test classes.
+namespace TestFormat
+{
+	/// Every merge kernel instruction set usable on this machine.
+	inline std::vector<MergeKernel::Isa> Isas()
+	{
+		std::vector<MergeKernel::Isa> isas = { MergeKernel::Isa::Scalar };
+		if (MergeKernel::Supported() >= MergeKernel::Isa::SSE2)
+			isas.push_back(MergeKernel::Isa::SSE2);
+		if (MergeKernel::Supported() >= MergeKernel::Isa::AVX2)
+			isas.push_back(MergeKernel::Isa::AVX2);
+		return isas;
+	}
+
+	/// Write \p content in the temporary directory, return its path.
+	inline std::filesystem::path WriteFile(const std::string& name, const std::string& content)
+	{
+		const auto path = std::filesystem::temp_directory_path() / name;
+		std::ofstream file(path, std::ios::binary);
+		file << content;
+		return path;
+	}
+
+	/// Read a report back in text mode: the runners write them in text mode, with "\r\n" line ends on Windows.
+	inline std::string ReadFile(const std::filesystem::path& path)
+	{
+		std::ifstream file(path);
+		std::stringstream ss;
+		ss << file.rdbuf();
+		return ss.str();
+	}
+}
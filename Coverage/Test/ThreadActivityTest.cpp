@@ -0,0 +1,46 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "ThreadActivity.h"
+
+#include <cstdint>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestThreadActivity)
+	{
+	public:
+
+		TEST_METHOD(Ran)
+		{
+			ThreadActivity activity;
+			Assert::IsTrue(activity.ran(1, 100));    // First sample: unknown, walked
+			Assert::IsFalse(activity.ran(1, 100));
+			Assert::IsTrue(activity.ran(1, 101));
+			Assert::IsTrue(activity.ran(2, 0));
+
+			activity.forget(1);
+			Assert::IsTrue(activity.ran(1, 101));
+			Assert::AreEqual(uint64_t(4), activity.active());
+			Assert::AreEqual(uint64_t(1), activity.idle());
+		}
+
+		TEST_METHOD(ParseStat)
+		{
+			uint64_t cpuTime = 0;
+			Assert::IsTrue(ThreadActivity::ParseStat("1234 (worker) S 1 1234 1234 0 -1 4194560 120 0 0 0 17 5 0 0 20 0 8 0 100 0 0", cpuTime));
+			Assert::AreEqual(uint64_t(22), cpuTime);
+
+			// The command may contain spaces and parentheses
+			Assert::IsTrue(ThreadActivity::ParseStat("42 (a) b (c) R 1 42 42 0 -1 0 0 0 0 0 300 400 0 0", cpuTime));
+			Assert::AreEqual(uint64_t(700), cpuTime);
+
+			Assert::IsFalse(ThreadActivity::ParseStat("", cpuTime));
+			Assert::IsFalse(ThreadActivity::ParseStat("42 (a) R 1 42", cpuTime));
+			Assert::IsFalse(ThreadActivity::ParseStat("42 (a) R 1 42 42 0 -1 0 0 0 0 0 x 400", cpuTime));
+		}
+	};
+}
@@ -0,0 +1,67 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "WaitReason.h"
+
+#include <cstdint>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestWaitReason)
+	{
+	public:
+
+		TEST_METHOD(ParseProc)
+		{
+			uint64_t number = 0;
+			Assert::IsTrue(WaitReason::ParseSyscall("202 0x7ffdc1ae5718 0x189 0x0 0x0 0x0 0xffffffff 0x7f254341ccb0 0x7f25434a3f16", number));
+			Assert::AreEqual(uint64_t(202), number);
+			Assert::IsTrue(WaitReason::ParseSyscall("7", number));
+			Assert::AreEqual(uint64_t(7), number);
+
+			// Not in a system call
+			Assert::IsFalse(WaitReason::ParseSyscall("running", number));
+			Assert::IsFalse(WaitReason::ParseSyscall("-1 0x7ffdc1ae5718 0x7f25434a3f16", number));
+			Assert::IsFalse(WaitReason::ParseSyscall("", number));
+
+			char state = 0;
+			Assert::IsTrue(WaitReason::ParseState("1234 (a) b (c) S 1 1234 1234 0 -1", state));
+			Assert::AreEqual('S', state);
+			Assert::IsTrue(WaitReason::ParseState("42 (worker) R 1", state));
+			Assert::AreEqual('R', state);
+			Assert::IsFalse(WaitReason::ParseState("42 (worker)", state));
+			Assert::IsFalse(WaitReason::ParseState("", state));
+		}
+
+		TEST_METHOD(Classify)
+		{
+#if !defined(__aarch64__)
+			Assert::IsTrue(WaitReason::FromSyscall(202) == WaitReason::Futex);
+			Assert::IsTrue(WaitReason::FromSyscall(230) == WaitReason::Sleep);
+			Assert::IsTrue(WaitReason::FromSyscall(0) == WaitReason::Read);
+			Assert::IsTrue(WaitReason::FromSyscall(232) == WaitReason::Poll);
+			Assert::IsTrue(WaitReason::FromSyscall(39) == WaitReason::Unknown);
+#endif
+
+			Assert::IsTrue(WaitReason::FromKernelFunction("futex_do_wait") == WaitReason::Futex);
+			Assert::IsTrue(WaitReason::FromKernelFunction("hrtimer_nanosleep") == WaitReason::Sleep);
+			Assert::IsTrue(WaitReason::FromKernelFunction("anon_pipe_read") == WaitReason::Read);
+			Assert::IsTrue(WaitReason::FromKernelFunction("poll_schedule_timeout.constprop.0") == WaitReason::Poll);
+			Assert::IsTrue(WaitReason::FromKernelFunction("0") == WaitReason::Unknown);
+
+			Assert::IsTrue(WaitReason::FromFunction("NtWaitForAlertByThreadId") == WaitReason::Futex);
+			Assert::IsTrue(WaitReason::FromFunction("ZwDelayExecution") == WaitReason::Sleep);
+			Assert::IsTrue(WaitReason::FromFunction("NtReadFile") == WaitReason::Read);
+			Assert::IsTrue(WaitReason::FromFunction("NtUserGetMessage") == WaitReason::Poll);
+			Assert::IsTrue(WaitReason::FromFunction("NtWaitForSingleObject") == WaitReason::Object);
+			Assert::IsTrue(WaitReason::FromFunction("NtClose") == WaitReason::Unknown);
+			Assert::IsTrue(WaitReason::FromFunction("ReadFile") == WaitReason::Unknown);
+
+			Assert::AreEqual(std::string("futex"), std::string(WaitReason::Name(WaitReason::Futex)));
+			Assert::AreEqual(std::string("unknown"), std::string(WaitReason::Name(WaitReason::Count)));
+		}
+	};
+}
@@ -0,0 +1,134 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "MergeRunnerV1.h"
+#include "TestHelpers.h"
+
+#include <filesystem>
+#include <sstream>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestNativeV1)
+	{
+	public:
+
+		TEST_METHOD(MakeDictionary)
+		{
+			// File names containing 'F', 'I', 'L', 'E' or ':' are read entirely
+			const auto path = WriteFile("nativeV1_dict.cov",
+				"FILE: C:\\Lib\\File.cpp\nRES: _cu\nPROF: \n"
+				"FILE: C:\\main.cpp\nRES: uuc\nPROF: 1\n");
+			const auto dict = MergeRunnerV1::makeDictionary(path.string());
+			std::filesystem::remove(path);
+
+			Assert::AreEqual(size_t(2), dict.size());
+			Assert::AreEqual(std::string("_cu"), dict.at("C:\\Lib\\File.cpp").res);
+			Assert::AreEqual(std::string("1"), dict.at("C:\\main.cpp").prof);
+		}
+
+		TEST_METHOD(MergeSamples)
+		{
+			// Run 1: 10 samples, 4 in a.cpp; run 2: 30 samples, 6 in a.cpp. Older c.cpp record has no raw samples.
+			const std::string output =
+				"SAMPLES: 10\n"
+				"FILE: a.cpp\nRES: cc\nPROF: 10,100,30,0,\nRAW: 1,1,3,0,\n"
+				"FILE: c.cpp\nRES: u\nPROF: 5,5,\n";
+			const std::string merged =
+				"SAMPLES: 30\n"
+				"FILE: a.cpp\nRES: cu\nPROF: 0,0,20,100,\nRAW: 0,0,6,3,\n"
+				"FILE: b.cpp\nRES: c\nPROF: 10,100,\nRAW: 3,2,\n";
+			const std::string expected =
+				"SAMPLES: 40\n"
+				"FILE: a.cpp\nRES: cc\nPROF: 2,25,22,75,\nRAW: 1,1,9,3,\n"
+				"FILE: b.cpp\nRES: c\nPROF: 7,100,\nRAW: 3,2,\n"
+				"FILE: c.cpp\nRES: u\nPROF: 5,5,\n";
+
+			const auto outputPath = WriteFile("nativeV1_samples_output.cov", output);
+			const auto mergedPath = WriteFile("nativeV1_samples_merged.cov", merged);
+
+			// Dictionaries
+			auto dict = MergeRunnerV1::makeDictionary(mergedPath.string());
+			Assert::AreEqual(uint64_t(30), dict.totalSamples);
+			Assert::AreEqual(size_t(4), dict["a.cpp"].samples.size());
+			MergeRunnerV1::merge(MergeRunnerV1::makeDictionary(outputPath.string()), dict);
+			std::stringstream ss;
+			{
+				ReportEmitter out(ss);
+				MergeRunnerV1::write(dict, out);
+			}
+			Assert::AreEqual(expected, ss.str());
+
+			// Merge-join
+			std::stringstream joined;
+			{
+				ReportEmitter out(joined);
+				MergeRunnerV1::mergeSorted(outputPath.string(), mergedPath.string(), out);
+			}
+			Assert::AreEqual(expected, joined.str());
+
+			std::filesystem::remove(outputPath);
+			std::filesystem::remove(mergedPath);
+		}
+
+		TEST_METHOD(RejectCorrupted)
+		{
+			const auto path = WriteFile("nativeV1_corrupted.cov", "FILE: a.cpp\nPROF: \n");
+			bool thrown = false;
+			try
+			{
+				MergeRunnerV1::makeDictionary(path.string());
+			}
+			catch (const std::exception&)
+			{
+				thrown = true;
+			}
+			std::filesystem::remove(path);
+			Assert::IsTrue(thrown);
+		}
+
+		TEST_METHOD(MergeSortedAndUnsorted)
+		{
+			const std::string output =
+				"FILE: a.cpp\nRES: ccuu\nPROF: \n"
+				"FILE: c.cpp\nRES: uu\nPROF: \n"
+				"FILE: d.cpp\nRES: _c\nPROF: \n";
+			const std::string merged =
+				"FILE: b.cpp\nRES: c\nPROF: \n"
+				"FILE: c.cpp\nRES: cu\nPROF: \n";
+			const std::string expected =
+				"FILE: a.cpp\nRES: ccuu\nPROF: \n"
+				"FILE: b.cpp\nRES: c\nPROF: \n"
+				"FILE: c.cpp\nRES: cu\nPROF: \n"
+				"FILE: d.cpp\nRES: _c\nPROF: \n";
+
+			// Unsorted merged file goes through the dictionary, with the same result
+			const std::string unsorted =
+				"FILE: c.cpp\nRES: cu\nPROF: \n"
+				"FILE: b.cpp\nRES: c\nPROF: \n";
+
+			for (const bool sorted : { true, false })
+			{
+				const auto outputPath = WriteFile("nativeV1_output.cov", output);
+				const auto mergedPath = WriteFile("nativeV1_merged.cov", sorted ? merged : unsorted);
+				Assert::IsTrue(MergeRunnerV1::isSorted(outputPath.string()));
+				Assert::AreEqual(sorted, MergeRunnerV1::isSorted(mergedPath.string()));
+
+				auto options = RuntimeOptions::Instance();
+				options.ExportFormat = RuntimeOptions::Native;
+				options.OutputFile = outputPath.string();
+				options.MergedOutput = mergedPath.string();
+				MergeRunnerV1(options).execute();
+
+				Assert::AreEqual(expected, ReadFile(mergedPath));
+				Assert::IsFalse(std::filesystem::exists(MergedFile::TempName(mergedPath.string())));
+				std::filesystem::remove(outputPath);
+				std::filesystem::remove(mergedPath);
+				std::filesystem::remove(mergedPath.string() + ".lock");
+			}
+		}
+	};
+}
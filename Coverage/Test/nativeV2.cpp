@@ -5,6 +5,8 @@
 #include "MergeRunnerV2.h"
 #include "RuntimeOptions.h"
 
+#include <regex>
+
 #ifndef NOMINMAX
 #	define NOMINMAX
 #	include <Windows.h>
@@ -33,7 +35,7 @@ namespace TestFormat
 	{
 	public:
 
-		void MergeTest(const std::string dirName)
+		void MergeTest(const std::string dirName, bool compact = false)
 		{
 			const auto max = FileCoverageV2::maskCount;
 			const auto c   = FileCoverageV2::maskIsCode;
@@ -59,17 +61,20 @@ namespace TestFormat
 				const std::string filename("demo");
 				std::stringstream ss;
 				merge.md5Code = "0123456789ABCDEFGHIJKLMNOPQRSTUV";
-				FileCoverageV2::writeHeader(ss);
-				if (!dirName.empty())
-				{
-					FileCoverageV2::openDirectory(ss, dirName);
-				}
-				merge.write(filename, ss);
-				if (!dirName.empty())
 				{
-					FileCoverageV2::closeDirectory(ss);
+					ReportEmitter out(ss);
+					FileCoverageV2::writeHeader(out, compact);
+					if (!dirName.empty())
+					{
+						FileCoverageV2::openDirectory(out, dirName);
+					}
+					merge.write(filename, out, compact);
+					if (!dirName.empty())
+					{
+						FileCoverageV2::closeDirectory(out);
+					}
+					FileCoverageV2::writeFooter(out);
 				}
-				FileCoverageV2::writeFooter(ss);
 
 				// Create reader
 				auto options = RuntimeOptions::Instance();
@@ -77,7 +82,7 @@ namespace TestFormat
 				options.OutputFile   = filename; /// Dummy valid value
 				options.ExportFormat = RuntimeOptions::ExportFormatType::NativeV2;
 				MergeRunnerV2 runner(options);
-				auto dict = runner.createDictionary(filename, ss);
+				auto dict = runner.createDictionary(filename, ss.str());
 				const size_t EXPECT_DICT_SIZE = 1;
 				Assert::AreEqual(EXPECT_DICT_SIZE, dict.size());
 
@@ -100,5 +105,223 @@ namespace TestFormat
 		{
 			MergeTest("directoryName");
 		}
+
+		TEST_METHOD(MergeCompact)
+		{
+			MergeTest("directoryName", true);
+		}
+
+		TEST_METHOD(CompactLinesRoundTrip)
+		{
+			const auto c = FileCoverageV2::maskIsCode;
+
+			// Mostly empty file: sparse
+			FileCoverageV2::LineArray sparse(5000, 0);
+			sparse[10] = c | 3;
+			sparse[11] = c | 3;
+			sparse[4000] = c;
+			// Long stretches: run-length
+			FileCoverageV2::LineArray rle(5000, c | 1);
+			std::fill(rle.begin() + 100, rle.begin() + 3000, 0);
+			// Noise: raw
+			FileCoverageV2::LineArray raw(500);
+			for (size_t i = 0; i < raw.size(); ++i)
+			{
+				raw[i] = static_cast<uint16_t>(c | ((i * 7919) % FileCoverageV2::maskCount));
+			}
+
+			Assert::IsTrue(CompactLines::Encoding::Sparse == CompactLines::Choose(sparse));
+			Assert::IsTrue(CompactLines::Encoding::Rle == CompactLines::Choose(rle));
+			Assert::IsTrue(CompactLines::Encoding::Raw == CompactLines::Choose(raw));
+
+			for (const auto& lines : { sparse, rle, raw })
+			{
+				for (const auto encoding : { CompactLines::Encoding::Raw, CompactLines::Encoding::Rle, CompactLines::Encoding::Sparse })
+				{
+					std::string data;
+					CompactLines::Encode(lines, encoding, data);
+					FileCoverageV2::LineArray decoded;
+					CompactLines::Decode(data, encoding, decoded);
+					Assert::AreEqual(lines, decoded);
+				}
+			}
+
+			// Corrupted: more lines than announced
+			std::string data;
+			CompactLines::Encode(rle, CompactLines::Encoding::Rle, data);
+			data[0] = 1;
+			FileCoverageV2::LineArray decoded;
+			Assert::ExpectException<std::runtime_error>([&]() { CompactLines::Decode(data, CompactLines::Encoding::Rle, decoded); });
+		}
+
+		TEST_METHOD(CompactWrite)
+		{
+			FileCoverageV2 coverage(5000);
+			coverage._code[42] = FileCoverageV2::maskIsCode | 1;
+			coverage.updateStats();
+			coverage.md5Code = "0123456789ABCDEFGHIJKLMNOPQRSTUV";
+
+			std::stringstream ss;
+			{
+				ReportEmitter out(ss);
+				FileCoverageV2::writeHeader(out, true);
+				coverage.write("demo", out, true);
+				FileCoverageV2::writeFooter(out);
+			}
+			Assert::IsTrue(ss.str().find(R"(<CppCoverage version="2.1">)") != std::string::npos);
+			Assert::IsTrue(ss.str().find(R"(<coverage encoding="sparse">)") != std::string::npos);
+
+			auto dict = MergeRunnerV2::createDictionary("demo", ss.str());
+			Assert::AreEqual(coverage._code, dict[""]["demo"]._code);
+		}
+
+		TEST_METHOD(ParseLayout)
+		{
+			const auto c = FileCoverageV2::maskIsCode;
+			FileCoverageV2 coverage(3);
+			coverage._code = { 0, c | 2, c };
+			coverage.updateStats();
+			std::stringstream ss;
+			{
+				ReportEmitter out(ss);
+				coverage.write("inside.cpp", out);
+			}
+			const auto element = ss.str();
+
+			// CRLF, files outside directories before and after one, unknown elements
+			std::string report = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<CppCoverage version=\"2.0\">\r\n";
+			report += std::regex_replace(element, std::regex("inside"), "first");
+			report += "\t<directory path=\"C:\\proj\">\r\n<unknown value=\"1\"/>\r\n" + element + "\t</directory>\r\n";
+			report += std::regex_replace(element, std::regex("inside"), "last");
+			report += "</CppCoverage>\r\n";
+
+			auto dict = MergeRunnerV2::createDictionary("demo", report);
+			Assert::AreEqual(size_t(2), dict.size());
+			Assert::AreEqual(size_t(2), dict[""].size());
+			Assert::AreEqual(coverage._code, dict[""]["first.cpp"]._code);
+			Assert::AreEqual(coverage._code, dict[""]["last.cpp"]._code);
+			Assert::AreEqual(coverage._code, dict["C:\\proj"]["inside.cpp"]._code);
+			Assert::AreEqual(size_t(1), dict["C:\\proj"]["inside.cpp"]._nbLinesCovered);
+		}
+
+		static std::string Write(const MergeRunnerV2::DictCoverage& dict)
+		{
+			std::stringstream ss;
+			{
+				ReportEmitter out(ss);
+				MergeRunnerV2::write(dict, out, false);
+			}
+			return ss.str();
+		}
+
+		TEST_METHOD(SortedMergeJoin)
+		{
+			const auto c = FileCoverageV2::maskIsCode;
+			const auto make = [&](uint16_t hits, size_t size)
+			{
+				FileCoverageV2 coverage(size);
+				for (size_t i = 0; i < size; ++i)
+					coverage._code[i] = c | static_cast<uint16_t>(i % 2 == 0 ? hits : 0);
+				coverage._nbLinesCode = size;
+				coverage.updateStats();
+				return coverage;
+			};
+
+			// Shared, own and mismatching files, in directories and outside (written last)
+			MergeRunnerV2::DictCoverage output, merged;
+			output["C:\\b"]["x.cpp"] = make(1, 4);
+			output["C:\\b"]["a.cpp"] = make(2, 3);
+			output["C:\\a"]["z.cpp"] = make(1, 2);
+			output[""]["root.cpp"] = make(3, 5);
+			merged["C:\\b"]["x.cpp"] = make(5, 4);
+			merged["C:\\b"]["m.cpp"] = make(1, 1);
+			merged["C:\\b"]["a.cpp"] = make(1, 7);
+			merged["C:\\c"]["y.cpp"] = make(1, 2);
+			merged[""]["aaa.cpp"] = make(1, 1);
+
+			const auto outputReport = Write(output);
+			const auto mergedReport = Write(merged);
+			Assert::IsTrue(NativeV2Parser(outputReport).sorted());
+			Assert::IsTrue(outputReport.find("C:\\a") < outputReport.find("C:\\b"));
+			Assert::IsTrue(outputReport.find("x.cpp") > outputReport.find("a.cpp"));
+			Assert::IsTrue(outputReport.find("root.cpp") > outputReport.find("</directory>"));
+
+			// Same report as the dictionary merge
+			auto reference = merged;
+			MergeRunnerV2::merge(output, reference);
+
+			std::stringstream ss;
+			{
+				ReportEmitter out(ss);
+				MergeRunnerV2::mergeSorted(outputReport, mergedReport, out, false);
+			}
+			Assert::AreEqual(Write(reference), ss.str());
+
+			// Unsorted report announcing the canonical order
+			std::string unsorted = outputReport;
+			unsorted.replace(unsorted.find("x.cpp"), 5, "0.cpp");
+			std::stringstream ignored;
+			ReportEmitter out(ignored);
+			Assert::ExpectException<std::runtime_error>([&]() { MergeRunnerV2::mergeSorted(unsorted, mergedReport, out, false); });
+
+			// Reports without layout are not sorted
+			Assert::IsFalse(NativeV2Parser(R"(<CppCoverage version="2.0"></CppCoverage>)").sorted());
+		}
+
+		TEST_METHOD(ProfileMerge)
+		{
+			const auto c = FileCoverageV2::maskIsCode;
+			const auto make = [&](size_t size, size_t line, uint64_t deep, uint64_t shallow)
+			{
+				FileCoverageV2 coverage(size);
+				coverage._code[line] = c | 1;
+				coverage._nbLinesCode = 1;
+				coverage.updateStats();
+				coverage._samples.resize(size);
+				coverage._samples[line] = { deep, shallow };
+				return coverage;
+			};
+
+			MergeRunnerV2::DictCoverage output, merged;
+			output["C:\\a"]["hot.cpp"] = make(300, 250, 3000, 1);
+			output["C:\\a"]["cold.cpp"] = FileCoverageV2(4);
+			merged["C:\\a"]["hot.cpp"] = make(300, 250, 5000, 2);
+			merged["C:\\a"]["cold.cpp"] = make(4, 1, 2, 1);
+
+			// Files without samples have no <profile>
+			const auto outputReport = Write(output);
+			const auto mergedReport = Write(merged);
+			Assert::IsTrue(outputReport.find("<profile>") > outputReport.find("hot.cpp"));
+			Assert::IsTrue(mergedReport.find("<profile>") < mergedReport.find("hot.cpp"));
+
+			// Counts are summed, a file profiled in one report only keeps its counts
+			auto dict = MergeRunnerV2::createDictionary("demo", mergedReport);
+			MergeRunnerV2::merge(MergeRunnerV2::createDictionary("demo", outputReport), dict);
+			const auto& hot = dict["C:\\a"]["hot.cpp"];
+			Assert::AreEqual(size_t(300), hot._samples.size());
+			Assert::AreEqual(uint64_t(8000), hot._samples[250].deep);
+			Assert::AreEqual(uint64_t(3), hot._samples[250].shallow);
+			Assert::AreEqual(uint64_t(0), hot._samples[249].deep);
+			Assert::AreEqual(uint64_t(2), dict["C:\\a"]["cold.cpp"]._samples[1].deep);
+
+			std::stringstream ss;
+			{
+				ReportEmitter out(ss);
+				MergeRunnerV2::mergeSorted(outputReport, mergedReport, out, false);
+			}
+			Assert::AreEqual(Write(dict), ss.str());
+
+			// A profile must describe the lines of its coverage
+			std::string data;
+			merged["C:\\a"]["cold.cpp"].encodeSamples(data);
+			FileCoverageV2 other(300);
+			Assert::ExpectException<std::runtime_error>([&]() { other.decodeSamples(data); });
+		}
+
+		TEST_METHOD(RejectNewerVersion)
+		{
+			std::stringstream ss(R"(<?xml version="1.0" encoding="utf-8"?>)" "\n" R"(<CppCoverage version="3.5">)" "\n</CppCoverage>\n");
+			Assert::ExpectException<std::exception>([&]() { MergeRunnerV2::createDictionary("demo", ss.str()); });
+		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "CppUnitTest.h"
+#include <SDKDDKVer.h>
+
+#include "FileCoverageV2.h"
+#include "NativeV3.h"
+#include "ReportConverter.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace TestFormat
+{
+	TEST_CLASS(TestNativeV3)
+	{
+	public:
+
+		static FileCoverageV2 MakeCoverage(uint16_t seed)
+		{
+			const auto c = FileCoverageV2::maskIsCode;
+			const auto p = FileCoverageV2::maskIsPartial;
+			FileCoverageV2 coverage(7);
+			coverage._code = { 0, c, uint16_t(c | seed), uint16_t(c | p | 1), 0, uint16_t(c | (seed * 3)), c };
+			coverage.updateStats();
+			coverage.md5Code = "0123456789ABCDEFGHIJKLMNOPQRSTUV";
+			return coverage;
+		}
+
+		static std::string Write(NativeV3::Writer& writer)
+		{
+			std::ostringstream ss;
+			{
+				ReportEmitter out(ss);
+				writer.write(out);
+			}
+			return ss.str();
+		}
+
+		TEST_METHOD(RoundTrip)
+		{
+			const auto first = MakeCoverage(2);
+			const auto second = MakeCoverage(5);
+
+			NativeV3::Writer writer;
+			// Unsorted on purpose: the writer sorts the index
+			writer.add("src", "b.cpp", second);
+			writer.add("", "top.cpp", first);
+			writer.add("src", "a.cpp", first);
+			writer.add("lib", "a.cpp", second);
+			const std::string content = Write(writer);
+
+			Assert::IsTrue(NativeV3::IsNativeV3(content));
+			NativeV3::Reader reader{ std::string_view(content) };
+			Assert::AreEqual(size_t(3), reader.directories().size());
+			Assert::AreEqual(size_t(4), reader.files().size());
+
+			// Sorted directories with their files
+			Assert::AreEqual(std::string(""), std::string(reader.string(reader.directories()[0].path)));
+			Assert::AreEqual(std::string("lib"), std::string(reader.string(reader.directories()[1].path)));
+			Assert::AreEqual(std::string("src"), std::string(reader.string(reader.directories()[2].path)));
+			const auto srcFiles = reader.files(reader.directories()[2]);
+			Assert::AreEqual(size_t(2), srcFiles.size());
+			Assert::AreEqual(std::string("a.cpp"), std::string(reader.string(srcFiles[0].path)));
+			Assert::AreEqual(std::string("b.cpp"), std::string(reader.string(srcFiles[1].path)));
+
+			// Line arrays are aligned and lossless
+			const auto* entry = reader.find("src", "b.cpp");
+			Assert::IsNotNull(entry);
+			Assert::AreEqual(size_t(0), size_t(entry->linesOffset % NativeV3::LinesAlignment));
+			const auto coverage = reader.coverage(*entry);
+			Assert::IsTrue(second._code == coverage._code);
+			Assert::AreEqual(second._nbLinesFile, coverage._nbLinesFile);
+			Assert::AreEqual(second._nbLinesCode, coverage._nbLinesCode);
+			Assert::AreEqual(second._nbLinesCovered, coverage._nbLinesCovered);
+			Assert::AreEqual(second.md5Code, coverage.md5Code);
+
+			Assert::IsNull(reader.find("src", "c.cpp"));
+			Assert::IsNull(reader.find("other", "a.cpp"));
+		}
+
+		TEST_METHOD(Profiles)
+		{
+			auto profiled = MakeCoverage(3);
+			profiled._samples.resize(profiled._code.size());
+			profiled._samples[2] = { 40, 12 };
+			profiled._samples[5] = { 7, 0 };
+
+			NativeV3::Writer writer;
+			writer.add("src", "profiled.cpp", profiled);
+			writer.add("src", "plain.cpp", MakeCoverage(1));
+			const std::string content = Write(writer);
+
+			NativeV3::Reader reader{ std::string_view(content) };
+			Assert::AreEqual(uint64_t(0), reader.find("src", "plain.cpp")->samplesSize);
+			Assert::IsTrue(reader.coverage(*reader.find("src", "plain.cpp"))._samples.empty());
+
+			const auto coverage = reader.coverage(*reader.find("src", "profiled.cpp"));
+			Assert::AreEqual(profiled._samples.size(), coverage._samples.size());
+			for (size_t i = 0; i < profiled._samples.size(); ++i)
+			{
+				Assert::AreEqual(profiled._samples[i].deep, coverage._samples[i].deep);
+				Assert::AreEqual(profiled._samples[i].shallow, coverage._samples[i].shallow);
+			}
+
+			// Back to NativeV2 with the same profile
+			std::ostringstream v2;
+			{
+				ReportEmitter out(v2);
+				ReportConverter::ToNativeV2(reader, out);
+			}
+			std::string encoded;
+			profiled.encodeSamples(encoded);
+			std::string base64(FastBase64::EncodedLength(encoded.size()), '\0');
+			FastBase64::Encode(reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size(), base64.data());
+			Assert::IsTrue(v2.str().find(base64) != std::string::npos);
+		}
+
+		TEST_METHOD(ConvertFromNativeV2)
+		{
+			MergeRunnerV2::DictCoverage dict;
+			dict["src"]["a.cpp"] = MakeCoverage(4);
+			dict[""]["top.cpp"] = MakeCoverage(1);
+
+			std::ostringstream ss;
+			{
+				ReportEmitter out(ss);
+				ReportConverter::FromNativeV2(dict, out);
+			}
+			const std::string content = ss.str();
+
+			NativeV3::Reader reader{ std::string_view(content) };
+			for (const auto& [directory, files] : dict)
+			{
+				for (const auto& [path, reference] : files)
+				{
+					const auto* entry = reader.find(directory, path);
+					Assert::IsNotNull(entry);
+					Assert::IsTrue(reference._code == reader.coverage(*entry)._code);
+				}
+			}
+
+			// Back to NativeV2: files outside directories come last
+			std::ostringstream v2;
+			{
+				ReportEmitter out(v2);
+				ReportConverter::ToNativeV2(reader, out);
+			}
+			const std::string xml = v2.str();
+			Assert::IsTrue(xml.find(R"(<directory path="src">)") < xml.find(R"(<file path="top.cpp">)"));
+		}
+
+		TEST_METHOD(RejectCorrupted)
+		{
+			NativeV3::Writer writer;
+			writer.add("src", "a.cpp", MakeCoverage(1));
+			const std::string content = Write(writer);
+
+			Assert::ExpectException<std::runtime_error>([&]()
+			{
+				NativeV3::Reader reader{ std::string_view(content.data(), content.size() / 2) };
+			});
+			Assert::ExpectException<std::runtime_error>([&]()
+			{
+				NativeV3::Reader reader{ std::string_view("not a report") };
+			});
+		}
+	};
+}
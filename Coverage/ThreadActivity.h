@@ -0,0 +1,114 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+/// CPU time of the threads between two samples: a thread that did not run since the previous sample is blocked,
+/// its stack did not change and walking it again would only add wait frames to the profile.
+class ThreadActivity
+{
+public:
+  /// True when \p cpuTime of \p thread went up since the previous call, or on the first call for the thread.
+  bool ran(uint64_t thread, uint64_t cpuTime)
+  {
+    auto [it, inserted] = _cpuTimes.emplace(thread, cpuTime);
+    const bool active = inserted || cpuTime > it->second;
+    it->second = cpuTime;
+    ++(active ? _active : _idle);
+    return active;
+  }
+
+  void forget(uint64_t thread)
+  {
+    _cpuTimes.erase(thread);
+  }
+
+  uint64_t active() const { return _active; }   ///< ran() calls that returned true
+  uint64_t idle() const { return _idle; }
+
+#ifdef _WIN32
+  /// CPU cycles charged to \p thread. GetThreadTimes only moves at the clock interrupt (15.6ms by default): a thread
+  /// running less than that between two samples would look blocked.
+  static bool CpuTime(HANDLE thread, uint64_t& cpuTime)
+  {
+    ULONG64 cycles;
+    if (!QueryThreadCycleTime(thread, &cycles))
+    {
+      return false;
+    }
+    cpuTime = cycles;
+    return true;
+  }
+#endif
+
+  /// utime + stime (fields 14 and 15, clock ticks) of a /proc/<pid>/task/<tid>/stat line.
+  /// The command name (field 2) is in parentheses and may contain spaces and parentheses: fields are counted from the last ')'.
+  static bool ParseStat(std::string_view stat, uint64_t& cpuTime)
+  {
+    auto pos = stat.rfind(')');
+    if (pos == std::string_view::npos)
+    {
+      return false;
+    }
+
+    // Field 3 (state) follows the command
+    uint64_t utime = 0;
+    size_t field = 2;
+    for (++pos; pos < stat.size() && field < 15;)
+    {
+      while (pos < stat.size() && stat[pos] == ' ')
+      {
+        ++pos;
+      }
+      auto end = stat.find(' ', pos);
+      end = end == std::string_view::npos ? stat.size() : end;
+      if (pos == end)
+      {
+        break;
+      }
+
+      ++field;
+      if (field == 14 || field == 15)
+      {
+        uint64_t value;
+        auto result = std::from_chars(stat.data() + pos, stat.data() + end, value);
+        if (result.ec != std::errc() || result.ptr != stat.data() + end)
+        {
+          return false;
+        }
+        if (field == 14)
+        {
+          utime = value;
+        }
+        else
+        {
+          cpuTime = utime + value;
+          return true;
+        }
+      }
+      pos = end;
+    }
+    return false;
+  }
+
+  /// CPU time of a Linux task, in clock ticks.
+  static bool TaskCpuTime(uint32_t pid, uint32_t tid, uint64_t& cpuTime)
+  {
+    std::ifstream file("/proc/" + std::to_string(pid) + "/task/" + std::to_string(tid) + "/stat");
+    std::string stat;
+    return std::getline(file, stat) && ParseStat(stat, cpuTime);
+  }
+
+private:
+  std::unordered_map<uint64_t, uint64_t> _cpuTimes;
+  uint64_t _active = 0;
+  uint64_t _idle = 0;
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+/// Why a thread is blocked at a sample: a leaf frame of the off-CPU profiles, so that the time waiting on locks,
+/// sleeps and I/O is told apart under the same call path.
+/// - Linux: system call the task is blocked in (/proc/<pid>/task/<tid>/syscall), or its kernel wait function (wchan)
+///   when the system call cannot be read,
+/// - Windows: ntdll system call stub at the top of the stack.
+struct WaitReason
+{
+  enum Reason : uint8_t
+  {
+    Unknown,
+    Futex,      ///< Locks, condition variables, joins
+    Sleep,
+    Read,
+    Write,
+    Poll,       ///< poll / select / epoll, I/O completion ports, message loops
+    Socket,     ///< accept, connect, send / receive
+    Object,     ///< Windows kernel objects: events, semaphores, process and thread handles
+    Child,      ///< Waiting for a child process
+    Sync,       ///< Flush to disk
+    Signal,
+    Count
+  };
+
+  static std::string_view Name(Reason reason)
+  {
+    static constexpr std::string_view names[Count] =
+    {
+      "unknown", "futex", "sleep", "read", "write", "poll", "socket", "object", "child", "sync", "signal"
+    };
+    return reason < Count ? names[reason] : names[Unknown];
+  }
+
+  /// Blocking system calls of the native Linux ABI.
+  static Reason FromSyscall(uint64_t number)
+  {
+#if defined(__aarch64__)
+    switch (number)
+    {
+      case 98: case 449: return Futex;
+      case 101: case 115: return Sleep;
+      case 63: case 65: case 67: return Read;
+      case 64: case 66: case 68: return Write;
+      case 22: case 72: case 73: case 441: case 4: case 426: return Poll;
+      case 202: case 203: case 206: case 207: case 211: case 212: case 242: return Socket;
+      case 95: case 260: return Child;
+      case 32: case 82: case 83: return Sync;
+      case 133: case 137: return Signal;
+    }
+#else
+    switch (number)
+    {
+      case 202: case 449: return Futex;
+      case 35: case 230: return Sleep;
+      case 0: case 17: case 19: return Read;
+      case 1: case 18: case 20: return Write;
+      case 7: case 23: case 232: case 270: case 271: case 281: case 441: case 208: case 426: return Poll;
+      case 42: case 43: case 44: case 45: case 46: case 47: case 288: return Socket;
+      case 61: case 247: return Child;
+      case 73: case 74: case 75: return Sync;
+      case 34: case 128: case 130: return Signal;
+    }
+#endif
+    return Unknown;
+  }
+
+  /// Kernel wait function of a task (/proc/<pid>/task/<tid>/wchan), as "futex_do_wait" or "anon_pipe_read".
+  static Reason FromKernelFunction(std::string_view name)
+  {
+    const auto has = [&](std::string_view part) { return name.find(part) != std::string_view::npos; };
+    if (has("futex"))
+      return Futex;
+    if (has("nanosleep"))
+      return Sleep;
+    if (has("poll") || has("select"))
+      return Poll;
+    if (has("sk_wait") || has("inet_") || has("tcp_") || has("unix_stream"))
+      return Socket;
+    if (has("_read"))
+      return Read;
+    if (has("_write"))
+      return Write;
+    if (has("do_wait"))
+      return Child;
+    if (has("sigsuspend") || has("sigtimedwait"))
+      return Signal;
+    return Unknown;
+  }
+
+  /// System call stub of ntdll / win32u (Nt or Zw prefix).
+  static Reason FromFunction(std::string_view name)
+  {
+    if (name.starts_with("Zw"))
+    {
+      name.remove_prefix(2);
+    }
+    else if (name.starts_with("Nt"))
+    {
+      name.remove_prefix(name.starts_with("NtUser") ? 6 : 2);
+    }
+    else
+    {
+      return Unknown;
+    }
+
+    // SRW locks, critical sections, condition variables and WaitOnAddress park on the thread id or a keyed event
+    if (name == "WaitForAlertByThreadId" || name == "WaitForKeyedEvent")
+      return Futex;
+    if (name == "DelayExecution")
+      return Sleep;
+    if (name == "ReadFile" || name == "ReadFileScatter")
+      return Read;
+    if (name == "WriteFile" || name == "WriteFileGather")
+      return Write;
+    if (name == "RemoveIoCompletion" || name == "RemoveIoCompletionEx" || name == "WaitForWorkViaWorkerFactory" ||
+        name == "GetMessage" || name == "WaitMessage" || name == "MsgWaitForMultipleObjectsEx")
+      return Poll;
+    // Winsock calls are device I/O controls on the AFD driver
+    if (name == "DeviceIoControlFile")
+      return Socket;
+    if (name == "WaitForSingleObject" || name == "WaitForMultipleObjects" || name == "SignalAndWaitForSingleObject")
+      return Object;
+    if (name == "FlushBuffersFile" || name == "FlushBuffersFileEx")
+      return Sync;
+    return Unknown;
+  }
+
+  /// System call number of a /proc/<pid>/task/<tid>/syscall line ("202 0x7ffd... ..."). False when the task is not
+  /// in a system call ("running", "-1 sp pc").
+  static bool ParseSyscall(std::string_view line, uint64_t& number)
+  {
+    const auto end = line.find(' ');
+    const auto field = line.substr(0, end);
+    auto result = std::from_chars(field.data(), field.data() + field.size(), number);
+    return !field.empty() && result.ec == std::errc() && result.ptr == field.data() + field.size();
+  }
+
+  /// Task state (field 3) of a /proc/<pid>/task/<tid>/stat line: 'R' running, 'S' sleeping, 'D' uninterruptible...
+  /// Fields are counted from the last ')': the command name may contain any character.
+  static bool ParseState(std::string_view stat, char& state)
+  {
+    auto pos = stat.rfind(')');
+    if (pos == std::string_view::npos || pos + 2 >= stat.size())
+    {
+      return false;
+    }
+    state = stat[pos + 2];
+    return true;
+  }
+
+  /// Reason of a blocked Linux task. Returns false when the task runs or is gone.
+  static bool TaskReason(uint32_t pid, uint32_t tid, Reason& reason)
+  {
+    const auto task = "/proc/" + std::to_string(pid) + "/task/" + std::to_string(tid) + "/";
+    const auto readLine = [&](const char* name)
+    {
+      std::ifstream file(task + name);
+      std::string line;
+      std::getline(file, line);
+      return line;
+    };
+
+    char state;
+    if (!ParseState(readLine("stat"), state) || state == 'R')
+    {
+      return false;
+    }
+
+    // The system call is only readable with ptrace access to the task; the wait function is often hidden ("0")
+    uint64_t number;
+    reason = ParseSyscall(readLine("syscall"), number) ? FromSyscall(number) : Unknown;
+    if (reason == Unknown)
+    {
+      reason = FromKernelFunction(readLine("wchan"));
+    }
+    return true;
+  }
+};
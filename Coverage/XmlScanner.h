@@ -0,0 +1,150 @@
+#pragma once
+
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/// Fast non-validating scanner of the XML reports written by this tool (usually a memory mapping).
+/// Tags are read one at a time, attribute values and texts are views into the content and are not unescaped:
+/// the writers do not escape them.
+class XmlScanner
+{
+public:
+  /// \param[in] content: whole report.
+  /// \param[in] format: report name for error messages.
+  XmlScanner(std::string_view content, std::string_view format) :
+    _content(content),
+    _format(format)
+  {}
+
+  /// Content between '<' and '>' of the next tag (without a closing '/' for empty elements).
+  /// Throws std::runtime_error on unterminated tag.
+  bool nextTag(std::string_view& tag)
+  {
+    const auto begin = _content.find('<', _pos);
+    if (begin == std::string_view::npos)
+    {
+      return false;
+    }
+    const auto end = _content.find('>', begin + 1);
+    if (end == std::string_view::npos)
+    {
+      throw std::runtime_error("Unterminated tag in " + std::string(_format) + " report");
+    }
+
+    tag = _content.substr(begin + 1, end - begin - 1);
+    if (tag.ends_with('/'))
+    {
+      tag.remove_suffix(1);
+    }
+    _pos = end + 1;
+    return true;
+  }
+
+  /// True for <?xml ...?>, comments and other declarations.
+  static bool isDeclaration(std::string_view tag)
+  {
+    return tag.starts_with("?") || tag.starts_with("!");
+  }
+
+  static std::string_view tagName(std::string_view tag)
+  {
+    size_t end = 0;
+    while (end < tag.size() && !isSpace(tag[end]))
+    {
+      ++end;
+    }
+    return tag.substr(0, end);
+  }
+
+  /// Value of attribute \p name (empty when missing).
+  std::string_view attribute(std::string_view tag, std::string_view name) const
+  {
+    size_t pos = tagName(tag).size();
+    while (pos < tag.size())
+    {
+      while (pos < tag.size() && isSpace(tag[pos]))
+      {
+        ++pos;
+      }
+      const auto equal = tag.find('=', pos);
+      if (equal == std::string_view::npos)
+      {
+        break;
+      }
+
+      // Clover metrics are written as ncloc = "..."
+      auto quote = equal + 1;
+      while (quote < tag.size() && isSpace(tag[quote]))
+      {
+        ++quote;
+      }
+      if (quote >= tag.size() || tag[quote] != '"')
+      {
+        break;
+      }
+      const auto close = tag.find('"', quote + 1);
+      if (close == std::string_view::npos)
+      {
+        throw std::runtime_error("Unterminated attribute in " + std::string(_format) + " report");
+      }
+
+      auto key = tag.substr(pos, equal - pos);
+      while (!key.empty() && isSpace(key.back()))
+      {
+        key.remove_suffix(1);
+      }
+      if (key == name)
+      {
+        return tag.substr(quote + 1, close - quote - 1);
+      }
+      pos = close + 1;
+    }
+    return {};
+  }
+
+  /// Text up to the next tag, without surrounding white spaces.
+  std::string_view text() const
+  {
+    auto end = _content.find('<', _pos);
+    if (end == std::string_view::npos)
+    {
+      end = _content.size();
+    }
+
+    auto value = _content.substr(_pos, end - _pos);
+    while (!value.empty() && isSpace(value.front()))
+    {
+      value.remove_prefix(1);
+    }
+    while (!value.empty() && isSpace(value.back()))
+    {
+      value.remove_suffix(1);
+    }
+    return value;
+  }
+
+  /// Throws std::runtime_error when \p value is not an unsigned number.
+  template <typename T = size_t>
+  T number(std::string_view value) const
+  {
+    T result = 0;
+    const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (ec != std::errc() || ptr != value.data() + value.size())
+    {
+      throw std::runtime_error("Invalid number in " + std::string(_format) + " report: " + std::string(value));
+    }
+    return result;
+  }
+
+private:
+  static bool isSpace(char c)
+  {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  std::string_view _content;
+  std::string_view _format;
+  size_t _pos = 0;
+};
@@ -30,7 +30,18 @@
 
 class Base64 {
 public:
+  static constexpr size_t EncodedLength(size_t in_len) {
+    return 4 * ((in_len + 2) / 3);
+  }
+
   static std::string Encode(const std::string& data) {
+    std::string ret(EncodedLength(data.size()), '\0');
+    Encode(reinterpret_cast<const uint8_t*>(data.data()), data.size(), ret.data());
+    return ret;
+  }
+
+  /// Encode \p in_len bytes directly into \p p, which must hold EncodedLength(in_len) characters.
+  static void Encode(const uint8_t* data, size_t in_len, char* p) {
     static constexpr char sEncodingTable[] = {
       'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M',
       'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z',
@@ -39,11 +50,7 @@ public:
       '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '/'
     };
 
-    size_t in_len = data.size();
-    size_t out_len = 4 * ((in_len + 2) / 3);
-    std::string ret(out_len, '\0');
     size_t i;
-    char* p = const_cast<char*>(ret.c_str());
 
     for (i = 0; in_len > 2 && i < in_len - 2; i += 3)
     {
@@ -70,8 +77,6 @@ public:
       }
       *p++ = '=';
     }
-
-    return ret;
   }
 
   static void Decode(const std::string& input, std::string& out) {
@@ -18,16 +18,60 @@ namespace NubiloSoft.CoverageExt.Native
             public FileCoverageStats stats;
             ushort[] _lines;
 
-            internal void addCoverage(string encodedString)
+            internal void addCoverage(string encodedString, string encoding)
             {
                 byte[] data = Convert.FromBase64String(encodedString);
-                Debug.Assert(data.Length % 2 == 0);
+                if (String.IsNullOrEmpty(encoding))
+                {
+                    Debug.Assert(data.Length % 2 == 0);
+
+                    _lines = new ushort[data.Length / 2];
+                    for (UInt32 objIndex = 0; objIndex < _lines.Length; ++objIndex)
+                    {
+                        UInt32 id = objIndex * sizeof(UInt16);
+                        _lines[objIndex] = (ushort)((data[id + 1] << 8) + data[id]);
+                    }
+                    return;
+                }
+
+                // Check CompactLines.h : it's must be the same
+                int pos = 0;
+                _lines = new ushort[readVarint(data, ref pos)];
+                int index = 0;
+                while (pos < data.Length)
+                {
+                    int first = (int)readVarint(data, ref pos);
+                    ushort value = (ushort)readVarint(data, ref pos);
+                    if (encoding == "rle")
+                    {
+                        for (int i = 0; i < first; ++i)
+                        {
+                            _lines[index++] = value;
+                        }
+                    }
+                    else if (encoding == "sparse")
+                    {
+                        index += first;
+                        _lines[index++] = value;
+                    }
+                    else
+                    {
+                        throw new FormatException("Unsupported line encoding: " + encoding);
+                    }
+                }
+            }
 
-                _lines = new ushort[data.Length / 2];
-                for (UInt32 objIndex = 0; objIndex < _lines.Length; ++objIndex)
+            static ulong readVarint(byte[] data, ref int pos)
+            {
+                ulong value = 0;
+                for (int shift = 0; ; shift += 7)
                 {
-                    UInt32 id = objIndex * sizeof(UInt16);
-                    _lines[objIndex] = (ushort)((data[id + 1] << 8) + data[id]);
+                    byte b = data[pos++];
+                    value |= (ulong)(b & 0x7F) << shift;
+                    if ((b & 0x80) == 0)
+                    {
+                        return value;
+                    }
                 }
             }
             // Check FileCoverageV2.h : it's must be the same
@@ -142,7 +186,7 @@ namespace NubiloSoft.CoverageExt.Native
                 //Read coverage :
                 else if (fileItem.LocalName == "coverage")
                 {
-                    coverage.addCoverage(fileItem.InnerText);
+                    coverage.addCoverage(fileItem.InnerText, fileItem.Attributes["encoding"]?.InnerText);
                 }
             }
             lookup.Add(currentFile, coverage);
@@ -156,6 +200,13 @@ namespace NubiloSoft.CoverageExt.Native
             XmlDocument xmlDoc = new XmlDocument();
             xmlDoc.Load(filename);
 
+            // 2.1 adds run-length/sparse line encodings
+            string version = xmlDoc.DocumentElement?.Attributes["version"]?.InnerText;
+            if (version != "2.0" && version != "2.1")
+            {
+                throw new FormatException("Unsupported NativeV2 version: " + version);
+            }
+
             {
                 XmlNodeList filesNodes = xmlDoc.SelectNodes("/CppCoverage/file");
                 foreach (XmlNode item in filesNodes)